@@ -0,0 +1,770 @@
+#pragma once
+#include <memory>
+#include <iostream>
+#include <optional>
+#include <mutex>
+#include <shared_mutex>
+#include <cmath>
+#include <exception>
+#include <variant>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include "CacheErrorCodes.h"
+#include "ErrorCodes.h"
+#include "VariadicNthType.h"
+#include <tuple>
+
+#include <iostream>
+#include <fstream>
+#include <assert.h>
+
+#define __CONCURRENT__
+//#define __TREE_AWARE_CACHE__
+
+/*
+ * B-epsilon tree on the same cache and storage stack as BPlusStore. The updates are not applied to the leaves
+ * right away, they are added as messages to the root's buffer and move down a level at a time, a full buffer
+ * flushing the messages of its busiest child in one go. A leaf is thus written once per batch rather than once
+ * per update, at the cost of looking into the buffers on the way down when searching.
+ * The index nodes are IndexNodeWithBuffer, the data nodes are the same as BPlusStore's.
+ * Unlike BPlusStore, an insert of an existing key overwrites its value and a remove of a missing key is not an
+ * error. The writers are serialized on the tree's mutex.
+ */
+#ifdef __TREE_AWARE_CACHE__
+template <typename ICallback, typename KeyType, typename ValueType, typename CacheType>
+class BEpsilonStore : public ICallback
+#else // !__TREE_AWARE_CACHE__
+template <typename KeyType, typename ValueType, typename CacheType>
+class BEpsilonStore
+#endif __TREE_AWARE_CACHE__
+{
+    typedef CacheType::ObjectUIDType ObjectUIDType;
+    typedef CacheType::ObjectType ObjectType;
+    typedef CacheType::ObjectTypePtr ObjectTypePtr;
+
+    using DataNodeType = typename std::tuple_element<0, typename ObjectType::ObjectCoreTypes>::type;
+    using IndexNodeType = typename std::tuple_element<1, typename ObjectType::ObjectCoreTypes>::type;
+
+private:
+    uint32_t m_nDegree;
+    uint32_t m_nBufferSize;     // messages an index node holds before it flushes some of them to a child.
+    std::shared_ptr<CacheType> m_ptrCache;
+    std::optional<ObjectUIDType> m_uidRootNode;
+
+#ifdef __CONCURRENT__
+    mutable std::shared_mutex m_mutex;
+#endif __CONCURRENT__
+
+public:
+    ~BEpsilonStore()
+    {
+    }
+
+    template<typename... CacheArgs>
+    BEpsilonStore(uint32_t nDegree, uint32_t nBufferSize, CacheArgs... args)
+        : m_nDegree(nDegree)
+        , m_nBufferSize(nBufferSize)
+        , m_uidRootNode(std::nullopt)
+    {
+        m_ptrCache = std::make_shared<CacheType>(args...);
+    }
+
+    template <typename DefaultNodeType>
+    void init()
+    {
+#ifdef __TREE_AWARE_CACHE__
+        m_ptrCache->init(this);
+#endif __TREE_AWARE_CACHE__
+
+        m_ptrCache->template createObjectOfType<DefaultNodeType>(m_uidRootNode);
+    }
+
+    ErrorCode insert(const KeyType& key, const ValueType& value)
+    {
+        return addMessage(key, IndexNodeType::MessageType::Insert, value);
+    }
+
+    // Adds the delta to the key's value, a missing key is inserted with the delta. ValueType must provide operator+.
+    ErrorCode upsert(const KeyType& key, const ValueType& delta)
+    {
+        return addMessage(key, IndexNodeType::MessageType::Upsert, delta);
+    }
+
+    ErrorCode remove(const KeyType& key)
+    {
+        return addMessage(key, IndexNodeType::MessageType::Delete, ValueType());
+    }
+
+    ErrorCode search(const KeyType& key, ValueType& value)
+    {
+        ErrorCode errCode = ErrorCode::KeyDoesNotExist;
+
+        std::vector<std::pair<ObjectUIDType, ObjectTypePtr>> vtAccessedNodes;
+
+        std::vector<ValueType> vtDeltas;    // the upserts pending for the key, the newest first.
+
+#ifdef __CONCURRENT__
+        std::shared_lock<std::shared_mutex> lock_tree(m_mutex);
+#endif __CONCURRENT__
+
+        ObjectUIDType uidCurrentNode = *m_uidRootNode;
+        ObjectTypePtr ptrLastNode = nullptr, ptrCurrentNode = nullptr;
+
+        do
+        {
+            getNode(ptrLastNode, uidCurrentNode, ptrCurrentNode);
+
+            vtAccessedNodes.push_back(std::make_pair(uidCurrentNode, ptrCurrentNode));
+
+            if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data))
+            {
+                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data);
+
+                uint8_t nType;
+                ValueType messageValue;
+                if (ptrIndexNode->getMessage(key, nType, messageValue) == ErrorCode::Success)
+                {
+                    if (nType == IndexNodeType::MessageType::Upsert)
+                    {
+                        vtDeltas.push_back(messageValue);
+                    }
+                    else
+                    {
+                        // The message overrides whatever there is below.
+                        if (nType == IndexNodeType::MessageType::Insert)
+                        {
+                            value = messageValue;
+                            errCode = ErrorCode::Success;
+                        }
+                        break;
+                    }
+                }
+
+                ptrLastNode = ptrCurrentNode;
+                uidCurrentNode = ptrIndexNode->getChild(key);
+            }
+            else if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*ptrCurrentNode->data))
+            {
+                std::shared_ptr<DataNodeType> ptrDataNode = std::get<std::shared_ptr<DataNodeType>>(*ptrCurrentNode->data);
+
+                errCode = ptrDataNode->getValue(key, value);
+                break;
+            }
+        } while (true);
+
+        for (auto it = vtDeltas.rbegin(); it != vtDeltas.rend(); it++)
+        {
+            if (errCode == ErrorCode::Success)
+            {
+                value = value + *it;
+            }
+            else
+            {
+                value = *it;
+                errCode = ErrorCode::Success;
+            }
+        }
+
+        m_ptrCache->reorder(vtAccessedNodes, false);
+        vtAccessedNodes.clear();
+
+        return errCode;
+    }
+
+    void print(std::ofstream& out)
+    {
+        int nSpace = 7;
+
+        std::string prefix;
+
+        out << prefix << "|" << std::endl;
+        out << prefix << "|" << std::string(nSpace, '-').c_str() << "(root)";
+
+        out << std::endl;
+
+        ObjectUIDType uidRootNode = *m_uidRootNode;
+        ObjectTypePtr ptrRootNode = nullptr;
+        getNode(nullptr, uidRootNode, ptrRootNode);
+
+        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrRootNode->data))
+        {
+            std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrRootNode->data);
+
+            ptrIndexNode->template print<std::shared_ptr<CacheType>, ObjectTypePtr, DataNodeType>(out, m_ptrCache, 0, prefix);
+        }
+        else if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*ptrRootNode->data))
+        {
+            std::shared_ptr<DataNodeType> ptrDataNode = std::get<std::shared_ptr<DataNodeType>>(*ptrRootNode->data);
+
+            ptrDataNode->print(out, 0, prefix);
+        }
+    }
+
+    void getCacheState(size_t& lru, size_t& map)
+    {
+        return m_ptrCache->getCacheState(lru, map);
+    }
+
+    // bytes is the size of the cached nodes as reported by their getSize.
+    void getCacheState(size_t& lru, size_t& map, size_t& bytes)
+    {
+        return m_ptrCache->getCacheState(lru, map, bytes);
+    }
+
+private:
+    /*
+     * The nodes touched by an update are kept in vtAccessedNodes until it is over, so that the cache cannot evict
+     * them halfway. The list is handed to reorder, which leaves its first entries the most recent, and a node is
+     * always (re)added right after its parent, i.e. a parent stays more recent than its children and can be
+     * flushed to storage after them. nParentPos is the parent's position in the list.
+     */
+    ErrorCode addMessage(const KeyType& key, uint8_t nType, const ValueType& value)
+    {
+        std::vector<std::pair<ObjectUIDType, ObjectTypePtr>> vtAccessedNodes;
+
+#ifdef __CONCURRENT__
+        std::unique_lock<std::shared_mutex> lock_tree(m_mutex);
+#endif __CONCURRENT__
+
+        ObjectUIDType uidRootNode = *m_uidRootNode;
+        ObjectTypePtr ptrRootNode = nullptr;
+        getNode(nullptr, uidRootNode, ptrRootNode);
+
+        vtAccessedNodes.push_back(std::make_pair(uidRootNode, ptrRootNode));
+
+        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrRootNode->data))
+        {
+            std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrRootNode->data);
+
+            ptrIndexNode->addMessage(key, nType, value);
+
+#ifdef __TREE_AWARE_CACHE__
+            ptrRootNode->dirty = true;
+#endif __TREE_AWARE_CACHE__
+
+            flushBuffer(ptrRootNode, 0, vtAccessedNodes);
+        }
+        else if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*ptrRootNode->data))
+        {
+            std::shared_ptr<DataNodeType> ptrDataNode = std::get<std::shared_ptr<DataNodeType>>(*ptrRootNode->data);
+
+            applyMessage(ptrDataNode, key, nType, value);
+
+#ifdef __TREE_AWARE_CACHE__
+            ptrRootNode->dirty = true;
+#endif __TREE_AWARE_CACHE__
+        }
+
+        do
+        {
+            if (requireSplit(ptrRootNode))
+            {
+                // The root object is kept (see BPlusStore::getRootNode), its content moves a level down instead.
+                std::optional<ObjectUIDType> uidLHSNode;
+                moveOutOfRootNode(ptrRootNode, uidLHSNode);
+
+                *ptrRootNode->data = std::make_shared<IndexNodeType>(*uidLHSNode);
+
+#ifdef __TREE_AWARE_CACHE__
+                ptrRootNode->dirty = true;
+#endif __TREE_AWARE_CACHE__
+
+                ObjectUIDType uidChildNode = *uidLHSNode;
+                ObjectTypePtr ptrChildNode = nullptr;
+                getChildNode(ptrRootNode, 0, uidChildNode, ptrChildNode, vtAccessedNodes);
+
+                splitChildNode(ptrRootNode, 0, ptrChildNode, vtAccessedNodes);
+            }
+            else if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrRootNode->data)
+                && std::get<std::shared_ptr<IndexNodeType>>(*ptrRootNode->data)->getKeysCount() == 0)
+            {
+                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrRootNode->data);
+
+                // The root has a single child left, its messages go down before the child takes its place.
+                flushToChild(ptrRootNode, 0, 0, vtAccessedNodes);
+
+                if (ptrIndexNode->getKeysCount() == 0)
+                {
+                    moveIntoRootNode(ptrRootNode, ptrIndexNode->getChildAt(0));
+                }
+            }
+            else
+            {
+                break;
+            }
+        } while (true);
+
+        m_ptrCache->reorder(vtAccessedNodes, false);
+        vtAccessedNodes.clear();
+
+        return ErrorCode::Success;
+    }
+
+    // Flushes the busiest children until the node's buffer is within the limit again.
+    inline void flushBuffer(ObjectTypePtr ptrNode, size_t nPos, std::vector<std::pair<ObjectUIDType, ObjectTypePtr>>& vtAccessedNodes)
+    {
+        std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrNode->data);
+
+        while (ptrIndexNode->requireFlush(m_nBufferSize))
+        {
+            flushToChild(ptrNode, nPos, ptrIndexNode->getChildNodeIdxWithMostMessages(), vtAccessedNodes);
+        }
+    }
+
+    // Moves the parent's messages for the child at nChildIdx into the child and restructures the child if needed.
+    inline void flushToChild(ObjectTypePtr ptrParentNode, size_t nParentPos, size_t nChildIdx, std::vector<std::pair<ObjectUIDType, ObjectTypePtr>>& vtAccessedNodes)
+    {
+        std::shared_ptr<IndexNodeType> ptrParentIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrParentNode->data);
+
+        std::vector<KeyType> vtKeys;
+        std::vector<uint8_t> vtTypes;
+        std::vector<ValueType> vtValues;
+        ptrParentIndexNode->takeMessages(nChildIdx, vtKeys, vtTypes, vtValues);
+
+        if (vtKeys.size() == 0)
+        {
+            return;
+        }
+
+#ifdef __TREE_AWARE_CACHE__
+        ptrParentNode->dirty = true;
+#endif __TREE_AWARE_CACHE__
+
+        ObjectUIDType uidChildNode = ptrParentIndexNode->getChildAt(nChildIdx);
+        ObjectTypePtr ptrChildNode = nullptr;
+        getChildNode(ptrParentNode, nParentPos, uidChildNode, ptrChildNode, vtAccessedNodes);
+
+        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrChildNode->data))
+        {
+            std::shared_ptr<IndexNodeType> ptrChildIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrChildNode->data);
+
+            ptrChildIndexNode->addMessages(vtKeys, vtTypes, vtValues);
+
+#ifdef __TREE_AWARE_CACHE__
+            ptrChildNode->dirty = true;
+#endif __TREE_AWARE_CACHE__
+
+            flushBuffer(ptrChildNode, nParentPos + 1, vtAccessedNodes);
+        }
+        else if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*ptrChildNode->data))
+        {
+            std::shared_ptr<DataNodeType> ptrChildDataNode = std::get<std::shared_ptr<DataNodeType>>(*ptrChildNode->data);
+
+            for (size_t nIdx = 0; nIdx < vtKeys.size(); nIdx++)
+            {
+                applyMessage(ptrChildDataNode, vtKeys[nIdx], vtTypes[nIdx], vtValues[nIdx]);
+            }
+
+#ifdef __TREE_AWARE_CACHE__
+            ptrChildNode->dirty = true;
+#endif __TREE_AWARE_CACHE__
+        }
+
+        if (requireSplit(ptrChildNode))
+        {
+            splitChildNode(ptrParentNode, nParentPos, ptrChildNode, vtAccessedNodes);
+        }
+        else
+        {
+            rebalanceChildNode(ptrParentNode, nParentPos, uidChildNode, ptrChildNode, vtKeys.front(), vtAccessedNodes);
+        }
+    }
+
+    // Splits the child until all of its parts are within the degree.
+    inline void splitChildNode(ObjectTypePtr ptrParentNode, size_t nParentPos, ObjectTypePtr ptrChildNode, std::vector<std::pair<ObjectUIDType, ObjectTypePtr>>& vtAccessedNodes)
+    {
+        std::shared_ptr<IndexNodeType> ptrParentIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrParentNode->data);
+
+        while (requireSplit(ptrChildNode))
+        {
+            std::optional<ObjectUIDType> uidRHSNode;
+            KeyType pivotKey;
+            ErrorCode errCode = ErrorCode::Error;
+
+            if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrChildNode->data))
+            {
+                std::shared_ptr<IndexNodeType> ptrChildIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrChildNode->data);
+                errCode = ptrChildIndexNode->template split<std::shared_ptr<CacheType>>(m_ptrCache, uidRHSNode, pivotKey);
+            }
+            else if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*ptrChildNode->data))
+            {
+                std::shared_ptr<DataNodeType> ptrChildDataNode = std::get<std::shared_ptr<DataNodeType>>(*ptrChildNode->data);
+                errCode = ptrChildDataNode->template split<std::shared_ptr<CacheType>>(m_ptrCache, uidRHSNode, pivotKey);
+            }
+
+            if (errCode != ErrorCode::Success)
+            {
+                throw new std::exception("should not occur!");
+            }
+
+            ptrParentIndexNode->insert(pivotKey, *uidRHSNode);
+
+#ifdef __TREE_AWARE_CACHE__
+            ptrParentNode->dirty = true;
+            ptrChildNode->dirty = true;
+#endif __TREE_AWARE_CACHE__
+
+            ObjectUIDType uidRHSChildNode = *uidRHSNode;
+            ObjectTypePtr ptrRHSNode = nullptr;
+            getChildNode(ptrParentNode, nParentPos, uidRHSChildNode, ptrRHSNode, vtAccessedNodes);
+
+            splitChildNode(ptrParentNode, nParentPos, ptrRHSNode, vtAccessedNodes);
+        }
+    }
+
+    // Borrows from or merges with the siblings until the child (or what it merged into) is within the degree.
+    inline void rebalanceChildNode(ObjectTypePtr ptrParentNode, size_t nParentPos, ObjectUIDType uidChildNode, ObjectTypePtr ptrChildNode, const KeyType& keyChild
+        , std::vector<std::pair<ObjectUIDType, ObjectTypePtr>>& vtAccessedNodes)
+    {
+        std::shared_ptr<IndexNodeType> ptrParentIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrParentNode->data);
+
+        bool bMerged = false;
+
+        while (ptrParentIndexNode->getChildrenCount() > 1 && requireMerge(ptrChildNode))
+        {
+            std::optional<ObjectUIDType> uidToDelete = std::nullopt;
+
+            if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrChildNode->data))
+            {
+                std::shared_ptr<IndexNodeType> ptrChildIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrChildNode->data);
+
+                ptrParentIndexNode->template rebalanceIndexNode<std::shared_ptr<CacheType>, shared_ptr<IndexNodeType>>(m_ptrCache, uidChildNode, ptrChildIndexNode, keyChild, m_nDegree, uidToDelete);
+            }
+            else if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*ptrChildNode->data))
+            {
+                std::shared_ptr<DataNodeType> ptrChildDataNode = std::get<std::shared_ptr<DataNodeType>>(*ptrChildNode->data);
+
+                ptrParentIndexNode->template rebalanceDataNode<std::shared_ptr<CacheType>, shared_ptr<DataNodeType>>(m_ptrCache, uidChildNode, ptrChildDataNode, keyChild, m_nDegree, uidToDelete);
+            }
+
+#ifdef __TREE_AWARE_CACHE__
+            ptrParentNode->dirty = true;
+            ptrChildNode->dirty = true;
+#endif __TREE_AWARE_CACHE__
+
+            if (!uidToDelete)
+            {
+                continue;
+            }
+
+            bMerged = true;
+
+            if (*uidToDelete == uidChildNode)
+            {
+                // The child went into its left sibling, carry on with that one.
+                ptrChildNode = nullptr;
+                m_ptrCache->remove(*uidToDelete);
+
+                uidChildNode = ptrParentIndexNode->getChild(keyChild);
+                getChildNode(ptrParentNode, nParentPos, uidChildNode, ptrChildNode, vtAccessedNodes);
+            }
+            else
+            {
+                m_ptrCache->remove(*uidToDelete);
+            }
+        }
+
+        if (!bMerged)
+        {
+            return;
+        }
+
+        // A merged node can exceed the limits.
+        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrChildNode->data))
+        {
+            vtAccessedNodes.insert(vtAccessedNodes.begin() + nParentPos + 1, std::make_pair(uidChildNode, ptrChildNode));
+            flushBuffer(ptrChildNode, nParentPos + 1, vtAccessedNodes);
+        }
+
+        splitChildNode(ptrParentNode, nParentPos, ptrChildNode, vtAccessedNodes);
+    }
+
+    inline void applyMessage(std::shared_ptr<DataNodeType> ptrDataNode, const KeyType& key, uint8_t nType, const ValueType& value)
+    {
+        switch (nType)
+        {
+        case IndexNodeType::MessageType::Insert:
+            ptrDataNode->remove(key);
+            ptrDataNode->insert(key, value);
+            break;
+        case IndexNodeType::MessageType::Delete:
+            ptrDataNode->remove(key);
+            break;
+        case IndexNodeType::MessageType::Upsert:
+        {
+            ValueType valueExisting;
+            if (ptrDataNode->getValue(key, valueExisting) == ErrorCode::Success)
+            {
+                ptrDataNode->remove(key);
+                ptrDataNode->insert(key, valueExisting + value);
+            }
+            else
+            {
+                ptrDataNode->insert(key, value);
+            }
+            break;
+        }
+        default:
+            throw new std::exception("should not occur!");
+        }
+    }
+
+    inline bool requireSplit(ObjectTypePtr ptrNode)
+    {
+        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrNode->data))
+        {
+            return std::get<std::shared_ptr<IndexNodeType>>(*ptrNode->data)->requireSplit(m_nDegree);
+        }
+
+        return std::get<std::shared_ptr<DataNodeType>>(*ptrNode->data)->requireSplit(m_nDegree);
+    }
+
+    inline bool requireMerge(ObjectTypePtr ptrNode)
+    {
+        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrNode->data))
+        {
+            return std::get<std::shared_ptr<IndexNodeType>>(*ptrNode->data)->requireMerge(m_nDegree);
+        }
+
+        return std::get<std::shared_ptr<DataNodeType>>(*ptrNode->data)->requireMerge(m_nDegree);
+    }
+
+    // Copies the root's content into a new node, the caller then turns the root into the parent of that node.
+    inline void moveOutOfRootNode(ObjectTypePtr ptrRootNode, std::optional<ObjectUIDType>& uidNode)
+    {
+        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrRootNode->data))
+        {
+            std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrRootNode->data);
+            m_ptrCache->template createObjectOfType<IndexNodeType>(uidNode, *ptrIndexNode);
+        }
+        else
+        {
+            std::shared_ptr<DataNodeType> ptrDataNode = std::get<std::shared_ptr<DataNodeType>>(*ptrRootNode->data);
+            m_ptrCache->template createObjectOfType<DataNodeType>(uidNode, *ptrDataNode);
+        }
+
+        if (!uidNode)
+        {
+            throw new std::exception("should not occur!");
+        }
+    }
+
+    // Hands the content of the given node over to the root and releases the node.
+    inline void moveIntoRootNode(ObjectTypePtr ptrRootNode, ObjectUIDType uidNode)
+    {
+        ObjectTypePtr ptrNode = nullptr;
+
+#ifdef __TREE_AWARE_CACHE__
+        std::optional<ObjectUIDType> uidUpdated = std::nullopt;
+        m_ptrCache->getObject(uidNode, ptrNode, uidUpdated);
+
+        if (uidUpdated != std::nullopt)
+        {
+            uidNode = *uidUpdated;
+        }
+#else __TREE_AWARE_CACHE__
+        m_ptrCache->getObject(uidNode, ptrNode);
+#endif __TREE_AWARE_CACHE__
+
+        if (ptrNode == nullptr)
+        {
+            throw new std::exception("should not occur!");
+        }
+
+        *ptrRootNode->data = *ptrNode->data;
+
+#ifdef __TREE_AWARE_CACHE__
+        ptrRootNode->dirty = true;
+#endif __TREE_AWARE_CACHE__
+
+        ptrNode = nullptr;
+        m_ptrCache->remove(uidNode);
+    }
+
+    // Fetches the child and puts it right after its parent in vtAccessedNodes, i.e. at nParentPos + 1.
+    inline void getChildNode(ObjectTypePtr ptrParentNode, size_t nParentPos, ObjectUIDType& uidNode, ObjectTypePtr& ptrNode
+        , std::vector<std::pair<ObjectUIDType, ObjectTypePtr>>& vtAccessedNodes)
+    {
+        getNode(ptrParentNode, uidNode, ptrNode);
+
+        vtAccessedNodes.insert(vtAccessedNodes.begin() + nParentPos + 1, std::make_pair(uidNode, ptrNode));
+    }
+
+    inline void getNode(ObjectTypePtr ptrParentNode, ObjectUIDType& uidNode, ObjectTypePtr& ptrNode)
+    {
+#ifdef __TREE_AWARE_CACHE__
+        std::optional<ObjectUIDType> uidUpdated = std::nullopt;
+        m_ptrCache->getObject(uidNode, ptrNode, uidUpdated);
+
+        if (uidUpdated != std::nullopt)
+        {
+            if (ptrParentNode != nullptr)
+            {
+                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrParentNode->data);
+                ptrIndexNode->updateChildUID(uidNode, *uidUpdated);
+
+                ptrParentNode->dirty = true;
+            }
+            else
+            {
+                m_uidRootNode = *uidUpdated;
+            }
+
+            uidNode = *uidUpdated;
+        }
+#else __TREE_AWARE_CACHE__
+        m_ptrCache->getObject(uidNode, ptrNode);
+#endif __TREE_AWARE_CACHE__
+
+        if (ptrNode == nullptr)
+        {
+            throw new std::exception("should not occur!");
+        }
+    }
+
+#ifdef __TREE_AWARE_CACHE__
+public:
+    void applyExistingUpdates(std::shared_ptr<ObjectType> ptrObject
+        , std::unordered_map<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>& mpUIDUpdates)
+    {
+        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrObject->data))
+        {
+            std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrObject->data);
+
+            auto it = ptrIndexNode->m_ptrData->m_vtChildren.begin();
+            while (it != ptrIndexNode->m_ptrData->m_vtChildren.end())
+            {
+                if (mpUIDUpdates.find(*it) != mpUIDUpdates.end())
+                {
+                    ObjectUIDType uidTemp = *it;
+
+                    *it = *(mpUIDUpdates[*it].first);
+
+                    mpUIDUpdates.erase(uidTemp);
+
+                    ptrObject->dirty = true;
+                }
+                it++;
+            }
+        }
+        else //if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*ptrObject->data))
+        {
+            // Nothing to update in this case!
+        }
+    }
+
+    void applyExistingUpdates(std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>>& vtNodes
+        , std::unordered_map<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>& mpUIDUpdates)
+    {
+        auto it = vtNodes.begin();
+        while (it != vtNodes.end())
+        {
+            if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*(*it).second.second->data))
+            {
+                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*(*it).second.second->data);
+
+                auto it_children = ptrIndexNode->m_ptrData->m_vtChildren.begin();
+                while (it_children != ptrIndexNode->m_ptrData->m_vtChildren.end())
+                {
+                    if (mpUIDUpdates.find(*it_children) != mpUIDUpdates.end())
+                    {
+                        ObjectUIDType uidTemp = *it_children;
+
+                        *it_children = *(mpUIDUpdates[*it_children].first);
+
+                        mpUIDUpdates.erase(uidTemp);
+
+                        (*it).second.second->dirty = true;
+                    }
+                    it_children++;
+                }
+            }
+            else //if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*(*it).second.second->data))
+            {
+                // Nothing to update in this case!
+            }
+            it++;
+        }
+    }
+
+    void prepareFlush(std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>>& vtNodes
+        , const std::function<size_t(size_t)>& fnAllocate, size_t nBlockSize, ObjectUIDType::Media nMediaType)
+    {
+        std::vector<bool> vtAppliedUpdates;
+        vtAppliedUpdates.resize(vtNodes.size(), false);
+
+        for (int idx = 0; idx < vtNodes.size(); idx++)
+        {
+            if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*vtNodes[idx].second.second->data))
+            {
+                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*vtNodes[idx].second.second->data);
+
+                auto it = ptrIndexNode->m_ptrData->m_vtChildren.begin();
+                while (it != ptrIndexNode->m_ptrData->m_vtChildren.end())
+                {
+                    for (int jdx = 0; jdx < idx; jdx++)
+                    {
+                        if (vtAppliedUpdates[jdx])
+                            continue;
+
+                        if (*it == vtNodes[jdx].first)
+                        {
+                            *it = *vtNodes[jdx].second.first;
+                            vtNodes[idx].second.second->dirty = true;
+
+                            vtAppliedUpdates[jdx] = true;
+                            break;
+                        }
+                    }
+                    it++;
+                }
+
+                if (!vtNodes[idx].second.second->dirty)
+                {
+                    vtNodes.erase(vtNodes.begin() + idx); idx--;
+                    continue;
+                }
+
+                size_t nNodeSize = ptrIndexNode->getSize();
+
+                size_t nPos = fnAllocate(std::ceil(nNodeSize / (float)nBlockSize));
+
+                ObjectUIDType uidUpdated = ObjectUIDType::createAddressFromArgs(nMediaType, nPos, nBlockSize, nNodeSize);
+
+                vtNodes[idx].second.first = uidUpdated;
+            }
+            else if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*vtNodes[idx].second.second->data))
+            {
+                if (!vtNodes[idx].second.second->dirty)
+                {
+                    vtNodes.erase(vtNodes.begin() + idx); idx--;
+                    continue;
+                }
+
+                std::shared_ptr<DataNodeType> ptrDataNode = std::get<std::shared_ptr<DataNodeType>>(*vtNodes[idx].second.second->data);
+
+                size_t nNodeSize = ptrDataNode->getSize();
+
+                size_t nPos = fnAllocate(std::ceil(nNodeSize / (float)nBlockSize));
+
+                ObjectUIDType uidUpdated = ObjectUIDType::createAddressFromArgs(nMediaType, nPos, nBlockSize, nNodeSize);
+
+                vtNodes[idx].second.first = uidUpdated;
+            }
+        }
+    }
+
+    void getChildUIDs(std::shared_ptr<ObjectType> ptrObject, std::vector<ObjectUIDType>& vtChildUIDs)
+    {
+        vtChildUIDs.clear();
+
+        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrObject->data))
+        {
+            std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrObject->data);
+
+            vtChildUIDs.assign(ptrIndexNode->m_ptrData->m_vtChildren.begin(), ptrIndexNode->m_ptrData->m_vtChildren.end());
+        }
+    }
+#endif __TREE_AWARE_CACHE__
+};
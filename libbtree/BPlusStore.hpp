@@ -11,6 +11,12 @@
 #include <exception>
 #include <variant>
 #include <unordered_map>
+#include <unordered_set>
+#include <span>
+#include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <functional>
 #include "CacheErrorCodes.h"
 #include "ErrorCodes.h"
 #include "VariadicNthType.h"
@@ -23,6 +29,16 @@
 #define __CONCURRENT__
 //#define __TREE_AWARE_CACHE__
 
+// A background thread goes through the leaves in passes of compact() whenever more than COMPACTION_THRESHOLD percent
+// of the used part of the storage is free, COMPACTION_NODES_PER_STEP leaves at a time. Needs __TREE_AWARE_CACHE__.
+//#define __ONLINE_COMPACTION__
+#define COMPACTION_THRESHOLD 25
+#define COMPACTION_NODES_PER_STEP 64
+
+#ifdef __CONCURRENT__
+#define __B_LINK_TREE__   // inserts lock one node at a time, see insertIntoLeafWithLinks.
+#endif __CONCURRENT__
+
 #ifdef __TREE_AWARE_CACHE__
 template <typename ICallback, typename KeyType, typename ValueType, typename CacheType>
 class BPlusStore : public ICallback
@@ -45,11 +61,40 @@ private:
 
 #ifdef __CONCURRENT__
     mutable std::shared_mutex m_mutex;
+
+    // Sequence lock over m_uidRootNode (odd while it is being updated), readers find the root through it instead of m_mutex.
+    std::atomic<uint64_t> m_nRootVersion;
+
+    // Writers waiting for the root, readers hold off meanwhile so that a steady stream of them cannot starve the writers.
+    std::atomic<uint32_t> m_nRootWriters;
 #endif __CONCURRENT__
 
+#ifdef __B_LINK_TREE__
+    // Number of levels, guarded by the root's lock. An insert uses it to find the node at a given level again.
+    size_t m_nHeight;
+
+    // Nodes that currently have a right link. They are kept referenced so that the cache cannot evict them, the
+    // link is not part of the serialized node.
+    std::mutex m_mtxLinkedNodes;
+    std::unordered_set<ObjectTypePtr> m_setLinkedNodes;
+#endif __B_LINK_TREE__
+
+#ifdef __ONLINE_COMPACTION__
+    bool m_bStop;
+
+    std::thread m_threadCompaction;
+#endif __ONLINE_COMPACTION__
+
 public:
     ~BPlusStore()
     {
+#ifdef __ONLINE_COMPACTION__
+        m_bStop = true;
+        if (m_threadCompaction.joinable())
+        {
+            m_threadCompaction.join();
+        }
+#endif __ONLINE_COMPACTION__
     }
 
     template<typename... CacheArgs>
@@ -58,6 +103,11 @@ public:
         , m_uidRootNode(std::nullopt)
     {
         m_ptrCache = std::make_shared<CacheType>(args...);
+
+#ifdef __CONCURRENT__
+        m_nRootVersion = 0;
+        m_nRootWriters = 0;
+#endif __CONCURRENT__
     }
 
     template <typename DefaultNodeType>
@@ -68,10 +118,165 @@ public:
 #endif __TREE_AWARE_CACHE__
 
         m_ptrCache->template createObjectOfType<DefaultNodeType>(m_uidRootNode);
+
+#ifdef __B_LINK_TREE__
+        m_nHeight = 1;
+#endif __B_LINK_TREE__
+
+#ifdef __ONLINE_COMPACTION__
+        // Started once the cache knows the tree, the nodes are only moved through the flush callbacks.
+        m_bStop = false;
+        m_threadCompaction = std::thread(handlerCompaction, this);
+#endif __ONLINE_COMPACTION__
+    }
+
+    /*
+     * Builds the tree bottom-up from a stream of (key, value) pairs sorted in strictly ascending key order.
+     * The nodes are packed to fFillFactor of their capacity and handed over to the cache as soon as they are
+     * complete, so there are neither per-key descents nor splits. Only the last two nodes of each level are
+     * kept aside, to keep the rightmost node of a level from ending up nearly empty.
+     * The tree must be empty, i.e. nothing has been inserted since init().
+     */
+    template <typename InputIterator>
+    ErrorCode bulkLoad(InputIterator itBegin, InputIterator itEnd, float fFillFactor = 1.0f)
+    {
+#ifdef __CONCURRENT__
+        std::unique_lock<std::shared_mutex> lock_tree(m_mutex);
+#endif __CONCURRENT__
+
+        ObjectUIDType uidRootNode = getRootNodeUID();
+        ObjectTypePtr ptrRootNode = nullptr;
+        getNode(nullptr, uidRootNode, ptrRootNode);
+
+#ifdef __CONCURRENT__
+        std::unique_lock<std::shared_mutex> lock_root = lockRootNode(ptrRootNode);
+#endif __CONCURRENT__
+
+        if (!std::holds_alternative<std::shared_ptr<DataNodeType>>(*ptrRootNode->data)
+            || std::get<std::shared_ptr<DataNodeType>>(*ptrRootNode->data)->getKeysCount() > 0)
+        {
+            return ErrorCode::Error;
+        }
+
+        // Keep the nodes between the merge and the split thresholds, i.e. at most m_nDegree keys per data node
+        // and m_nDegree pivots per index node.
+        size_t nMinEntries = std::ceil(m_nDegree / 2.0f) + 1;
+
+        size_t nDataNodeFill = std::round(m_nDegree * fFillFactor);
+        nDataNodeFill = std::max(nDataNodeFill, nMinEntries);
+        nDataNodeFill = std::min(nDataNodeFill, (size_t)m_nDegree);
+
+        size_t nIndexNodeFill = std::round((m_nDegree + 1) * fFillFactor);
+        nIndexNodeFill = std::max(nIndexNodeFill, nMinEntries + 1);
+        nIndexNodeFill = std::min(nIndexNodeFill, (size_t)m_nDegree + 1);
+
+        std::vector<KeyType> vtKeys;
+        std::vector<ValueType> vtValues;
+
+        // Per index level: the smallest key under each pending child and the child itself.
+        std::vector<std::pair<std::vector<KeyType>, std::vector<ObjectUIDType>>> vtLevels;
+
+        for (InputIterator it = itBegin; it != itEnd; it++)
+        {
+            assert(vtKeys.size() == 0 || vtKeys.back() < (*it).first);
+
+            vtKeys.push_back((*it).first);
+            vtValues.push_back((*it).second);
+
+            if (vtKeys.size() == 2 * nDataNodeFill)
+            {
+                bulkLoadDataNode(vtKeys, vtValues, nDataNodeFill, vtLevels, nIndexNodeFill);
+            }
+        }
+
+        if (vtKeys.size() == 0)
+        {
+            return ErrorCode::Success;
+        }
+
+        if (vtKeys.size() > m_nDegree)
+        {
+            bulkLoadDataNode(vtKeys, vtValues, vtKeys.size() / 2, vtLevels, nIndexNodeFill);
+        }
+
+        bulkLoadDataNode(vtKeys, vtValues, vtKeys.size(), vtLevels, nIndexNodeFill);
+
+        for (size_t nLevel = 0; nLevel < vtLevels.size(); nLevel++)
+        {
+            size_t nChildren = vtLevels[nLevel].second.size();
+
+            if (nLevel == vtLevels.size() - 1 && nChildren == 1)
+            {
+                break;
+            }
+
+            if (nChildren > m_nDegree + 1)
+            {
+                bulkLoadIndexNode(vtLevels, nLevel, nChildren / 2, nIndexNodeFill);
+            }
+
+            bulkLoadIndexNode(vtLevels, nLevel, vtLevels[nLevel].second.size(), nIndexNodeFill);
+        }
+
+        moveIntoRootNode(ptrRootNode, vtLevels.back().second.front());
+
+#ifdef __B_LINK_TREE__
+        m_nHeight = vtLevels.size();
+#endif __B_LINK_TREE__
+
+        return ErrorCode::Success;
     }
 
     ErrorCode insert(const KeyType& key, const ValueType& value)
     {
+        const std::pair<KeyType, ValueType> prEntry(key, value);
+
+        const std::pair<KeyType, ValueType>* itEntry = &prEntry;
+#ifdef __B_LINK_TREE__
+        return insertIntoLeafWithLinks(itEntry, itEntry + 1);
+#else __B_LINK_TREE__
+        return insertIntoLeaf(itEntry, itEntry + 1);
+#endif __B_LINK_TREE__
+    }
+
+    /*
+     * Inserts a batch of entries. The batch is sorted by key in place and split into groups of keys that share
+     * the same leaf, each group is then applied with a single descent and with the leaf locked once. A group is
+     * capped so that the leaf requires at most one split.
+     */
+    ErrorCode insertBatch(std::span<std::pair<KeyType, ValueType>> vtEntries)
+    {
+        std::sort(vtEntries.begin(), vtEntries.end(),
+            [](const std::pair<KeyType, ValueType>& lhs, const std::pair<KeyType, ValueType>& rhs) { return lhs.first < rhs.first; });
+
+        auto itEntry = vtEntries.begin();
+        while (itEntry != vtEntries.end())
+        {
+#ifdef __B_LINK_TREE__
+            ErrorCode errCode = insertIntoLeafWithLinks(itEntry, vtEntries.end());
+#else __B_LINK_TREE__
+            ErrorCode errCode = insertIntoLeaf(itEntry, vtEntries.end());
+#endif __B_LINK_TREE__
+
+            if (errCode != ErrorCode::Success)
+            {
+                return errCode;
+            }
+        }
+
+        return ErrorCode::Success;
+    }
+
+private:
+    // Inserts the entries from itEntry onwards that belong to the leaf of *itEntry, entries must be sorted by key.
+    // itEntry is advanced past the entries inserted.
+    template <typename EntryIterator>
+    ErrorCode insertIntoLeaf(EntryIterator& itEntry, EntryIterator itEnd)
+    {
+        const KeyType& key = (*itEntry).first;
+
+        std::optional<KeyType> keyUpperBound;   // the smallest pivot on the path greater than the key, if any.
+
         std::vector<std::pair<ObjectUIDType, ObjectTypePtr>> vtAccessedNodes;
 
 #ifdef __CONCURRENT__
@@ -87,7 +292,7 @@ public:
         vtLocks.push_back(std::unique_lock<std::shared_mutex>(m_mutex));
 #endif __CONCURRENT__
 
-        uidCurrentNode = m_uidRootNode.value();
+        uidCurrentNode = getRootNodeUID();
 
         do
         {
@@ -113,8 +318,7 @@ public:
                 else
                 {
                     //ptrLastNode->dirty = true; do ths ame for root!
-                    assert(uidCurrentNode == *m_uidRootNode);
-                    m_uidRootNode = uidUpdated;
+                    setRootNodeUID(*uidUpdated);
                 }
 
                 uidCurrentNode = *uidUpdated;
@@ -124,7 +328,14 @@ public:
 #endif __TREE_AWARE_CACHE__
 
 #ifdef __CONCURRENT__
-            vtLocks.push_back(std::unique_lock<std::shared_mutex>(ptrCurrentNode->mutex));
+            if (ptrLastNode == nullptr)
+            {
+                vtLocks.push_back(lockRootNode(ptrCurrentNode));
+            }
+            else
+            {
+                vtLocks.push_back(std::unique_lock<std::shared_mutex>(ptrCurrentNode->mutex));
+            }
 #endif __CONCURRENT__
 
             if (ptrCurrentNode == nullptr)
@@ -132,6 +343,8 @@ public:
                 throw new std::exception("should not occur!");   // TODO: critical log.
             }
 
+            setDepth(ptrLastNode, ptrCurrentNode);
+
             vtAccessedNodes.push_back(std::make_pair(uidCurrentNode, ptrCurrentNode));
 
             if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data))
@@ -153,7 +366,13 @@ public:
                 uidLastNode = uidCurrentNode;
                 ptrLastNode = ptrCurrentNode;
 
-                uidCurrentNode = ptrIndexNode->getChild(key);
+                size_t nChildIdx = ptrIndexNode->getChildNodeIdx(key);
+                if (nChildIdx < ptrIndexNode->getKeysCount())
+                {
+                    keyUpperBound = ptrIndexNode->getPivotAt(nChildIdx);
+                }
+
+                uidCurrentNode = ptrIndexNode->getChildAt(nChildIdx);
             }
             else if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*ptrCurrentNode->data))
             {
@@ -163,15 +382,24 @@ public:
                 ptrCurrentNode->dirty = true;
 #endif __TREE_AWARE_CACHE__
 
-                if (ptrDataNode->insert(key, value) != ErrorCode::Success)
+                // A node holds at most m_nDegree keys, so up to 2 * m_nDegree keys can be settled with one split.
+                size_t nCapacity = 2 * m_nDegree - ptrDataNode->getKeysCount();
+
+                do
                 {
-                    vtNodes.clear();
+                    if (ptrDataNode->insert((*itEntry).first, (*itEntry).second) != ErrorCode::Success)
+                    {
+                        vtNodes.clear();
 
 #ifdef __CONCURRENT__
-                    vtLocks.clear();
+                        vtLocks.clear();
 #endif __CONCURRENT__
-                    return ErrorCode::InsertFailed;
-                }
+                        return ErrorCode::InsertFailed;
+                    }
+
+                    itEntry++;
+                    nCapacity--;
+                } while (itEntry != itEnd && nCapacity > 0 && (!keyUpperBound || (*itEntry).first < *keyUpperBound));
 
                 if (ptrDataNode->requireSplit(m_nDegree))
                 {
@@ -205,7 +433,19 @@ public:
                     throw new std::exception("should not occur!");
                 }
 
-                m_ptrCache->template createObjectOfType<IndexNodeType>(m_uidRootNode, pivotKey, uidLHSNode, *uidRHSNode);
+                // The root object is kept (see getRootNode), its content moves down to a new node instead.
+                ObjectTypePtr ptrRootNode = vtAccessedNodes.front().second;
+
+                std::optional<ObjectUIDType> uidNewLHSNode;
+                moveOutOfRootNode(ptrRootNode, uidNewLHSNode);
+
+                *ptrRootNode->data = std::make_shared<IndexNodeType>(pivotKey, *uidNewLHSNode, *uidRHSNode);
+
+#ifdef __TREE_AWARE_CACHE__
+                ptrRootNode->dirty = true;
+#endif __TREE_AWARE_CACHE__
+
+                vtAccessedNodes.push_back(std::make_pair(*uidNewLHSNode, nullptr));
 
                 int idx = 0;
                 auto it_a = vtAccessedNodes.begin();
@@ -296,171 +536,559 @@ public:
         return ErrorCode::Success;
     }
 
-    ErrorCode search(const KeyType& key, ValueType& value)
+#ifdef __B_LINK_TREE__
+    /*
+     * B-link version of insertIntoLeaf. The way down takes shared locks with lock coupling and only the leaf is
+     * locked exclusively. A node that overflows is split on its own: it keeps the new sibling's smallest key as
+     * its high key along with a link to the sibling and is released, only then is the parent locked to take the
+     * new pivot, after which the link is dropped again. Whoever reaches the node through a parent that does not
+     * know the sibling yet finds the key at or above the high key and moves right (see moveRight).
+     * As the link is dropped, a node reached without holding its parent may have lost part of its range to a
+     * sibling the parent already knows of. The leaf is therefore locked while its parent is still held, and a
+     * parent on the way up is looked up again from the root if its version shows that it has been split since.
+     */
+    template <typename EntryIterator>
+    ErrorCode insertIntoLeafWithLinks(EntryIterator& itEntry, EntryIterator itEnd)
     {
-        ErrorCode errCode = ErrorCode::Error;
+        const KeyType& key = (*itEntry).first;
+
+        std::optional<KeyType> keyUpperBound;   // the smallest pivot on the path greater than the key, if any.
 
         std::vector<std::pair<ObjectUIDType, ObjectTypePtr>> vtAccessedNodes;
+        std::vector<std::tuple<ObjectUIDType, ObjectTypePtr, uint32_t>> vtPath;    // the index nodes on the way down (and their versions), the root first.
+
+        // Inserts only keep removes out, see remove.
+        std::shared_lock<std::shared_mutex> lock_tree(m_mutex);
 
-#ifdef __CONCURRENT__
         std::vector<std::shared_lock<std::shared_mutex>> vtLocks;
-        vtLocks.push_back(std::shared_lock<std::shared_mutex>(m_mutex));
-#endif __CONCURRENT__
+        std::unique_lock<std::shared_mutex> lock_leaf;
+
+        ObjectUIDType uidCurrentNode;
+        ObjectTypePtr ptrCurrentNode = nullptr;
+
+        getRootNode(uidCurrentNode, ptrCurrentNode, vtLocks);
 
-        ObjectUIDType uidCurrentNode = *m_uidRootNode;
         do
         {
-            ObjectTypePtr prNodeDetails = nullptr;
-
-#ifdef __TREE_AWARE_CACHE__
-            std::optional<ObjectUIDType> uidUpdated = std::nullopt;
-            m_ptrCache->getObject(uidCurrentNode, prNodeDetails, uidUpdated);    //TODO: lock
+            moveRight(key, uidCurrentNode, ptrCurrentNode, vtLocks.back());
 
-            if (uidUpdated != std::nullopt)
+            if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data))
             {
-                ObjectTypePtr ptrLastNode = vtAccessedNodes.size() > 0 ? vtAccessedNodes[vtAccessedNodes.size() - 1].second : nullptr;
-                if (ptrLastNode != nullptr)
-                {
-                    if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrLastNode->data))
-                    {
-                        std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrLastNode->data);
-                        ptrIndexNode->updateChildUID(uidCurrentNode, *uidUpdated);
+                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data);
 
-                        ptrLastNode->dirty = true;
-                    }
-                    else //if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*ptrLastNode->data))
-                    {
-                        throw new std::exception("should not occur!");
-                    }
+                vtLocks.erase(vtLocks.begin(), vtLocks.end() - 1);
+
+                vtPath.push_back(std::make_tuple(uidCurrentNode, ptrCurrentNode, ptrIndexNode->getVersion()));
+                vtAccessedNodes.push_back(std::make_pair(uidCurrentNode, ptrCurrentNode));
+
+                // The subtree ends at the high key as well.
+                if (ptrIndexNode->getRightLink() && (!keyUpperBound || ptrIndexNode->getRightLink()->first < *keyUpperBound))
+                {
+                    keyUpperBound = ptrIndexNode->getRightLink()->first;
                 }
-                else
+
+                size_t nChildIdx = ptrIndexNode->getChildNodeIdx(key);
+                if (nChildIdx < ptrIndexNode->getKeysCount())
                 {
-                    //ptrLastNode->dirty = true;  do the same thing here... atm root never leaves cache. but later fix this.
-                    assert(uidCurrentNode == *m_uidRootNode);
-                    m_uidRootNode = uidUpdated;
+                    keyUpperBound = ptrIndexNode->getPivotAt(nChildIdx);
                 }
 
-                uidCurrentNode = *uidUpdated;
-            }
-#else __TREE_AWARE_CACHE__
-            m_ptrCache->getObject(uidCurrentNode, prNodeDetails);    //TODO: lock
-#endif __TREE_AWARE_CACHE__
+                ObjectTypePtr ptrParentNode = ptrCurrentNode;
 
+                uidCurrentNode = ptrIndexNode->getChildAt(nChildIdx);
+                ptrCurrentNode = nullptr;
+                getNode(ptrParentNode, uidCurrentNode, ptrCurrentNode);
 
-#ifdef __CONCURRENT__
-            vtLocks.push_back(std::shared_lock<std::shared_mutex>(prNodeDetails->mutex));
-            vtLocks.erase(vtLocks.begin());
-#endif __CONCURRENT__
+                vtLocks.push_back(std::shared_lock<std::shared_mutex>(ptrCurrentNode->mutex));
 
-            if (prNodeDetails == nullptr)
-            {
-                throw new std::exception("should not occur!");
+                continue;
             }
 
-            vtAccessedNodes.push_back(std::make_pair(uidCurrentNode, prNodeDetails));
+            // The leaf is locked again, exclusively, while the parent is still held.
+            vtLocks.pop_back();
 
-            if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*prNodeDetails->data))
+            if (vtPath.size() == 0)
             {
-                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*prNodeDetails->data);
+                lock_leaf = lockRootNode(ptrCurrentNode);
 
-                uidCurrentNode = ptrIndexNode->getChild(key);
+                if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data))
+                {
+                    // The root has been split, start over.
+                    lock_leaf.unlock();
+
+                    getRootNode(uidCurrentNode, ptrCurrentNode, vtLocks);
+                    continue;
+                }
             }
-            else if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*prNodeDetails->data))
+            else
             {
-                std::shared_ptr<DataNodeType> ptrDataNode = std::get<std::shared_ptr<DataNodeType>>(*prNodeDetails->data);
+                lock_leaf = std::unique_lock<std::shared_mutex>(ptrCurrentNode->mutex);
+                moveRight(key, uidCurrentNode, ptrCurrentNode, lock_leaf);
 
-                errCode = ptrDataNode->getValue(key, value);
+                vtLocks.clear();
+            }
 
-                break;
+            break;
+        } while (true);
+
+        std::shared_ptr<DataNodeType> ptrDataNode = std::get<std::shared_ptr<DataNodeType>>(*ptrCurrentNode->data);
+
+        vtAccessedNodes.push_back(std::make_pair(uidCurrentNode, ptrCurrentNode));
+
+        // The keys from the high key on belong to the right sibling.
+        if (ptrDataNode->getRightLink() && (!keyUpperBound || ptrDataNode->getRightLink()->first < *keyUpperBound))
+        {
+            keyUpperBound = ptrDataNode->getRightLink()->first;
+        }
+
+#ifdef __TREE_AWARE_CACHE__
+        ptrCurrentNode->dirty = true;
+#endif __TREE_AWARE_CACHE__
+
+        // A node holds at most m_nDegree keys, so up to 2 * m_nDegree keys can be settled with one split.
+        size_t nCapacity = 2 * m_nDegree - ptrDataNode->getKeysCount();
+
+        do
+        {
+            if (ptrDataNode->insert((*itEntry).first, (*itEntry).second) != ErrorCode::Success)
+            {
+                return ErrorCode::InsertFailed;
             }
 
+            itEntry++;
+            nCapacity--;
+        } while (itEntry != itEnd && nCapacity > 0 && (!keyUpperBound || (*itEntry).first < *keyUpperBound));
 
-        } while (true);
+        if (!ptrDataNode->requireSplit(m_nDegree))
+        {
+            lock_leaf.unlock();
 
-        m_ptrCache->reorder(vtAccessedNodes);
-        vtAccessedNodes.clear();
+            m_ptrCache->reorder(vtAccessedNodes, false);
+            vtAccessedNodes.clear();
 
-        return errCode;
-    }
+            return ErrorCode::Success;
+        }
 
-    ErrorCode remove(const KeyType& key)
-    {   
-        std::vector<std::pair<ObjectUIDType, ObjectTypePtr>> vtAccessedNodes;
+        KeyType pivotKey;
+        std::optional<ObjectUIDType> uidRHSNode;
+        ObjectTypePtr ptrRHSNode = nullptr;
 
-#ifdef __CONCURRENT__
-        std::vector<std::unique_lock<std::shared_mutex>> vtLocks;
-#endif __CONCURRENT__
+        if (ptrDataNode->template split<std::shared_ptr<CacheType>, ObjectUIDType>(m_ptrCache, uidRHSNode, pivotKey) != ErrorCode::Success)
+        {
+            // TODO: Should update be performed on cloned objects first?
+            throw new std::exception("should not occur!"); // for the time being!
+        }
 
-        ObjectUIDType uidLastNode, uidCurrentNode;
-        ObjectTypePtr ptrLastNode = nullptr, ptrCurrentNode = nullptr;
+        if (vtPath.size() == 0)
+        {
+            splitRootNode(ptrCurrentNode, pivotKey, *uidRHSNode);
+        }
+        else
+        {
+            linkRightSibling(ptrCurrentNode, pivotKey, *uidRHSNode, ptrRHSNode);
+        }
 
-        std::vector<std::pair<ObjectUIDType, ObjectTypePtr>> vtNodes;
+        lock_leaf.unlock();
 
-#ifdef __CONCURRENT__
-        vtLocks.push_back(std::unique_lock<std::shared_mutex>(m_mutex));
-#endif __CONCURRENT__
+        // The nodes changed on the way up, the topmost level first. They go ahead of the nodes on the way down, so that
+        // parents stay ahead of their children in the cache (a new index node may have adopted the leaf).
+        std::vector<std::pair<ObjectUIDType, ObjectTypePtr>> vtSplitNodes;
 
-        uidCurrentNode = m_uidRootNode.value();
+        size_t nLevel = 1;  // of the parent, the leaves being level 0.
 
-        do
+        while (ptrRHSNode != nullptr)
         {
-#ifdef __TREE_AWARE_CACHE__
-            std::optional<ObjectUIDType> uidUpdated = std::nullopt;
-            m_ptrCache->getObject(uidCurrentNode, ptrCurrentNode, uidUpdated);    //TODO: lock
+            ObjectUIDType uidParentNode = std::get<0>(vtPath.back());
+            ObjectTypePtr ptrParentNode = std::get<1>(vtPath.back());
+            uint32_t nVersion = std::get<2>(vtPath.back());
+            vtPath.pop_back();
 
-            if (uidUpdated != std::nullopt)
+            std::unique_lock<std::shared_mutex> lock_parent;
+
+            if (vtPath.size() == 0)
             {
-                if (ptrLastNode != nullptr)
-                {
-                    if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrLastNode->data))
-                    {
-                        std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrLastNode->data);
-                        ptrIndexNode->updateChildUID(uidCurrentNode, *uidUpdated);
-                        ptrLastNode->dirty = true;
-                    }
-                    else //if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*ptrLastNode->data))
-                    {
-                        throw new std::exception("should not occur!");
-                    }
-                }
-                else
-                {
-                    // ptrLastNode->dirty = true; todo: do for parent as well..
-                    assert(uidCurrentNode == *m_uidRootNode);
-                    m_uidRootNode = uidUpdated;
-                }
+                lock_parent = lockRootNode(ptrParentNode);
+            }
+            else
+            {
+                lock_parent = std::unique_lock<std::shared_mutex>(ptrParentNode->mutex);
+            }
 
-                uidCurrentNode = *uidUpdated;
+            if (getVersion(ptrParentNode) != nVersion)
+            {
+                // The parent has been split since the way down and its link may already be gone.
+                lock_parent.unlock();
+
+                lockNodeAtLevel(pivotKey, nLevel, uidParentNode, ptrParentNode, lock_parent, vtPath);
             }
-#else __TREE_AWARE_CACHE__
-            m_ptrCache->getObject(uidCurrentNode, ptrCurrentNode);    //TODO: lock
+
+            std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrParentNode->data);
+
+            if (ptrIndexNode->insert(pivotKey, *uidRHSNode) != ErrorCode::Success)
+            {
+                // TODO: Should update be performed on cloned objects first?
+                throw new std::exception("should not occur!"); // for the time being!
+            }
+
+#ifdef __TREE_AWARE_CACHE__
+            ptrParentNode->dirty = true;
 #endif __TREE_AWARE_CACHE__
 
+            vtSplitNodes.insert(vtSplitNodes.begin(), std::make_pair(*uidRHSNode, ptrRHSNode));
+            vtSplitNodes.insert(vtSplitNodes.begin(), std::make_pair(uidParentNode, ptrParentNode));
 
-#ifdef __CONCURRENT__
-            vtLocks.push_back(std::unique_lock<std::shared_mutex>(ptrCurrentNode->mutex));
-#endif __CONCURRENT__
+            unlinkRightSibling(ptrParentNode, pivotKey, *uidRHSNode);
 
-            if (ptrCurrentNode == nullptr)
+            uidRHSNode = std::nullopt;
+            ptrRHSNode = nullptr;
+
+            if (!ptrIndexNode->requireSplit(m_nDegree))
             {
-                throw new std::exception("should not occur!");
+                break;
             }
 
-            vtAccessedNodes.push_back(std::make_pair(uidCurrentNode, ptrCurrentNode));
+            if (ptrIndexNode->template split<std::shared_ptr<CacheType>>(m_ptrCache, uidRHSNode, pivotKey) != ErrorCode::Success)
+            {
+                // TODO: Should update be performed on cloned objects first?
+                throw new std::exception("should not occur!"); // for the time being!
+            }
 
-            if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data))
+            if (vtPath.size() == 0)
             {
-                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data);
+                splitRootNode(ptrParentNode, pivotKey, *uidRHSNode);
+            }
+            else
+            {
+                linkRightSibling(ptrParentNode, pivotKey, *uidRHSNode, ptrRHSNode);
+            }
 
-                if (ptrIndexNode->canTriggerMerge(m_nDegree))
-                {
-                    vtNodes.push_back(std::pair<ObjectUIDType, ObjectTypePtr>(uidLastNode, ptrLastNode));
-                }
-                else
-                {
-#ifdef __CONCURRENT__
-                    if (vtLocks.size() > 3) //TODO: 3 seems to be working.. but how and why.. investiage....!
-                    {
+            nLevel++;
+        }
+
+        // A parent may have been looked up again, the nodes above it go first.
+        for (auto it = vtPath.rbegin(); it != vtPath.rend(); it++)
+        {
+            vtSplitNodes.insert(vtSplitNodes.begin(), std::make_pair(std::get<0>(*it), std::get<1>(*it)));
+        }
+
+        vtAccessedNodes.insert(vtAccessedNodes.begin(), vtSplitNodes.begin(), vtSplitNodes.end());
+
+        m_ptrCache->reorder(vtAccessedNodes, false);
+        vtAccessedNodes.clear();
+
+        return ErrorCode::Success;
+    }
+#endif __B_LINK_TREE__
+
+public:
+    ErrorCode search(const KeyType& key, ValueType& value)
+    {
+        ErrorCode errCode = ErrorCode::Error;
+
+        std::vector<std::pair<ObjectUIDType, ObjectTypePtr>> vtAccessedNodes;
+
+        ObjectUIDType uidCurrentNode;
+        ObjectTypePtr prNodeDetails = nullptr;
+
+#ifdef __CONCURRENT__
+        std::vector<std::shared_lock<std::shared_mutex>> vtLocks;
+        getRootNode(uidCurrentNode, prNodeDetails, vtLocks);
+#else __CONCURRENT__
+        getRootNode(uidCurrentNode, prNodeDetails);
+#endif __CONCURRENT__
+
+        do
+        {
+            if (prNodeDetails == nullptr)
+            {
+                getNode(vtAccessedNodes.back().second, uidCurrentNode, prNodeDetails);
+
+#ifdef __CONCURRENT__
+                vtLocks.push_back(std::shared_lock<std::shared_mutex>(prNodeDetails->mutex));
+                vtLocks.erase(vtLocks.begin());
+#endif __CONCURRENT__
+            }
+
+#ifdef __B_LINK_TREE__
+            moveRight(key, uidCurrentNode, prNodeDetails, vtLocks.back());
+#endif __B_LINK_TREE__
+
+            vtAccessedNodes.push_back(std::make_pair(uidCurrentNode, prNodeDetails));
+
+            if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*prNodeDetails->data))
+            {
+                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*prNodeDetails->data);
+
+                uidCurrentNode = ptrIndexNode->getChild(key);
+                prNodeDetails = nullptr;
+            }
+            else if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*prNodeDetails->data))
+            {
+                std::shared_ptr<DataNodeType> ptrDataNode = std::get<std::shared_ptr<DataNodeType>>(*prNodeDetails->data);
+
+                errCode = ptrDataNode->getValue(key, value);
+
+                break;
+            }
+        } while (true);
+
+        m_ptrCache->reorder(vtAccessedNodes);
+        vtAccessedNodes.clear();
+
+        return errCode;
+    }
+
+    /*
+     * Looks up several keys at once, vtValues and vtErrorCodes receive the results in the order of vtKeys.
+     * The keys are visited in sorted order by walking down from the lowest ancestor that covers the next key,
+     * so a subtree shared by several keys is descended once and all the keys of a leaf are resolved under the
+     * same shared lock. The cache is reordered once for all the nodes touched.
+     */
+    ErrorCode searchBatch(std::span<const KeyType> vtKeys, std::vector<ValueType>& vtValues, std::vector<ErrorCode>& vtErrorCodes)
+    {
+        vtValues.resize(vtKeys.size());
+        vtErrorCodes.assign(vtKeys.size(), ErrorCode::KeyDoesNotExist);
+
+        if (vtKeys.size() == 0)
+        {
+            return ErrorCode::Success;
+        }
+
+        std::vector<size_t> vtOrder(vtKeys.size());
+        std::iota(vtOrder.begin(), vtOrder.end(), 0);
+        std::sort(vtOrder.begin(), vtOrder.end(), [&vtKeys](size_t lhs, size_t rhs) { return vtKeys[lhs] < vtKeys[rhs]; });
+
+        std::vector<std::pair<ObjectUIDType, ObjectTypePtr>> vtAccessedNodes;
+        std::vector<std::pair<ObjectTypePtr, std::optional<KeyType>>> vtPath;   // index node and the upper bound of its key range.
+
+        size_t nIdx = 0;
+        std::optional<KeyType> keyUpperBound;
+
+        ObjectTypePtr ptrParentNode = nullptr;
+        ObjectTypePtr ptrCurrentNode = nullptr;
+        ObjectUIDType uidCurrentNode;
+
+#ifdef __CONCURRENT__
+        std::vector<std::shared_lock<std::shared_mutex>> vtLocks;
+        getRootNode(uidCurrentNode, ptrCurrentNode, vtLocks);
+#else __CONCURRENT__
+        getRootNode(uidCurrentNode, ptrCurrentNode);
+#endif __CONCURRENT__
+
+        vtAccessedNodes.push_back(std::make_pair(uidCurrentNode, nullptr));
+
+        do
+        {
+            if (ptrCurrentNode == nullptr)
+            {
+                getNode(ptrParentNode, uidCurrentNode, ptrCurrentNode);
+
+#ifdef __CONCURRENT__
+                vtLocks.push_back(std::shared_lock<std::shared_mutex>(ptrCurrentNode->mutex));
+#endif __CONCURRENT__
+
+                vtAccessedNodes.push_back(std::make_pair(uidCurrentNode, nullptr));
+            }
+
+#ifdef __B_LINK_TREE__
+            moveRight(vtKeys[vtOrder[nIdx]], uidCurrentNode, ptrCurrentNode, vtLocks.back());
+#endif __B_LINK_TREE__
+
+            if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data))
+            {
+                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data);
+
+#ifdef __B_LINK_TREE__
+                // The keys from the high key on are further right, the node is left (and visited again) once they are reached.
+                if (ptrIndexNode->getRightLink() && (!keyUpperBound || ptrIndexNode->getRightLink()->first < *keyUpperBound))
+                {
+                    keyUpperBound = ptrIndexNode->getRightLink()->first;
+                }
+#endif __B_LINK_TREE__
+
+                vtPath.push_back(std::make_pair(ptrCurrentNode, keyUpperBound));
+
+                size_t nChildIdx = ptrIndexNode->getChildNodeIdx(vtKeys[vtOrder[nIdx]]);
+                if (nChildIdx < ptrIndexNode->getKeysCount())
+                {
+                    keyUpperBound = ptrIndexNode->getPivotAt(nChildIdx);
+                }
+
+                ptrParentNode = ptrCurrentNode;
+                ptrCurrentNode = nullptr;
+                uidCurrentNode = ptrIndexNode->getChildAt(nChildIdx);
+
+                continue;
+            }
+
+            std::shared_ptr<DataNodeType> ptrDataNode = std::get<std::shared_ptr<DataNodeType>>(*ptrCurrentNode->data);
+
+            std::optional<KeyType> keyLeafUpperBound = keyUpperBound;
+
+#ifdef __B_LINK_TREE__
+            if (ptrDataNode->getRightLink() && (!keyUpperBound || ptrDataNode->getRightLink()->first < *keyUpperBound))
+            {
+                keyLeafUpperBound = ptrDataNode->getRightLink()->first;
+            }
+#endif __B_LINK_TREE__
+
+            do
+            {
+                vtErrorCodes[vtOrder[nIdx]] = ptrDataNode->getValue(vtKeys[vtOrder[nIdx]], vtValues[vtOrder[nIdx]]);
+                nIdx++;
+            } while (nIdx < vtKeys.size() && (!keyLeafUpperBound || vtKeys[vtOrder[nIdx]] < *keyLeafUpperBound));
+
+#ifdef __B_LINK_TREE__
+            // The next key is still under the same parent, i.e. in the right sibling (moveRight gets there).
+            if (nIdx < vtKeys.size() && (!keyUpperBound || vtKeys[vtOrder[nIdx]] < *keyUpperBound))
+            {
+                continue;
+            }
+#endif __B_LINK_TREE__
+
+#ifdef __CONCURRENT__
+            vtLocks.pop_back();
+#endif __CONCURRENT__
+
+            if (nIdx == vtKeys.size())
+            {
+                break;
+            }
+
+            // Climb to the nearest ancestor whose range covers the next key, the root covers all.
+            while (vtPath.back().second && !(vtKeys[vtOrder[nIdx]] < *vtPath.back().second))
+            {
+                vtPath.pop_back();
+
+#ifdef __CONCURRENT__
+                vtLocks.pop_back();
+#endif __CONCURRENT__
+            }
+
+            // The ancestor is visited again (and keeps its lock), it is pushed back on the path when its child is chosen.
+            ptrCurrentNode = vtPath.back().first;
+            keyUpperBound = vtPath.back().second;
+            vtPath.pop_back();
+        } while (true);
+
+        vtPath.clear();
+
+#ifdef __CONCURRENT__
+        vtLocks.clear();
+#endif __CONCURRENT__
+
+        // Leaves released earlier in the walk may already have been evicted.
+        m_ptrCache->reorder(vtAccessedNodes, false);
+        vtAccessedNodes.clear();
+
+        return ErrorCode::Success;
+    }
+
+    // Visits the entries in [keyBegin, keyEnd) in ascending key order. fnCallback(key, value) returns false to stop early.
+    template <typename Callback>
+    ErrorCode scan(const KeyType& keyBegin, const KeyType& keyEnd, Callback fnCallback)
+    {
+        return scanRange(keyBegin, keyEnd, fnCallback, true);
+    }
+
+    // Visits the entries in [keyBegin, keyEnd) in descending key order. fnCallback(key, value) returns false to stop early.
+    template <typename Callback>
+    ErrorCode reverseScan(const KeyType& keyBegin, const KeyType& keyEnd, Callback fnCallback)
+    {
+        return scanRange(keyBegin, keyEnd, fnCallback, false);
+    }
+
+    ErrorCode remove(const KeyType& key)
+    {   
+        std::vector<std::pair<ObjectUIDType, ObjectTypePtr>> vtAccessedNodes;
+
+#ifdef __CONCURRENT__
+        std::vector<std::unique_lock<std::shared_mutex>> vtLocks;
+#endif __CONCURRENT__
+
+        ObjectUIDType uidLastNode, uidCurrentNode;
+        ObjectTypePtr ptrLastNode = nullptr, ptrCurrentNode = nullptr;
+
+        std::vector<std::pair<ObjectUIDType, ObjectTypePtr>> vtNodes;
+
+#ifdef __CONCURRENT__
+#ifdef __B_LINK_TREE__
+        // Merges do not follow right links, a remove waits until no insert is halfway through a split.
+        std::unique_lock<std::shared_mutex> lock_tree(m_mutex);
+#else __B_LINK_TREE__
+        vtLocks.push_back(std::unique_lock<std::shared_mutex>(m_mutex));
+#endif __B_LINK_TREE__
+#endif __CONCURRENT__
+
+        uidCurrentNode = getRootNodeUID();
+
+        do
+        {
+#ifdef __TREE_AWARE_CACHE__
+            std::optional<ObjectUIDType> uidUpdated = std::nullopt;
+            m_ptrCache->getObject(uidCurrentNode, ptrCurrentNode, uidUpdated);    //TODO: lock
+
+            if (uidUpdated != std::nullopt)
+            {
+                if (ptrLastNode != nullptr)
+                {
+                    if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrLastNode->data))
+                    {
+                        std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrLastNode->data);
+                        ptrIndexNode->updateChildUID(uidCurrentNode, *uidUpdated);
+                        ptrLastNode->dirty = true;
+                    }
+                    else //if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*ptrLastNode->data))
+                    {
+                        throw new std::exception("should not occur!");
+                    }
+                }
+                else
+                {
+                    // ptrLastNode->dirty = true; todo: do for parent as well..
+                    setRootNodeUID(*uidUpdated);
+                }
+
+                uidCurrentNode = *uidUpdated;
+            }
+#else __TREE_AWARE_CACHE__
+            m_ptrCache->getObject(uidCurrentNode, ptrCurrentNode);    //TODO: lock
+#endif __TREE_AWARE_CACHE__
+
+
+#ifdef __CONCURRENT__
+            if (ptrLastNode == nullptr)
+            {
+                vtLocks.push_back(lockRootNode(ptrCurrentNode));
+            }
+            else
+            {
+                vtLocks.push_back(std::unique_lock<std::shared_mutex>(ptrCurrentNode->mutex));
+            }
+#endif __CONCURRENT__
+
+            if (ptrCurrentNode == nullptr)
+            {
+                throw new std::exception("should not occur!");
+            }
+
+            setDepth(ptrLastNode, ptrCurrentNode);
+
+            vtAccessedNodes.push_back(std::make_pair(uidCurrentNode, ptrCurrentNode));
+
+            if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data))
+            {
+                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data);
+
+                if (ptrIndexNode->canTriggerMerge(m_nDegree))
+                {
+                    vtNodes.push_back(std::pair<ObjectUIDType, ObjectTypePtr>(uidLastNode, ptrLastNode));
+                }
+                else
+                {
+#ifdef __CONCURRENT__
+                    if (vtLocks.size() > 3) //TODO: 3 seems to be working.. but how and why.. investiage....!
+                    {
                         vtLocks.erase(vtLocks.begin());
                     }
 #endif __CONCURRENT__
@@ -516,7 +1144,9 @@ public:
                     throw new std::exception("should not occur!");
                 }
 
-                if (*m_uidRootNode != uidChildNode)
+                ObjectUIDType uidCurrentRoot = getRootNodeUID();
+
+                if (uidCurrentRoot != uidChildNode)
                 {
                     throw new std::exception("should not occur!");
                 }
@@ -525,26 +1155,44 @@ public:
 
 #ifdef __TREE_AWARE_CACHE__
                 std::optional<ObjectUIDType> uidUpdated = std::nullopt;
-                m_ptrCache->getObject(*m_uidRootNode, ptrCurrentRoot, uidUpdated);
+                m_ptrCache->getObject(uidCurrentRoot, ptrCurrentRoot, uidUpdated);
 
                 assert(uidUpdated == std::nullopt);
 
                 ptrCurrentRoot->dirty = true;
 #else __TREE_AWARE_CACHE__
-                m_ptrCache->getObject(*m_uidRootNode, ptrCurrentRoot);
+                m_ptrCache->getObject(uidCurrentRoot, ptrCurrentRoot);
 #endif __TREE_AWARE_CACHE__
 
                 if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrCurrentRoot->data))
                 {
                     std::shared_ptr<IndexNodeType> ptrInnerNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrCurrentRoot->data);
                     if (ptrInnerNode->getKeysCount() == 0) {
-                        ObjectUIDType _tmp = ptrInnerNode->getChildAt(0);
-                        m_ptrCache->remove(*m_uidRootNode);
-                        m_uidRootNode = _tmp;
+                        // The root object is kept (see getRootNode), the remaining child is moved into it instead.
+                        ObjectUIDType uidOnlyChild = ptrInnerNode->getChildAt(0);
+                        ObjectTypePtr ptrOnlyChild = nullptr;
+                        getNode(ptrCurrentRoot, uidOnlyChild, ptrOnlyChild);
 
-#ifdef __TREE_AWARE_CACHE__
-                        ptrCurrentRoot->dirty = true;
-#endif __TREE_AWARE_CACHE__
+#ifdef __CONCURRENT__
+                        auto it = vtLocks.begin();
+                        while (it != vtLocks.end()) {
+                            if ((*it).mutex() == &ptrOnlyChild->mutex)
+                            {
+                                break;
+                            }
+                            it++;
+                        }
+
+                        if (it != vtLocks.end())
+                            vtLocks.erase(it);
+#endif __CONCURRENT__
+
+                        ptrOnlyChild = nullptr;
+                        moveIntoRootNode(ptrCurrentRoot, uidOnlyChild);
+
+#ifdef __B_LINK_TREE__
+                        m_nHeight--;
+#endif __B_LINK_TREE__
                     }
                 }
                 else if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*ptrCurrentRoot->data))
@@ -571,8 +1219,17 @@ public:
 
                     if (ptrChildIndexNode->requireMerge(m_nDegree))
                     {
+#ifdef __CONCURRENT__
+                        std::vector<std::unique_lock<std::shared_mutex>> vtSiblingLocks;
+                        lockSiblingNodes(prNodeDetails.second, key, vtSiblingLocks);
+#endif __CONCURRENT__
+
                         ptrParentIndexNode->template rebalanceIndexNode<std::shared_ptr<CacheType>, shared_ptr<IndexNodeType>>(m_ptrCache, uidChildNode, ptrChildIndexNode, key, m_nDegree, uidToDelete);
 
+#ifdef __CONCURRENT__
+                        vtSiblingLocks.clear();
+#endif __CONCURRENT__
+
 #ifdef __TREE_AWARE_CACHE__
                         prNodeDetails.second->dirty = true;
                         ptrChildNode->dirty = true;
@@ -607,8 +1264,17 @@ public:
 
                     std::shared_ptr<DataNodeType> ptrChildDataNode = std::get<std::shared_ptr<DataNodeType>>(*ptrChildNode->data);
 
+#ifdef __CONCURRENT__
+                    std::vector<std::unique_lock<std::shared_mutex>> vtSiblingLocks;
+                    lockSiblingNodes(prNodeDetails.second, key, vtSiblingLocks);
+#endif __CONCURRENT__
+
                     ptrParentIndexNode->template rebalanceDataNode<std::shared_ptr<CacheType>, shared_ptr<DataNodeType>>(m_ptrCache, uidChildNode, ptrChildDataNode, key, m_nDegree, uidToDelete);
 
+#ifdef __CONCURRENT__
+                    vtSiblingLocks.clear();
+#endif __CONCURRENT__
+
 #ifdef __TREE_AWARE_CACHE__
                     prNodeDetails.second->dirty = true;
                     ptrChildNode->dirty = true;
@@ -662,11 +1328,11 @@ public:
 
         ObjectTypePtr ptrRootNode = nullptr;
         std::optional<ObjectUIDType> uidUpdated = std::nullopt;
-        m_ptrCache->getObject(m_uidRootNode.value(), ptrRootNode, uidUpdated);
+        m_ptrCache->getObject(getRootNodeUID(), ptrRootNode, uidUpdated);
 
         if (uidUpdated != std::nullopt)
         {
-            m_uidRootNode = uidUpdated;
+            setRootNodeUID(*uidUpdated);
         }
 
         if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrRootNode->data))
@@ -688,20 +1354,929 @@ public:
         return m_ptrCache->getCacheState(lru, map);
     }
 
+    // bytes is the size of the cached nodes as reported by their getSize.
+    void getCacheState(size_t& lru, size_t& map, size_t& bytes)
+    {
+        return m_ptrCache->getCacheState(lru, map, bytes);
+    }
+
 #ifdef __TREE_AWARE_CACHE__
-public:
-    void applyExistingUpdates(std::shared_ptr<ObjectType> ptrObject
-        , std::unordered_map<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>& mpUIDUpdates)
+    // The bytes of the storage up to the end of the last node, what a copy of the store has to take (see compact).
+    size_t getStorageUsedSize()
     {
-        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrObject->data))
-        {
-            std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrObject->data);
+        return m_ptrCache->getStorageUsedSize();
+    }
+#endif __TREE_AWARE_CACHE__
 
-            auto it = ptrIndexNode->m_ptrData->m_vtChildren.begin();
-            while (it != ptrIndexNode->m_ptrData->m_vtChildren.end())
-            {
-                if (mpUIDUpdates.find(*it) != mpUIDUpdates.end())
-                {
+private:
+    // Reads m_uidRootNode through the sequence lock, i.e. without m_mutex.
+    inline ObjectUIDType getRootNodeUID()
+    {
+#ifdef __CONCURRENT__
+        do
+        {
+            uint64_t nVersion = m_nRootVersion.load(std::memory_order_acquire);
+
+            if (nVersion & 1)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            ObjectUIDType uidRootNode = *m_uidRootNode;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (m_nRootVersion.load(std::memory_order_relaxed) == nVersion)
+            {
+                return uidRootNode;
+            }
+        } while (true);
+#else __CONCURRENT__
+        return *m_uidRootNode;
+#endif __CONCURRENT__
+    }
+
+    inline void setRootNodeUID(const ObjectUIDType& uidRootNode)
+    {
+#ifdef __CONCURRENT__
+        uint64_t nVersion = m_nRootVersion.load(std::memory_order_relaxed);
+        do
+        {
+            while (nVersion & 1)
+            {
+                std::this_thread::yield();
+                nVersion = m_nRootVersion.load(std::memory_order_relaxed);
+            }
+        } while (!m_nRootVersion.compare_exchange_weak(nVersion, nVersion + 1, std::memory_order_acquire));
+
+        m_uidRootNode = uidRootNode;
+
+        m_nRootVersion.store(nVersion + 2, std::memory_order_release);
+#else __CONCURRENT__
+        m_uidRootNode = uidRootNode;
+#endif __CONCURRENT__
+    }
+
+    /*
+     * Readers do not go through m_mutex. This relies on the root object never being replaced: a root split moves
+     * the root's content down into a new node (moveOutOfRootNode) and a root that is left with a single child
+     * takes over that child's content (moveIntoRootNode). The root's UID may still change when the cache
+     * relocates the object, hence the UID is validated once the root is locked and the lookup is retried otherwise.
+     */
+#ifdef __CONCURRENT__
+    inline void getRootNode(ObjectUIDType& uidRootNode, ObjectTypePtr& ptrRootNode, std::vector<std::shared_lock<std::shared_mutex>>& vtLocks)
+    {
+        do
+        {
+            while (m_nRootWriters.load(std::memory_order_acquire) > 0)
+            {
+                std::this_thread::yield();
+            }
+
+            uint64_t nVersion = m_nRootVersion.load(std::memory_order_acquire);
+
+            uidRootNode = getRootNodeUID();
+
+            ptrRootNode = nullptr;
+            getNode(nullptr, uidRootNode, ptrRootNode);
+
+            std::shared_lock<std::shared_mutex> lock_root(ptrRootNode->mutex);
+
+            if (m_nRootVersion.load(std::memory_order_acquire) == nVersion)
+            {
+                vtLocks.push_back(std::move(lock_root));
+                return;
+            }
+        } while (true);
+    }
+#else __CONCURRENT__
+    inline void getRootNode(ObjectUIDType& uidRootNode, ObjectTypePtr& ptrRootNode)
+    {
+        uidRootNode = getRootNodeUID();
+
+        ptrRootNode = nullptr;
+        getNode(nullptr, uidRootNode, ptrRootNode);
+    }
+#endif __CONCURRENT__
+
+#ifdef __CONCURRENT__
+    inline std::unique_lock<std::shared_mutex> lockRootNode(ObjectTypePtr ptrRootNode)
+    {
+        m_nRootWriters.fetch_add(1, std::memory_order_acq_rel);
+
+        std::unique_lock<std::shared_mutex> lock_root(ptrRootNode->mutex);
+
+        m_nRootWriters.fetch_sub(1, std::memory_order_release);
+
+        return lock_root;
+    }
+
+    // rebalance reads, updates and may delete the siblings of the child, readers that are already past the parent can still sit on them.
+    inline void lockSiblingNodes(ObjectTypePtr ptrParentNode, const KeyType& key, std::vector<std::unique_lock<std::shared_mutex>>& vtLocks)
+    {
+        std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrParentNode->data);
+
+        size_t nChildIdx = ptrIndexNode->getChildNodeIdx(key);
+
+        if (nChildIdx > 0)
+        {
+            ObjectUIDType uidSibling = ptrIndexNode->getChildAt(nChildIdx - 1);
+            ObjectTypePtr ptrSibling = nullptr;
+            getNode(ptrParentNode, uidSibling, ptrSibling);
+
+            vtLocks.push_back(std::unique_lock<std::shared_mutex>(ptrSibling->mutex));
+        }
+
+        if (nChildIdx + 1 < ptrIndexNode->getChildrenCount())
+        {
+            ObjectUIDType uidSibling = ptrIndexNode->getChildAt(nChildIdx + 1);
+            ObjectTypePtr ptrSibling = nullptr;
+            getNode(ptrParentNode, uidSibling, ptrSibling);
+
+            vtLocks.push_back(std::unique_lock<std::shared_mutex>(ptrSibling->mutex));
+        }
+    }
+#endif __CONCURRENT__
+
+#ifdef __B_LINK_TREE__
+    inline std::optional<std::pair<KeyType, ObjectUIDType>>& getRightLink(ObjectTypePtr ptrNode)
+    {
+        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrNode->data))
+        {
+            return std::get<std::shared_ptr<IndexNodeType>>(*ptrNode->data)->getRightLink();
+        }
+
+        return std::get<std::shared_ptr<DataNodeType>>(*ptrNode->data)->getRightLink();
+    }
+
+    inline uint32_t& getVersion(ObjectTypePtr ptrNode)
+    {
+        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrNode->data))
+        {
+            return std::get<std::shared_ptr<IndexNodeType>>(*ptrNode->data)->getVersion();
+        }
+
+        return std::get<std::shared_ptr<DataNodeType>>(*ptrNode->data)->getVersion();
+    }
+
+    inline void getLinkedNode(const ObjectUIDType& uidNode, ObjectTypePtr& ptrNode)
+    {
+#ifdef __TREE_AWARE_CACHE__
+        std::optional<ObjectUIDType> uidUpdated = std::nullopt;
+        m_ptrCache->getObject(uidNode, ptrNode, uidUpdated);
+
+        // The insert that set the link holds on to the sibling until the parent refers to it, it is still cached.
+        assert(uidUpdated == std::nullopt);
+#else __TREE_AWARE_CACHE__
+        m_ptrCache->getObject(uidNode, ptrNode);
+#endif __TREE_AWARE_CACHE__
+
+        if (ptrNode == nullptr)
+        {
+            throw new std::exception("should not occur!");
+        }
+    }
+
+    // Follows the right link of ptrNode, lockNode is the lock held on ptrNode and is handed over to the sibling.
+    template <typename LockType>
+    inline void moveToRightSibling(ObjectUIDType& uidNode, ObjectTypePtr& ptrNode, LockType& lockNode)
+    {
+        ObjectUIDType uidSibling = getRightLink(ptrNode)->second;
+        ObjectTypePtr ptrSibling = nullptr;
+        getLinkedNode(uidSibling, ptrSibling);
+
+        lockNode = LockType(ptrSibling->mutex);
+
+        uidNode = uidSibling;
+        ptrNode = ptrSibling;
+    }
+
+    // Follows the right links for as long as the key is not below the node's high key.
+    template <typename LockType>
+    inline void moveRight(const KeyType& key, ObjectUIDType& uidNode, ObjectTypePtr& ptrNode, LockType& lockNode)
+    {
+        while (getRightLink(ptrNode) && !(key < getRightLink(ptrNode)->first))
+        {
+            moveToRightSibling(uidNode, ptrNode, lockNode);
+        }
+    }
+
+    // Moves to the node whose right link leads to ptrNode, searching from the child at nChildIdx of the (locked) parent.
+    // Returns false if ptrNode is that child itself. Nodes are locked from left to right, so ptrNode is released first.
+    template <typename LockType>
+    inline bool moveLeft(ObjectTypePtr ptrParentNode, size_t nChildIdx, ObjectUIDType& uidNode, ObjectTypePtr& ptrNode, LockType& lockNode)
+    {
+        std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrParentNode->data);
+
+        ObjectUIDType uidCurrentNode = ptrIndexNode->getChildAt(nChildIdx);
+        ObjectTypePtr ptrCurrentNode = nullptr;
+        getNode(ptrParentNode, uidCurrentNode, ptrCurrentNode);
+
+        if (ptrCurrentNode == ptrNode)
+        {
+            return false;
+        }
+
+        lockNode.unlock();
+        lockNode = LockType(ptrCurrentNode->mutex);
+
+        do
+        {
+            if (!getRightLink(ptrCurrentNode))
+            {
+                throw new std::exception("should not occur!");
+            }
+
+            ObjectUIDType uidSibling = getRightLink(ptrCurrentNode)->second;
+            ObjectTypePtr ptrSibling = nullptr;
+            getLinkedNode(uidSibling, ptrSibling);
+
+            if (ptrSibling == ptrNode)
+            {
+                break;
+            }
+
+            lockNode = LockType(ptrSibling->mutex);
+
+            uidCurrentNode = uidSibling;
+            ptrCurrentNode = ptrSibling;
+        } while (true);
+
+        uidNode = uidCurrentNode;
+        ptrNode = ptrCurrentNode;
+
+        return true;
+    }
+
+    // Called with ptrNode locked right after it has been split: the new sibling takes over the node's link and the
+    // node links to the sibling. Both are kept referenced for as long as they have a link.
+    inline void linkRightSibling(ObjectTypePtr ptrNode, const KeyType& pivotKey, ObjectUIDType& uidSibling, ObjectTypePtr& ptrSibling)
+    {
+#ifdef __TREE_AWARE_CACHE__
+        std::optional<ObjectUIDType> uidUpdated = std::nullopt;
+        m_ptrCache->getObject(uidSibling, ptrSibling, uidUpdated);
+
+        if (uidUpdated != std::nullopt)
+        {
+            uidSibling = *uidUpdated;
+        }
+#else __TREE_AWARE_CACHE__
+        m_ptrCache->getObject(uidSibling, ptrSibling);
+#endif __TREE_AWARE_CACHE__
+
+        // Nobody can reach the sibling before the node links to it.
+        getRightLink(ptrSibling) = getRightLink(ptrNode);
+        getRightLink(ptrNode) = std::make_pair(pivotKey, uidSibling);
+
+        getVersion(ptrNode)++;
+
+        std::unique_lock<std::mutex> lock_linked(m_mtxLinkedNodes);
+
+        m_setLinkedNodes.insert(ptrNode);
+
+        if (getRightLink(ptrSibling))
+        {
+            m_setLinkedNodes.insert(ptrSibling);
+        }
+    }
+
+    // Called with the parent locked once it refers to uidSibling: drops the link to uidSibling. It is usually held by
+    // the child left of uidSibling but nodes split off from that child in the meantime may sit in between.
+    inline void unlinkRightSibling(ObjectTypePtr ptrParentNode, const KeyType& pivotKey, const ObjectUIDType& uidSibling)
+    {
+        std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrParentNode->data);
+
+        ObjectUIDType uidNode = ptrIndexNode->getChildAt(ptrIndexNode->getChildNodeIdx(pivotKey) - 1);
+        ObjectTypePtr ptrNode = nullptr;
+        getNode(ptrParentNode, uidNode, ptrNode);
+
+        std::unique_lock<std::shared_mutex> lock_node(ptrNode->mutex);
+
+        while (!(getRightLink(ptrNode)->second == uidSibling))
+        {
+            moveToRightSibling(uidNode, ptrNode, lock_node);
+
+            if (!getRightLink(ptrNode))
+            {
+                throw new std::exception("should not occur!");
+            }
+        }
+
+        getRightLink(ptrNode).reset();
+
+        std::unique_lock<std::mutex> lock_linked(m_mtxLinkedNodes);
+        m_setLinkedNodes.erase(ptrNode);
+    }
+
+    // Splits the root in place, its content moves down into a new node next to uidRHSNode.
+    inline void splitRootNode(ObjectTypePtr ptrRootNode, const KeyType& pivotKey, const ObjectUIDType& uidRHSNode)
+    {
+        uint32_t nVersion = getVersion(ptrRootNode);
+
+        std::optional<ObjectUIDType> uidNewLHSNode;
+        moveOutOfRootNode(ptrRootNode, uidNewLHSNode);
+
+        *ptrRootNode->data = std::make_shared<IndexNodeType>(pivotKey, *uidNewLHSNode, uidRHSNode);
+
+        // The root's range does not shrink, the version tells that its level has changed instead.
+        getVersion(ptrRootNode) = nVersion + 1;
+
+#ifdef __TREE_AWARE_CACHE__
+        ptrRootNode->dirty = true;
+#endif __TREE_AWARE_CACHE__
+
+        m_nHeight++;
+    }
+
+    // Locks exclusively the node at nLevel (the leaves being level 0) whose range covers the key, walking down from
+    // the root with lock coupling. The nodes above it are put in vtPath, the root first.
+    inline void lockNodeAtLevel(const KeyType& key, size_t nLevel, ObjectUIDType& uidNode, ObjectTypePtr& ptrNode,
+        std::unique_lock<std::shared_mutex>& lockNode, std::vector<std::tuple<ObjectUIDType, ObjectTypePtr, uint32_t>>& vtPath)
+    {
+        do
+        {
+            vtPath.clear();
+
+            std::vector<std::shared_lock<std::shared_mutex>> vtLocks;
+            getRootNode(uidNode, ptrNode, vtLocks);
+
+            size_t nNodeLevel = m_nHeight - 1;
+
+            if (nNodeLevel == nLevel)
+            {
+                vtLocks.clear();
+                lockNode = lockRootNode(ptrNode);
+
+                if (m_nHeight - 1 == nLevel)
+                {
+                    return;
+                }
+
+                // The root has been split in between.
+                lockNode.unlock();
+                continue;
+            }
+
+            do
+            {
+                moveRight(key, uidNode, ptrNode, vtLocks.back());
+
+                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrNode->data);
+
+                vtPath.push_back(std::make_tuple(uidNode, ptrNode, ptrIndexNode->getVersion()));
+
+                ObjectTypePtr ptrParentNode = ptrNode;
+
+                uidNode = ptrIndexNode->getChild(key);
+                ptrNode = nullptr;
+                getNode(ptrParentNode, uidNode, ptrNode);
+
+                if (--nNodeLevel == nLevel)
+                {
+                    lockNode = std::unique_lock<std::shared_mutex>(ptrNode->mutex);
+                    moveRight(key, uidNode, ptrNode, lockNode);
+
+                    return;
+                }
+
+                vtLocks.push_back(std::shared_lock<std::shared_mutex>(ptrNode->mutex));
+                vtLocks.erase(vtLocks.begin());
+            } while (true);
+        } while (true);
+    }
+#endif __B_LINK_TREE__
+
+    // Copies the root's content into a new node, the caller then turns the root into the parent of that node.
+    inline void moveOutOfRootNode(ObjectTypePtr ptrRootNode, std::optional<ObjectUIDType>& uidNode)
+    {
+        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrRootNode->data))
+        {
+            std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrRootNode->data);
+            m_ptrCache->template createObjectOfType<IndexNodeType>(uidNode, *ptrIndexNode);
+        }
+        else
+        {
+            std::shared_ptr<DataNodeType> ptrDataNode = std::get<std::shared_ptr<DataNodeType>>(*ptrRootNode->data);
+            m_ptrCache->template createObjectOfType<DataNodeType>(uidNode, *ptrDataNode);
+        }
+
+        if (!uidNode)
+        {
+            throw new std::exception("should not occur!");
+        }
+    }
+
+    // Hands the content of the given node over to the root and releases the node. The caller holds the root exclusively
+    // and the node must not be locked.
+    inline void moveIntoRootNode(ObjectTypePtr ptrRootNode, ObjectUIDType uidNode)
+    {
+        ObjectTypePtr ptrNode = nullptr;
+
+#ifdef __TREE_AWARE_CACHE__
+        std::optional<ObjectUIDType> uidUpdated = std::nullopt;
+        m_ptrCache->getObject(uidNode, ptrNode, uidUpdated);
+
+        if (uidUpdated != std::nullopt)
+        {
+            uidNode = *uidUpdated;
+        }
+#else __TREE_AWARE_CACHE__
+        m_ptrCache->getObject(uidNode, ptrNode);
+#endif __TREE_AWARE_CACHE__
+
+        if (ptrNode == nullptr)
+        {
+            throw new std::exception("should not occur!");
+        }
+
+        *ptrRootNode->data = *ptrNode->data;
+
+#ifdef __TREE_AWARE_CACHE__
+        ptrRootNode->dirty = true;
+#endif __TREE_AWARE_CACHE__
+
+        ptrNode = nullptr;
+        m_ptrCache->remove(uidNode);
+    }
+
+    inline void getNode(ObjectTypePtr ptrParentNode, ObjectUIDType& uidNode, ObjectTypePtr& ptrNode)
+    {
+#ifdef __TREE_AWARE_CACHE__
+        std::optional<ObjectUIDType> uidUpdated = std::nullopt;
+        m_ptrCache->getObject(uidNode, ptrNode, uidUpdated);
+
+        if (uidUpdated != std::nullopt)
+        {
+            if (ptrParentNode != nullptr)
+            {
+                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrParentNode->data);
+                ptrIndexNode->updateChildUID(uidNode, *uidUpdated);
+
+                ptrParentNode->dirty = true;
+            }
+            else
+            {
+                setRootNodeUID(*uidUpdated);
+            }
+
+            uidNode = *uidUpdated;
+        }
+#else __TREE_AWARE_CACHE__
+        m_ptrCache->getObject(uidNode, ptrNode);
+#endif __TREE_AWARE_CACHE__
+
+        if (ptrNode == nullptr)
+        {
+            throw new std::exception("should not occur!");
+        }
+
+        setDepth(ptrParentNode, ptrNode);
+    }
+
+    // The cache may keep the upper levels resident, so a node learns its depth whenever it is reached from its parent.
+    inline void setDepth(ObjectTypePtr ptrParentNode, ObjectTypePtr ptrNode)
+    {
+        uint8_t nDepth = 0;
+
+        if (ptrParentNode != nullptr)
+        {
+            nDepth = ptrParentNode->depth.load(std::memory_order_relaxed);
+            nDepth = nDepth < UINT8_MAX - 1 ? nDepth + 1 : UINT8_MAX;
+        }
+
+        ptrNode->depth.store(nDepth, std::memory_order_relaxed);
+    }
+
+    // Moves the first nEntries of the pending entries into a new data node and registers it with the level above.
+    inline void bulkLoadDataNode(std::vector<KeyType>& vtKeys, std::vector<ValueType>& vtValues, size_t nEntries
+        , std::vector<std::pair<std::vector<KeyType>, std::vector<ObjectUIDType>>>& vtLevels, size_t nIndexNodeFill)
+    {
+        std::optional<ObjectUIDType> uidNode;
+        m_ptrCache->template createObjectOfType<DataNodeType>(uidNode, vtKeys.begin(), vtKeys.begin() + nEntries, vtValues.begin(), vtValues.begin() + nEntries);
+
+        if (!uidNode)
+        {
+            throw new std::exception("should not occur!");
+        }
+
+        KeyType keyNode = vtKeys.front();
+
+        vtKeys.erase(vtKeys.begin(), vtKeys.begin() + nEntries);
+        vtValues.erase(vtValues.begin(), vtValues.begin() + nEntries);
+
+        bulkLoadChild(vtLevels, 0, keyNode, *uidNode, nIndexNodeFill);
+    }
+
+    // Moves the first nChildren pending children of the given level into a new index node and registers it with the level above.
+    inline void bulkLoadIndexNode(std::vector<std::pair<std::vector<KeyType>, std::vector<ObjectUIDType>>>& vtLevels, size_t nLevel, size_t nChildren, size_t nIndexNodeFill)
+    {
+        std::vector<KeyType>& vtKeys = vtLevels[nLevel].first;
+        std::vector<ObjectUIDType>& vtChildren = vtLevels[nLevel].second;
+
+        // The smallest key of the first child is not a pivot of this node but of its parent.
+        std::optional<ObjectUIDType> uidNode;
+        m_ptrCache->template createObjectOfType<IndexNodeType>(uidNode, vtKeys.begin() + 1, vtKeys.begin() + nChildren, vtChildren.begin(), vtChildren.begin() + nChildren);
+
+        if (!uidNode)
+        {
+            throw new std::exception("should not occur!");
+        }
+
+        KeyType keyNode = vtKeys.front();
+
+        vtKeys.erase(vtKeys.begin(), vtKeys.begin() + nChildren);
+        vtChildren.erase(vtChildren.begin(), vtChildren.begin() + nChildren);
+
+        bulkLoadChild(vtLevels, nLevel + 1, keyNode, *uidNode, nIndexNodeFill);
+    }
+
+    inline void bulkLoadChild(std::vector<std::pair<std::vector<KeyType>, std::vector<ObjectUIDType>>>& vtLevels, size_t nLevel, const KeyType& keyChild, const ObjectUIDType& uidChild, size_t nIndexNodeFill)
+    {
+        if (vtLevels.size() == nLevel)
+        {
+            vtLevels.emplace_back();
+        }
+
+        vtLevels[nLevel].first.push_back(keyChild);
+        vtLevels[nLevel].second.push_back(uidChild);
+
+        if (vtLevels[nLevel].second.size() == 2 * nIndexNodeFill)
+        {
+            bulkLoadIndexNode(vtLevels, nLevel, nIndexNodeFill, nIndexNodeFill);
+        }
+    }
+
+    /*
+     * Range scans descend once and then walk the leaves in key order by keeping the root-to-leaf path.
+     * The shared locks on the path are retained until the scan leaves the corresponding subtree, so
+     * writers cannot split or merge a node whose position the scan still relies on.
+     */
+    template <typename Callback>
+    ErrorCode scanRange(const KeyType& keyBegin, const KeyType& keyEnd, Callback& fnCallback, bool bForward)
+    {
+        if (!(keyBegin < keyEnd))
+        {
+            return ErrorCode::Success;
+        }
+
+        std::vector<std::pair<ObjectUIDType, ObjectTypePtr>> vtAccessedNodes;
+        std::vector<std::pair<ObjectTypePtr, size_t>> vtPath;   // index node and the position of the child being visited.
+
+        bool bSeek = true;  // the first descent follows the boundary key, the following ones the outermost edge.
+        ObjectTypePtr ptrParentNode = nullptr;
+        ObjectTypePtr ptrCurrentNode = nullptr;
+        ObjectUIDType uidCurrentNode;
+
+#ifdef __CONCURRENT__
+        std::vector<std::shared_lock<std::shared_mutex>> vtLocks;
+        getRootNode(uidCurrentNode, ptrCurrentNode, vtLocks);
+#else __CONCURRENT__
+        getRootNode(uidCurrentNode, ptrCurrentNode);
+#endif __CONCURRENT__
+
+        do
+        {
+            if (ptrCurrentNode == nullptr)
+            {
+                getNode(ptrParentNode, uidCurrentNode, ptrCurrentNode);
+
+#ifdef __CONCURRENT__
+                vtLocks.push_back(std::shared_lock<std::shared_mutex>(ptrCurrentNode->mutex));
+#endif __CONCURRENT__
+
+#ifdef __B_LINK_TREE__
+                // Of a node that is being split, a forward scan starts with the left part (unless seeking) and a
+                // reverse scan with the right one.
+                if (bSeek || !bForward)
+                {
+                    moveRight(bForward ? keyBegin : keyEnd, uidCurrentNode, ptrCurrentNode, vtLocks.back());
+                }
+#endif __B_LINK_TREE__
+            }
+
+            // Only the UID is kept so that the leaves already visited remain evictable during long scans.
+            vtAccessedNodes.push_back(std::make_pair(uidCurrentNode, nullptr));
+
+            if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data))
+            {
+                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data);
+
+                size_t nChildIdx = 0;
+                if (bSeek)
+                {
+                    nChildIdx = ptrIndexNode->getChildNodeIdx(bForward ? keyBegin : keyEnd);
+                }
+                else if (!bForward)
+                {
+                    nChildIdx = ptrIndexNode->getChildrenCount() - 1;
+                }
+
+                vtPath.push_back(std::make_pair(ptrCurrentNode, nChildIdx));
+
+                ptrParentNode = ptrCurrentNode;
+                ptrCurrentNode = nullptr;
+                uidCurrentNode = ptrIndexNode->getChildAt(nChildIdx);
+
+                continue;
+            }
+
+            std::shared_ptr<DataNodeType> ptrDataNode = std::get<std::shared_ptr<DataNodeType>>(*ptrCurrentNode->data);
+
+            bool bContinue = bForward ? ptrDataNode->scan(keyBegin, keyEnd, fnCallback) : ptrDataNode->reverseScan(keyBegin, keyEnd, fnCallback);
+
+#ifdef __B_LINK_TREE__
+            // The other parts of a split leaf are not known to the parent yet.
+            if (bContinue && bForward && ptrDataNode->getRightLink() && ptrDataNode->getRightLink()->first < keyEnd)
+            {
+                moveToRightSibling(uidCurrentNode, ptrCurrentNode, vtLocks.back());
+                continue;
+            }
+
+            if (bContinue && !bForward && vtPath.size() > 0
+                && moveLeft(vtPath.back().first, vtPath.back().second, uidCurrentNode, ptrCurrentNode, vtLocks.back()))
+            {
+                continue;
+            }
+#endif __B_LINK_TREE__
+
+#ifdef __CONCURRENT__
+            vtLocks.pop_back();
+#endif __CONCURRENT__
+
+            if (!bContinue)
+            {
+                break;
+            }
+
+            bSeek = false;
+            bContinue = false;
+
+            // Climb to the nearest ancestor that still has a sibling subtree overlapping the range.
+            while (vtPath.size() > 0)
+            {
+                std::pair<ObjectTypePtr, size_t>& prNode = vtPath.back();
+                std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*prNode.first->data);
+
+                if (bForward)
+                {
+                    if (prNode.second + 1 < ptrIndexNode->getChildrenCount() && ptrIndexNode->getPivotAt(prNode.second) < keyEnd)
+                    {
+                        prNode.second++;
+                        bContinue = true;
+                    }
+#ifdef __B_LINK_TREE__
+                    else if (ptrIndexNode->getRightLink() && ptrIndexNode->getRightLink()->first < keyEnd)
+                    {
+                        moveToRightSibling(uidCurrentNode, prNode.first, vtLocks.back());
+
+                        ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*prNode.first->data);
+                        prNode.second = 0;
+                        bContinue = true;
+                    }
+#endif __B_LINK_TREE__
+                }
+                else
+                {
+                    if (prNode.second > 0 && keyBegin < ptrIndexNode->getPivotAt(prNode.second - 1))
+                    {
+                        prNode.second--;
+                        bContinue = true;
+                    }
+#ifdef __B_LINK_TREE__
+                    else if (prNode.second == 0 && vtPath.size() > 1
+                        && moveLeft(vtPath[vtPath.size() - 2].first, vtPath[vtPath.size() - 2].second, uidCurrentNode, prNode.first, vtLocks.back()))
+                    {
+                        ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*prNode.first->data);
+                        prNode.second = ptrIndexNode->getChildrenCount() - 1;
+                        bContinue = true;
+                    }
+#endif __B_LINK_TREE__
+                }
+
+                if (bContinue)
+                {
+                    ptrParentNode = prNode.first;
+                    ptrCurrentNode = nullptr;
+                    uidCurrentNode = ptrIndexNode->getChildAt(prNode.second);
+                    break;
+                }
+
+                vtPath.pop_back();
+
+#ifdef __CONCURRENT__
+                vtLocks.pop_back();
+#endif __CONCURRENT__
+            }
+
+            if (!bContinue)
+            {
+                break;
+            }
+        } while (true);
+
+        vtPath.clear();
+
+#ifdef __CONCURRENT__
+        vtLocks.clear();
+#endif __CONCURRENT__
+
+        // Leaves released earlier in the walk may already have been evicted.
+        m_ptrCache->reorder(vtAccessedNodes, false);
+        vtAccessedNodes.clear();
+
+        return ErrorCode::Success;
+    }
+
+#ifdef __TREE_AWARE_CACHE__
+public:
+    /*
+     * One step of an online compaction pass over the leaves in key order. Starting with the leaf that covers keyCursor
+     * (the first leaf if there is none), it looks at up to nMaxNodes leaves under the same parent and marks the ones,
+     * along with the nodes on the path, dirty that the storage would place closer to its front. The cache writes them
+     * out when they are evicted, into the lowest free blocks that fit, and their parents pick up the new uids through
+     * applyExistingUpdates/prepareFlush as with any other update. The leaves are reordered in the cache so that they are
+     * evicted, and thus laid out, in key order, but still ahead of their parents (a parent cannot go to the storage
+     * before the children that have not been there yet).
+     * keyCursor is advanced to where the next step continues, it is std::nullopt once the pass is complete.
+     */
+    ErrorCode compact(std::optional<KeyType>& keyCursor, size_t nMaxNodes)
+    {
+        std::vector<std::pair<ObjectUIDType, ObjectTypePtr>> vtAccessedNodes;
+        std::vector<std::pair<ObjectUIDType, ObjectTypePtr>> vtLeafNodes;
+
+        auto markRelocatable = [this](const ObjectUIDType& uidNode, ObjectTypePtr ptrNode)
+        {
+            if (m_ptrCache->isRelocatable(uidNode))
+            {
+                ptrNode->dirty = true;
+            }
+        };
+
+        std::optional<KeyType> keyUpperBound;
+        std::optional<KeyType> keyParentUpperBound;
+        size_t nChildIdx = 0;
+
+        ObjectTypePtr ptrParentNode = nullptr;
+        ObjectTypePtr ptrCurrentNode = nullptr;
+        ObjectUIDType uidCurrentNode;
+
+#ifdef __CONCURRENT__
+        std::vector<std::shared_lock<std::shared_mutex>> vtLocks;
+        getRootNode(uidCurrentNode, ptrCurrentNode, vtLocks);
+#else __CONCURRENT__
+        getRootNode(uidCurrentNode, ptrCurrentNode);
+#endif __CONCURRENT__
+
+        do
+        {
+            if (ptrCurrentNode == nullptr)
+            {
+                getNode(ptrParentNode, uidCurrentNode, ptrCurrentNode);
+
+#ifdef __CONCURRENT__
+                // The parent stays locked along with the node, its children are gone through once a leaf is reached.
+                vtLocks.push_back(std::shared_lock<std::shared_mutex>(ptrCurrentNode->mutex));
+                if (vtLocks.size() > 2)
+                {
+                    vtLocks.erase(vtLocks.begin());
+                }
+#endif __CONCURRENT__
+            }
+
+#ifdef __B_LINK_TREE__
+            if (keyCursor)
+            {
+                moveRight(*keyCursor, uidCurrentNode, ptrCurrentNode, vtLocks.back());
+            }
+#endif __B_LINK_TREE__
+
+            markRelocatable(uidCurrentNode, ptrCurrentNode);
+
+            if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*ptrCurrentNode->data))
+            {
+                vtLeafNodes.push_back(std::make_pair(uidCurrentNode, ptrCurrentNode));
+                break;
+            }
+
+            vtAccessedNodes.push_back(std::make_pair(uidCurrentNode, ptrCurrentNode));
+
+            std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrCurrentNode->data);
+
+#ifdef __B_LINK_TREE__
+            if (ptrIndexNode->getRightLink() && (!keyUpperBound || ptrIndexNode->getRightLink()->first < *keyUpperBound))
+            {
+                keyUpperBound = ptrIndexNode->getRightLink()->first;
+            }
+#endif __B_LINK_TREE__
+
+            keyParentUpperBound = keyUpperBound;
+
+            nChildIdx = keyCursor ? ptrIndexNode->getChildNodeIdx(*keyCursor) : 0;
+            if (nChildIdx < ptrIndexNode->getKeysCount())
+            {
+                keyUpperBound = ptrIndexNode->getPivotAt(nChildIdx);
+            }
+
+            ptrParentNode = ptrCurrentNode;
+            ptrCurrentNode = nullptr;
+            uidCurrentNode = ptrIndexNode->getChildAt(nChildIdx);
+        } while (true);
+
+        if (ptrParentNode == nullptr)
+        {
+            // The root is the only leaf.
+            keyCursor = std::nullopt;
+        }
+        else
+        {
+#ifdef __CONCURRENT__
+            vtLocks.pop_back();
+#endif __CONCURRENT__
+
+            // The leaves are all on the same level, i.e. the rest of the parent's children are leaves as well. Only the
+            // ones that are going to be moved are loaded.
+            std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrParentNode->data);
+
+            size_t nIdx = nChildIdx + 1;
+            for (; nIdx < ptrIndexNode->getChildrenCount() && nIdx < nChildIdx + nMaxNodes; nIdx++)
+            {
+                ObjectUIDType uidChildNode = ptrIndexNode->getChildAt(nIdx);
+                if (!m_ptrCache->isRelocatable(uidChildNode))
+                {
+                    continue;
+                }
+
+                ObjectTypePtr ptrChildNode = nullptr;
+                getNode(ptrParentNode, uidChildNode, ptrChildNode);
+
+#ifdef __CONCURRENT__
+                std::shared_lock<std::shared_mutex> lock_child(ptrChildNode->mutex);
+#endif __CONCURRENT__
+
+                markRelocatable(uidChildNode, ptrChildNode);
+
+                vtLeafNodes.push_back(std::make_pair(uidChildNode, ptrChildNode));
+            }
+
+            if (nIdx < ptrIndexNode->getChildrenCount())
+            {
+                keyCursor = ptrIndexNode->getPivotAt(nIdx - 1);
+            }
+            else
+            {
+                keyCursor = keyParentUpperBound;
+            }
+        }
+
+#ifdef __CONCURRENT__
+        vtLocks.clear();
+#endif __CONCURRENT__
+
+        // The cache goes through them from the back, i.e. the leaf with the lowest key ends up as the least recently used
+        // one and the root as the most recently used one.
+        vtAccessedNodes.insert(vtAccessedNodes.end(), vtLeafNodes.rbegin(), vtLeafNodes.rend());
+
+        m_ptrCache->reorder(vtAccessedNodes, false);
+        vtAccessedNodes.clear();
+
+        return ErrorCode::Success;
+    }
+
+#ifdef __ONLINE_COMPACTION__
+private:
+    static void handlerCompaction(BPlusStore* ptrSelf)
+    {
+        std::optional<KeyType> keyCursor;
+
+        do
+        {
+            // A pass that has been started is run to the end, the nodes only move once they are evicted.
+            if (keyCursor || ptrSelf->m_ptrCache->getStorageFragmentation() * 100 > COMPACTION_THRESHOLD)
+            {
+                ptrSelf->compact(keyCursor, COMPACTION_NODES_PER_STEP);
+            }
+
+            std::this_thread::sleep_for(100ms);
+
+        } while (!ptrSelf->m_bStop);
+    }
+
+public:
+#endif __ONLINE_COMPACTION__
+
+    void applyExistingUpdates(std::shared_ptr<ObjectType> ptrObject
+        , std::unordered_map<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>& mpUIDUpdates)
+    {
+        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrObject->data))
+        {
+            std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrObject->data);
+
+            auto it = ptrIndexNode->m_data.m_vtChildren.begin();
+            while (it != ptrIndexNode->m_data.m_vtChildren.end())
+            {
+                if (mpUIDUpdates.find(*it) != mpUIDUpdates.end())
+                {
                     ObjectUIDType uidTemp = *it;
 
                     *it = *(mpUIDUpdates[*it].first);
@@ -729,8 +2304,8 @@ public:
             {
                 std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*(*it).second.second->data);
 
-                auto it_children = ptrIndexNode->m_ptrData->m_vtChildren.begin();
-                while (it_children != ptrIndexNode->m_ptrData->m_vtChildren.end())
+                auto it_children = ptrIndexNode->m_data.m_vtChildren.begin();
+                while (it_children != ptrIndexNode->m_data.m_vtChildren.end())
                 {
                     if (mpUIDUpdates.find(*it_children) != mpUIDUpdates.end())
                     {
@@ -754,7 +2329,7 @@ public:
     }
 
     void prepareFlush(std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>>& vtNodes
-        , size_t& nPos, size_t nBlockSize, ObjectUIDType::Media nMediaType)
+        , const std::function<size_t(size_t)>& fnAllocate, size_t nBlockSize, ObjectUIDType::Media nMediaType)
     {
         std::vector<bool> vtAppliedUpdates;
         vtAppliedUpdates.resize(vtNodes.size(), false);
@@ -765,8 +2340,8 @@ public:
             {
                 std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*vtNodes[idx].second.second->data);
 
-                auto it = ptrIndexNode->m_ptrData->m_vtChildren.begin();
-                while (it != ptrIndexNode->m_ptrData->m_vtChildren.end())
+                auto it = ptrIndexNode->m_data.m_vtChildren.begin();
+                while (it != ptrIndexNode->m_data.m_vtChildren.end())
                 {
                     for (int jdx = 0; jdx < idx; jdx++)
                     {
@@ -793,11 +2368,11 @@ public:
 
                 size_t nNodeSize = ptrIndexNode->getSize();
 
+                size_t nPos = fnAllocate(std::ceil(nNodeSize / (float)nBlockSize));
+
                 ObjectUIDType uidUpdated = ObjectUIDType::createAddressFromArgs(nMediaType, nPos, nBlockSize, nNodeSize);
 
                 vtNodes[idx].second.first = uidUpdated;
-
-                nPos += std::ceil(nNodeSize / (float)nBlockSize);
             }
             else if (std::holds_alternative<std::shared_ptr<DataNodeType>>(*vtNodes[idx].second.second->data))
             {
@@ -811,13 +2386,25 @@ public:
 
                 size_t nNodeSize = ptrDataNode->getSize();
 
+                size_t nPos = fnAllocate(std::ceil(nNodeSize / (float)nBlockSize));
+
                 ObjectUIDType uidUpdated = ObjectUIDType::createAddressFromArgs(nMediaType, nPos, nBlockSize, nNodeSize);
 
                 vtNodes[idx].second.first = uidUpdated;
-
-                nPos += std::ceil(nNodeSize / (float)nBlockSize);
             }
         }
     }
+
+    void getChildUIDs(std::shared_ptr<ObjectType> ptrObject, std::vector<ObjectUIDType>& vtChildUIDs)
+    {
+        vtChildUIDs.clear();
+
+        if (std::holds_alternative<std::shared_ptr<IndexNodeType>>(*ptrObject->data))
+        {
+            std::shared_ptr<IndexNodeType> ptrIndexNode = std::get<std::shared_ptr<IndexNodeType>>(*ptrObject->data);
+
+            vtChildUIDs.assign(ptrIndexNode->m_data.m_vtChildren.begin(), ptrIndexNode->m_data.m_vtChildren.end());
+        }
+    }
 #endif __TREE_AWARE_CACHE__
 };
\ No newline at end of file
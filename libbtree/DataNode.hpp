@@ -10,6 +10,8 @@
 #include <fstream>
 #include <assert.h>
 #include "ErrorCodes.h"
+#include "KeySearch.hpp"
+#include "NodeBlock.hpp"
 
 template <typename KeyType, typename ValueType, typename ObjectUIDType, uint8_t TYPE_UID>
 class DataNode
@@ -20,46 +22,52 @@ public:
 private:
 	typedef DataNode<KeyType, ValueType, ObjectUIDType, TYPE_UID> SelfType;
 
-	typedef std::vector<KeyType>::const_iterator KeyTypeIterator;
-	typedef std::vector<ValueType>::const_iterator ValueTypeIterator;
+	typedef NodeArray<KeyType>::const_iterator KeyTypeIterator;
 
-	struct DATANODESTRUCT
+	// The keys and the values share one cache-line-aligned allocation, see NodeBlock.
+	struct DATANODESTRUCT : public NodeBlock
 	{
-		std::vector<KeyType> m_vtKeys;
-		std::vector<ValueType> m_vtValues;
+		NodeArray<KeyType> m_vtKeys;
+		NodeArray<ValueType> m_vtValues;
+
+		inline void reserve(size_t nCapacity)
+		{
+			NodeBlock::reserve(nCapacity, m_vtKeys, m_vtValues);
+		}
 	};
 
 public:
-	std::shared_ptr<DATANODESTRUCT> m_ptrData;
+	DATANODESTRUCT m_data;
 
-public:
-	~DataNode()
-	{
-		// TODO: check for ref count?
-		m_ptrData.reset();
-	}
+private:
+	// B-link: the high key and the right sibling, set when the node is split and cleared once the parent refers to the
+	// sibling. It is not serialized as it does not outlive the insert that split the node.
+	std::optional<std::pair<KeyType, ObjectUIDType>> m_prRightLink;
 
+	// B-link: bumped whenever the node is split, in memory only as well.
+	uint32_t m_nVersion = 0;
+
+public:
 	DataNode()
-		: m_ptrData(make_shared<DATANODESTRUCT>())
 	{
 	}
 
 	DataNode(const DataNode& source)
-		: m_ptrData(make_shared<DATANODESTRUCT>())
 	{
-		for (const auto& obj : source.m_ptrData->m_vtKeys)
+		m_data.reserve(source.m_data.capacity());
+
+		for (const auto& obj : source.m_data.m_vtKeys)
 		{
-			m_ptrData->m_vtKeys.push_back(KeyType(obj));
+			m_data.m_vtKeys.push_back(KeyType(obj));
 		}
 
-		for (const auto& obj : source.m_ptrData->m_vtValues)
+		for (const auto& obj : source.m_data.m_vtValues)
 		{
-			m_ptrData->m_vtValues.push_back(ValueType(obj));
+			m_data.m_vtValues.push_back(ValueType(obj));
 		}
 	}
 
 	DataNode(const char* szData)
-		: m_ptrData(make_shared<DATANODESTRUCT>())
 	{
 		size_t nKeyCount, nValueCount = 0;
 
@@ -71,66 +79,62 @@ public:
 		memcpy(&nValueCount, szData + nOffset, sizeof(size_t));
 		nOffset += sizeof(size_t);
 
-		m_ptrData->m_vtKeys.resize(nKeyCount);
-		m_ptrData->m_vtValues.resize(nValueCount);
+		m_data.reserve(std::max(nKeyCount, nValueCount));
+		m_data.m_vtKeys.resize(nKeyCount);
+		m_data.m_vtValues.resize(nValueCount);
 
 		size_t nKeysSize = nKeyCount * sizeof(KeyType);
-		memcpy(m_ptrData->m_vtKeys.data(), szData + nOffset, nKeysSize);
+		memcpy(m_data.m_vtKeys.data(), szData + nOffset, nKeysSize);
 		nOffset += nKeysSize;
 
 		size_t nValuesSize = nValueCount * sizeof(ValueType);
-		memcpy(m_ptrData->m_vtValues.data(), szData + nOffset, nValuesSize);
+		memcpy(m_data.m_vtValues.data(), szData + nOffset, nValuesSize);
 	}
 
 	DataNode(std::fstream& is)
-		: m_ptrData(make_shared<DATANODESTRUCT>())
 	{
 		size_t keyCount, valueCount;
 
 		is.read(reinterpret_cast<char*>(&keyCount), sizeof(size_t));
 		is.read(reinterpret_cast<char*>(&valueCount), sizeof(size_t));
 
-		m_ptrData->m_vtKeys.resize(keyCount);
-		m_ptrData->m_vtValues.resize(valueCount);
+		m_data.reserve(std::max(keyCount, valueCount));
+		m_data.m_vtKeys.resize(keyCount);
+		m_data.m_vtValues.resize(valueCount);
 
-		is.read(reinterpret_cast<char*>(m_ptrData->m_vtKeys.data()), keyCount * sizeof(KeyType));
-		is.read(reinterpret_cast<char*>(m_ptrData->m_vtValues.data()), valueCount * sizeof(ValueType));
+		is.read(reinterpret_cast<char*>(m_data.m_vtKeys.data()), keyCount * sizeof(KeyType));
+		is.read(reinterpret_cast<char*>(m_data.m_vtValues.data()), valueCount * sizeof(ValueType));
 	}
 
-	DataNode(KeyTypeIterator itBeginKeys, KeyTypeIterator itEndKeys, ValueTypeIterator itBeginValues, ValueTypeIterator itEndValues)
-		: m_ptrData(make_shared<DATANODESTRUCT>())
+	template <typename KeyIterator, typename ValueIterator>
+	DataNode(KeyIterator itBeginKeys, KeyIterator itEndKeys, ValueIterator itBeginValues, ValueIterator itEndValues)
 	{
-		m_ptrData->m_vtKeys.assign(itBeginKeys, itEndKeys);
-		m_ptrData->m_vtValues.assign(itBeginValues, itEndValues);
+		m_data.reserve(std::distance(itBeginKeys, itEndKeys));
+
+		m_data.m_vtKeys.assign(itBeginKeys, itEndKeys);
+		m_data.m_vtValues.assign(itBeginValues, itEndValues);
 	}
 
 	inline ErrorCode insert(const KeyType& key, const ValueType& value)
 	{
-		size_t nChildIdx = m_ptrData->m_vtKeys.size();
-		for (int nIdx = 0; nIdx < m_ptrData->m_vtKeys.size(); ++nIdx)
-		{
-			if (key < m_ptrData->m_vtKeys[nIdx])
-			{
-				nChildIdx = nIdx;
-				break;
-			}
-		}
+		m_data.reserve(m_data.m_vtKeys.size() + 1);
+
+		size_t nChildIdx = KeySearch::upperBound(m_data.m_vtKeys, key);
 
-		m_ptrData->m_vtKeys.insert(m_ptrData->m_vtKeys.begin() + nChildIdx, key);
-		m_ptrData->m_vtValues.insert(m_ptrData->m_vtValues.begin() + nChildIdx, value);
+		m_data.m_vtKeys.insert(m_data.m_vtKeys.begin() + nChildIdx, key);
+		m_data.m_vtValues.insert(m_data.m_vtValues.begin() + nChildIdx, value);
 
 		return ErrorCode::Success;
 	}
 
 	inline ErrorCode remove(const KeyType& key)
 	{
-		KeyTypeIterator it = std::lower_bound(m_ptrData->m_vtKeys.begin(), m_ptrData->m_vtKeys.end(), key);
+		size_t nIdx = KeySearch::lowerBound(m_data.m_vtKeys, key);
 
-		if (it != m_ptrData->m_vtKeys.end() && *it == key)
+		if (nIdx < m_data.m_vtKeys.size() && m_data.m_vtKeys[nIdx] == key)
 		{
-			int index = it - m_ptrData->m_vtKeys.begin();
-			m_ptrData->m_vtKeys.erase(it);
-			m_ptrData->m_vtValues.erase(m_ptrData->m_vtValues.begin() + index);
+			m_data.m_vtKeys.erase(m_data.m_vtKeys.begin() + nIdx);
+			m_data.m_vtValues.erase(m_data.m_vtValues.begin() + nIdx);
 
 			return ErrorCode::Success;
 		}
@@ -140,25 +144,34 @@ public:
 
 	inline bool requireSplit(size_t nDegree)
 	{
-		return m_ptrData->m_vtKeys.size() > nDegree;
+		return m_data.m_vtKeys.size() > nDegree;
 	}
 
 	inline bool requireMerge(size_t nDegree)
 	{
-		return m_ptrData->m_vtKeys.size() <= std::ceil(nDegree / 2.0f);
+		return m_data.m_vtKeys.size() <= std::ceil(nDegree / 2.0f);
 	}
 
 	inline size_t getKeysCount() {
-		return m_ptrData->m_vtKeys.size();
+		return m_data.m_vtKeys.size();
+	}
+
+	inline std::optional<std::pair<KeyType, ObjectUIDType>>& getRightLink()
+	{
+		return m_prRightLink;
+	}
+
+	inline uint32_t& getVersion()
+	{
+		return m_nVersion;
 	}
 
 	inline ErrorCode getValue(const KeyType& key, ValueType& value)
 	{
-		KeyTypeIterator it = std::lower_bound(m_ptrData->m_vtKeys.begin(), m_ptrData->m_vtKeys.end(), key);
-		if (it != m_ptrData->m_vtKeys.end() && *it == key)
+		size_t nIdx = KeySearch::lowerBound(m_data.m_vtKeys, key);
+		if (nIdx < m_data.m_vtKeys.size() && m_data.m_vtKeys[nIdx] == key)
 		{
-			size_t index = it - m_ptrData->m_vtKeys.begin();
-			value = m_ptrData->m_vtValues[index];
+			value = m_data.m_vtValues[nIdx];
 
 			return ErrorCode::Success;
 		}
@@ -166,70 +179,121 @@ public:
 		return ErrorCode::KeyDoesNotExist;
 	}
 
+	// Passes the entries in [keyBegin, keyEnd) to fnCallback in ascending order.
+	// Returns false once the range is exhausted or the callback asks to stop, i.e. no need to visit the next node.
+	template <typename Callback>
+	inline bool scan(const KeyType& keyBegin, const KeyType& keyEnd, Callback& fnCallback)
+	{
+		KeyTypeIterator it = std::lower_bound(m_data.m_vtKeys.begin(), m_data.m_vtKeys.end(), keyBegin);
+
+		for (size_t nIdx = it - m_data.m_vtKeys.begin(); nIdx < m_data.m_vtKeys.size(); nIdx++)
+		{
+			if (!(m_data.m_vtKeys[nIdx] < keyEnd))
+			{
+				return false;
+			}
+
+			if (!fnCallback(m_data.m_vtKeys[nIdx], m_data.m_vtValues[nIdx]))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Same as scan but in descending order, starting from the largest key below keyEnd.
+	template <typename Callback>
+	inline bool reverseScan(const KeyType& keyBegin, const KeyType& keyEnd, Callback& fnCallback)
+	{
+		KeyTypeIterator it = std::lower_bound(m_data.m_vtKeys.begin(), m_data.m_vtKeys.end(), keyEnd);
+
+		for (size_t nIdx = it - m_data.m_vtKeys.begin(); nIdx > 0; nIdx--)
+		{
+			if (m_data.m_vtKeys[nIdx - 1] < keyBegin)
+			{
+				return false;
+			}
+
+			if (!fnCallback(m_data.m_vtKeys[nIdx - 1], m_data.m_vtValues[nIdx - 1]))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
 	template <typename Cache, typename CacheKeyType>
 	inline ErrorCode split(Cache ptrCache, std::optional<CacheKeyType>& uidSibling, KeyType& pivotKeyForParent)
 	{
-		size_t nMid = m_ptrData->m_vtKeys.size() / 2;
+		size_t nMid = m_data.m_vtKeys.size() / 2;
 
 		ptrCache->template createObjectOfType<SelfType>(uidSibling,
-			m_ptrData->m_vtKeys.begin() + nMid, m_ptrData->m_vtKeys.end(),
-			m_ptrData->m_vtValues.begin() + nMid, m_ptrData->m_vtValues.end());
+			m_data.m_vtKeys.begin() + nMid, m_data.m_vtKeys.end(),
+			m_data.m_vtValues.begin() + nMid, m_data.m_vtValues.end());
 
 		if (!uidSibling)
 		{
 			return ErrorCode::Error;
 		}
 
-		pivotKeyForParent = m_ptrData->m_vtKeys[nMid];
+		pivotKeyForParent = m_data.m_vtKeys[nMid];
 
-		m_ptrData->m_vtKeys.resize(nMid);
-		m_ptrData->m_vtValues.resize(nMid);
+		m_data.m_vtKeys.resize(nMid);
+		m_data.m_vtValues.resize(nMid);
 
 		return ErrorCode::Success;
 	}
 
 	inline void moveAnEntityFromLHSSibling(std::shared_ptr<SelfType> ptrLHSSibling, KeyType& pivotKeyForParent)
 	{
-		KeyType key = ptrLHSSibling->m_ptrData->m_vtKeys.back();
-		ValueType value = ptrLHSSibling->m_ptrData->m_vtValues.back();
+		KeyType key = ptrLHSSibling->m_data.m_vtKeys.back();
+		ValueType value = ptrLHSSibling->m_data.m_vtValues.back();
 
-		ptrLHSSibling->m_ptrData->m_vtKeys.pop_back();
-		ptrLHSSibling->m_ptrData->m_vtValues.pop_back();
+		ptrLHSSibling->m_data.m_vtKeys.pop_back();
+		ptrLHSSibling->m_data.m_vtValues.pop_back();
 
-		if (ptrLHSSibling->m_ptrData->m_vtKeys.size() == 0)
+		if (ptrLHSSibling->m_data.m_vtKeys.size() == 0)
 		{
 			throw new std::exception("should not occur!");
 		}
 
-		m_ptrData->m_vtKeys.insert(m_ptrData->m_vtKeys.begin(), key);
-		m_ptrData->m_vtValues.insert(m_ptrData->m_vtValues.begin(), value);
+		m_data.reserve(m_data.m_vtKeys.size() + 1);
+
+		m_data.m_vtKeys.insert(m_data.m_vtKeys.begin(), key);
+		m_data.m_vtValues.insert(m_data.m_vtValues.begin(), value);
 
 		pivotKeyForParent = key;
 	}
 
 	inline void moveAnEntityFromRHSSibling(std::shared_ptr<SelfType> ptrRHSSibling, KeyType& pivotKeyForParent)
 	{
-		KeyType key = ptrRHSSibling->m_ptrData->m_vtKeys.front();
-		ValueType value = ptrRHSSibling->m_ptrData->m_vtValues.front();
+		KeyType key = ptrRHSSibling->m_data.m_vtKeys.front();
+		ValueType value = ptrRHSSibling->m_data.m_vtValues.front();
 
-		ptrRHSSibling->m_ptrData->m_vtKeys.erase(ptrRHSSibling->m_ptrData->m_vtKeys.begin());
-		ptrRHSSibling->m_ptrData->m_vtValues.erase(ptrRHSSibling->m_ptrData->m_vtValues.begin());
+		ptrRHSSibling->m_data.m_vtKeys.erase(ptrRHSSibling->m_data.m_vtKeys.begin());
+		ptrRHSSibling->m_data.m_vtValues.erase(ptrRHSSibling->m_data.m_vtValues.begin());
 
-		if (ptrRHSSibling->m_ptrData->m_vtKeys.size() == 0)
+		if (ptrRHSSibling->m_data.m_vtKeys.size() == 0)
 		{
 			throw new std::exception("should not occur!");
 		}
 
-		m_ptrData->m_vtKeys.push_back(key);
-		m_ptrData->m_vtValues.push_back(value);
+		m_data.reserve(m_data.m_vtKeys.size() + 1);
+
+		m_data.m_vtKeys.push_back(key);
+		m_data.m_vtValues.push_back(value);
 
-		pivotKeyForParent = ptrRHSSibling->m_ptrData->m_vtKeys.front();
+		pivotKeyForParent = ptrRHSSibling->m_data.m_vtKeys.front();
 	}
 
 	inline void mergeNode(std::shared_ptr<SelfType> ptrSibling)
 	{
-		m_ptrData->m_vtKeys.insert(m_ptrData->m_vtKeys.end(), ptrSibling->m_ptrData->m_vtKeys.begin(), ptrSibling->m_ptrData->m_vtKeys.end());
-		m_ptrData->m_vtValues.insert(m_ptrData->m_vtValues.end(), ptrSibling->m_ptrData->m_vtValues.begin(), ptrSibling->m_ptrData->m_vtValues.end());
+		m_data.reserve(m_data.m_vtKeys.size() + ptrSibling->m_data.m_vtKeys.size());
+
+		m_data.m_vtKeys.insert(m_data.m_vtKeys.end(), ptrSibling->m_data.m_vtKeys.begin(), ptrSibling->m_data.m_vtKeys.end());
+		m_data.m_vtValues.insert(m_data.m_vtValues.end(), ptrSibling->m_data.m_vtValues.begin(), ptrSibling->m_data.m_vtValues.end());
 	}
 
 public:
@@ -239,8 +303,8 @@ public:
 			sizeof(uint8_t)
 			+ sizeof(size_t)
 			+ sizeof(size_t)
-			+ (m_ptrData->m_vtKeys.size() * sizeof(KeyType))
-			+ (m_ptrData->m_vtValues.size() * sizeof(ObjectUIDType::NodeUID));
+			+ (m_data.m_vtKeys.size() * sizeof(KeyType))
+			+ (m_data.m_vtValues.size() * sizeof(ValueType));
 	}
 
 	inline void serialize(char*& szBuffer, uint8_t& uidObjectType, size_t& nBufferSize)
@@ -254,8 +318,8 @@ public:
 
 		uidObjectType = UID;
 
-		size_t nKeyCount = m_ptrData->m_vtKeys.size();
-		size_t nValueCount = m_ptrData->m_vtValues.size();
+		size_t nKeyCount = m_data.m_vtKeys.size();
+		size_t nValueCount = m_data.m_vtValues.size();
 
 		nBufferSize = sizeof(uint8_t) + (nKeyCount * sizeof(KeyType)) + (nValueCount * sizeof(ValueType)) + sizeof(size_t) + sizeof(size_t);
 
@@ -273,32 +337,32 @@ public:
 		nOffset += sizeof(size_t);
 
 		size_t nKeysSize = nKeyCount * sizeof(KeyType);
-		memcpy(szBuffer + nOffset, m_ptrData->m_vtKeys.data(), nKeysSize);
+		memcpy(szBuffer + nOffset, m_data.m_vtKeys.data(), nKeysSize);
 		nOffset += nKeysSize;
 
 		size_t nValuesSize = nValueCount * sizeof(ValueType);
-		memcpy(szBuffer + nOffset, m_ptrData->m_vtValues.data(), nValuesSize);
+		memcpy(szBuffer + nOffset, m_data.m_vtValues.data(), nValuesSize);
 		nOffset += nValuesSize;
 
 		assert(nBufferSize == nOffset);
 
 		SelfType* _t = new SelfType(szBuffer);
-		for (int i = 0; i < _t->m_ptrData->m_vtKeys.size(); i++)
+		for (int i = 0; i < _t->m_data.m_vtKeys.size(); i++)
 		{
-			assert(_t->m_ptrData->m_vtKeys[i] == m_ptrData->m_vtKeys[i]);
+			assert(_t->m_data.m_vtKeys[i] == m_data.m_vtKeys[i]);
 		}
-		for (int i = 0; i < _t->m_ptrData->m_vtValues.size(); i++)
+		for (int i = 0; i < _t->m_data.m_vtValues.size(); i++)
 		{
-			assert(_t->m_ptrData->m_vtValues[i] == m_ptrData->m_vtValues[i]);
+			assert(_t->m_data.m_vtValues[i] == m_data.m_vtValues[i]);
 		}
 		delete _t;
 
 		// hint
 		/*
 		if (std::is_trivial<ObjectUIDType>::value && std::is_standard_layout<ObjectUIDType>::value)
-		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::NodeUID));
+		os.write(reinterpret_cast<const char*>(m_data.m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::NodeUID));
 		else
-		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::PODType));
+		os.write(reinterpret_cast<const char*>(m_data.m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::PODType));
 
 		*/
 	}
@@ -314,16 +378,16 @@ public:
 
 		uidObjectType = UID;
 
-		size_t nKeyCount = m_ptrData->m_vtKeys.size();
-		size_t nValueCount = m_ptrData->m_vtValues.size();
+		size_t nKeyCount = m_data.m_vtKeys.size();
+		size_t nValueCount = m_data.m_vtValues.size();
 
 		nDataSize = sizeof(uint8_t) + (nKeyCount * sizeof(KeyType)) + (nValueCount * sizeof(ValueType)) + sizeof(size_t) + sizeof(size_t);
 
 		os.write(reinterpret_cast<const char*>(&UID), sizeof(uint8_t));
 		os.write(reinterpret_cast<const char*>(&nKeyCount), sizeof(size_t));
 		os.write(reinterpret_cast<const char*>(&nValueCount), sizeof(size_t));
-		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtKeys.data()), nKeyCount * sizeof(KeyType));
-		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtValues.data()), nValueCount * sizeof(ValueType));
+		os.write(reinterpret_cast<const char*>(m_data.m_vtKeys.data()), nKeyCount * sizeof(KeyType));
+		os.write(reinterpret_cast<const char*>(m_data.m_vtValues.data()), nValueCount * sizeof(ValueType));
 	}
 
 public:
@@ -334,9 +398,9 @@ public:
 		prefix.append(std::string(nSpace - 1, ' '));
 		prefix.append("|");
 
-		for (size_t nIndex = 0; nIndex < m_ptrData->m_vtKeys.size(); nIndex++)
+		for (size_t nIndex = 0; nIndex < m_data.m_vtKeys.size(); nIndex++)
 		{
-			out << " " << prefix << std::string(nSpace, '-').c_str() << "(K: " << m_ptrData->m_vtKeys[nIndex] << ", V: " << m_ptrData->m_vtValues[nIndex] << ")" << std::endl;
+			out << " " << prefix << std::string(nSpace, '-').c_str() << "(K: " << m_data.m_vtKeys[nIndex] << ", V: " << m_data.m_vtValues[nIndex] << ")" << std::endl;
 		}
 	}
 
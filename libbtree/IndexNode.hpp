@@ -8,14 +8,25 @@
 #include <iostream>
 #include <cmath>
 #include <optional>
+#include <atomic>
+#include <algorithm>
 
 #include <iostream>
 #include <fstream>
 #include <assert.h>
 
 #include "ErrorCodes.h"
+#include "KeySearch.hpp"
+#include "NodeBlock.hpp"
 
 //#define __TREE_AWARE_CACHE__
+#define __EYTZINGER_LAYOUT__
+
+#ifdef __EYTZINGER_LAYOUT__
+// A node gets the Eytzinger layout once it has this many pivots and has served this many lookups since it was last modified.
+#define EYTZINGER_MIN_PIVOTS 128
+#define EYTZINGER_BUILD_AFTER_LOOKUPS 64
+#endif __EYTZINGER_LAYOUT__
 
 using namespace std;
 
@@ -28,46 +39,68 @@ public:
 private:
 	typedef IndexNode<KeyType, ValueType, ObjectUIDType, UID> SelfType;
 
-	typedef std::vector<KeyType>::const_iterator KeyTypeIterator;
-	typedef std::vector<ObjectUIDType>::const_iterator CacheKeyTypeIterator;
-
 public:
-	struct INDEXNODESTRUCT
+	// The pivots and the children share one cache-line-aligned allocation, see NodeBlock.
+	struct INDEXNODESTRUCT : public NodeBlock
 	{
-		std::vector<KeyType> m_vtPivots;
-		std::vector<ObjectUIDType> m_vtChildren;
+		NodeArray<KeyType> m_vtPivots;
+		NodeArray<ObjectUIDType> m_vtChildren;
+
+		inline void reserve(size_t nCapacity)
+		{
+			NodeBlock::reserve(nCapacity, m_vtPivots, m_vtChildren);
+		}
 	};
 
-	std::shared_ptr<INDEXNODESTRUCT> m_ptrData;
+	INDEXNODESTRUCT m_data;
 
-public:
-	~IndexNode()
+private:
+	// B-link: the high key and the right sibling, set when the node is split and cleared once the parent refers to the
+	// sibling. It is not serialized as it does not outlive the insert that split the node.
+	std::optional<std::pair<KeyType, ObjectUIDType>> m_prRightLink;
+
+	// B-link: bumped whenever the node is split, in memory only as well.
+	uint32_t m_nVersion = 0;
+
+#ifdef __EYTZINGER_LAYOUT__
+	enum LayoutState : uint8_t
 	{
-		// TODO: check for ref count?
-		m_ptrData.reset();
-	}
+		NoLayout = 0,
+		BuildingLayout,
+		LayoutReady
+	};
+
+	// A copy of the pivots in Eytzinger order (see KeySearch::buildEytzinger), in memory only. It is built by a lookup
+	// once the node looks read-mostly and dropped by the next modification. Lookups hold the node's lock shared, so
+	// the one that moves m_nLayoutState to BuildingLayout builds it while the others keep using the sorted pivots,
+	// modifications hold the lock exclusively.
+	std::vector<KeyType> m_vtEytzinger;
+	std::vector<size_t> m_vtEytzingerRanks;
+	std::atomic<uint8_t> m_nLayoutState = NoLayout;
+	std::atomic<uint32_t> m_nLookups = 0;
+#endif __EYTZINGER_LAYOUT__
 
+public:
 	IndexNode()
-		: m_ptrData(make_shared<INDEXNODESTRUCT>())
 	{	
 	}
 
 	IndexNode(const IndexNode& source)
-		: m_ptrData(make_shared<INDEXNODESTRUCT>())
 	{
-		for (const auto& obj : source.m_ptrData->m_vtPivots)
+		m_data.reserve(source.m_data.capacity());
+
+		for (const auto& obj : source.m_data.m_vtPivots)
 		{
-			m_ptrData->m_vtPivots.push_back(KeyType(obj));
+			m_data.m_vtPivots.push_back(KeyType(obj));
 		}
 
-		for (const auto& obj : source.m_ptrData->m_vtChildren)
+		for (const auto& obj : source.m_data.m_vtChildren)
 		{
-			m_ptrData->m_vtChildren.push_back(ObjectUIDType(obj));
+			m_data.m_vtChildren.push_back(ObjectUIDType(obj));
 		}
 	}
 
 	IndexNode(const char* szData)
-		: m_ptrData(make_shared<INDEXNODESTRUCT>())
 	{
 		size_t nKeyCount, nValueCount = 0;
 
@@ -79,60 +112,60 @@ public:
 		memcpy(&nValueCount, szData + nOffset, sizeof(size_t));
 		nOffset += sizeof(size_t);
 
-		m_ptrData->m_vtPivots.resize(nKeyCount);
-		m_ptrData->m_vtChildren.resize(nValueCount);
+		m_data.reserve(std::max(nKeyCount, nValueCount));
+		m_data.m_vtPivots.resize(nKeyCount);
+		m_data.m_vtChildren.resize(nValueCount);
 
 		size_t nKeysSize = nKeyCount * sizeof(KeyType);
-		memcpy(m_ptrData->m_vtPivots.data(), szData + nOffset, nKeysSize);
+		memcpy(m_data.m_vtPivots.data(), szData + nOffset, nKeysSize);
 		nOffset += nKeysSize;
 
 		size_t nValuesSize = nValueCount * sizeof(ObjectUIDType::NodeUID);
-		memcpy(m_ptrData->m_vtChildren.data(), szData + nOffset, nValuesSize);
+		memcpy(m_data.m_vtChildren.data(), szData + nOffset, nValuesSize);
 	}
 
 	IndexNode(std::fstream& is)
-		: m_ptrData(make_shared<INDEXNODESTRUCT>())
 	{
 		size_t nKeyCount, nValueCount;
 		is.read(reinterpret_cast<char*>(&nKeyCount), sizeof(size_t));
 		is.read(reinterpret_cast<char*>(&nValueCount), sizeof(size_t));
 
-		m_ptrData->m_vtPivots.resize(nKeyCount);
-		m_ptrData->m_vtChildren.resize(nValueCount);
+		m_data.reserve(std::max(nKeyCount, nValueCount));
+		m_data.m_vtPivots.resize(nKeyCount);
+		m_data.m_vtChildren.resize(nValueCount);
 
-		is.read(reinterpret_cast<char*>(m_ptrData->m_vtPivots.data()), nKeyCount * sizeof(KeyType));
-		is.read(reinterpret_cast<char*>(m_ptrData->m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::NodeUID));
+		is.read(reinterpret_cast<char*>(m_data.m_vtPivots.data()), nKeyCount * sizeof(KeyType));
+		is.read(reinterpret_cast<char*>(m_data.m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::NodeUID));
 	}
 
-	IndexNode(KeyTypeIterator itBeginPivots, KeyTypeIterator itEndPivots, CacheKeyTypeIterator itBeginChildren, CacheKeyTypeIterator itEndChildren)
-		: m_ptrData(make_shared<INDEXNODESTRUCT>())
+	template <typename KeyIterator, typename ChildIterator>
+	IndexNode(KeyIterator itBeginPivots, KeyIterator itEndPivots, ChildIterator itBeginChildren, ChildIterator itEndChildren)
 	{
-		m_ptrData->m_vtPivots.assign(itBeginPivots, itEndPivots);
-		m_ptrData->m_vtChildren.assign(itBeginChildren, itEndChildren);
+		m_data.reserve(std::distance(itBeginChildren, itEndChildren));
+
+		m_data.m_vtPivots.assign(itBeginPivots, itEndPivots);
+		m_data.m_vtChildren.assign(itBeginChildren, itEndChildren);
 	}
 
 	IndexNode(const KeyType& pivotKey, const ObjectUIDType& ptrLHSNode, const ObjectUIDType& ptrRHSNode)
-		: m_ptrData(make_shared<INDEXNODESTRUCT>())
 	{
-		m_ptrData->m_vtPivots.push_back(pivotKey);
-		m_ptrData->m_vtChildren.push_back(ptrLHSNode);
-		m_ptrData->m_vtChildren.push_back(ptrRHSNode);
+		m_data.reserve(2);
+
+		m_data.m_vtPivots.push_back(pivotKey);
+		m_data.m_vtChildren.push_back(ptrLHSNode);
+		m_data.m_vtChildren.push_back(ptrRHSNode);
 	}
 
 	inline ErrorCode insert(const KeyType& pivotKey, const ObjectUIDType& uidSibling)
 	{
-		size_t nChildIdx = m_ptrData->m_vtPivots.size();
-		for (int nIdx = 0; nIdx < m_ptrData->m_vtPivots.size(); ++nIdx)
-		{
-			if (pivotKey < m_ptrData->m_vtPivots[nIdx])
-			{
-				nChildIdx = nIdx;
-				break;
-			}
-		}
+		invalidateLayout();
+
+		m_data.reserve(m_data.m_vtChildren.size() + 1);
 
-		m_ptrData->m_vtPivots.insert(m_ptrData->m_vtPivots.begin() + nChildIdx, pivotKey);
-		m_ptrData->m_vtChildren.insert(m_ptrData->m_vtChildren.begin() + nChildIdx + 1, uidSibling);
+		size_t nChildIdx = KeySearch::upperBound(m_data.m_vtPivots, pivotKey);
+
+		m_data.m_vtPivots.insert(m_data.m_vtPivots.begin() + nChildIdx, pivotKey);
+		m_data.m_vtChildren.insert(m_data.m_vtChildren.begin() + nChildIdx + 1, uidSibling);
 
 		return ErrorCode::Success;
 	}
@@ -140,87 +173,89 @@ public:
 	template <typename CacheType, typename ObjectCoreType>
 	inline ErrorCode rebalanceIndexNode(CacheType ptrCache, const ObjectUIDType& uidChild, ObjectCoreType ptrChild, const KeyType& key, size_t nDegree, std::optional<ObjectUIDType>& uidObjectToDelete)
 	{
+		invalidateLayout();
+
 		ObjectCoreType ptrLHSNode = nullptr;
 		ObjectCoreType ptrRHSNode = nullptr;
 
-		size_t nChildIdx = getChildNodeIdx(key);
+		size_t nChildIdx = KeySearch::upperBound(m_data.m_vtPivots, key);
 
 		if (nChildIdx > 0)
 		{
 #ifdef __TREE_AWARE_CACHE__
 			std::optional<ObjectUIDType> uidUpdated = std::nullopt;
-			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx - 1], ptrLHSNode, uidUpdated);    //TODO: lock
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_data.m_vtChildren[nChildIdx - 1], ptrLHSNode, uidUpdated);    //TODO: lock
 
 			if (uidUpdated != std::nullopt)
 			{
-				m_ptrData->m_vtChildren[nChildIdx - 1] = *uidUpdated;
+				m_data.m_vtChildren[nChildIdx - 1] = *uidUpdated;
 			}
 #else __TREE_AWARE_CACHE__
-			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx - 1], ptrLHSNode);    //TODO: lock
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_data.m_vtChildren[nChildIdx - 1], ptrLHSNode);    //TODO: lock
 #endif __TREE_AWARE_CACHE__
 
 			if (ptrLHSNode->getKeysCount() > std::ceil(nDegree / 2.0f))	// TODO: macro?
 			{
 				KeyType key;
-				ptrChild->moveAnEntityFromLHSSibling(ptrLHSNode, m_ptrData->m_vtPivots[nChildIdx - 1], key);
+				ptrChild->moveAnEntityFromLHSSibling(ptrLHSNode, m_data.m_vtPivots[nChildIdx - 1], key);
 
-				m_ptrData->m_vtPivots[nChildIdx - 1] = key;
+				m_data.m_vtPivots[nChildIdx - 1] = key;
 				return ErrorCode::Success;
 			}
 		}
 
-		if (nChildIdx < m_ptrData->m_vtPivots.size())
+		if (nChildIdx < m_data.m_vtPivots.size())
 		{
 #ifdef __TREE_AWARE_CACHE__
 			std::optional<ObjectUIDType> uidUpdated = std::nullopt;
-			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx + 1], ptrRHSNode, uidUpdated);    //TODO: lock
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_data.m_vtChildren[nChildIdx + 1], ptrRHSNode, uidUpdated);    //TODO: lock
 
 			if (uidUpdated != std::nullopt)
 			{
-				m_ptrData->m_vtChildren[nChildIdx + 1] = *uidUpdated;
+				m_data.m_vtChildren[nChildIdx + 1] = *uidUpdated;
 			}
 #else __TREE_AWARE_CACHE__
-			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx + 1], ptrRHSNode);    //TODO: lock
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_data.m_vtChildren[nChildIdx + 1], ptrRHSNode);    //TODO: lock
 #endif __TREE_AWARE_CACHE__
 
 			if (ptrRHSNode->getKeysCount() > std::ceil(nDegree / 2.0f))
 			{
 				KeyType key;
-				ptrChild->moveAnEntityFromRHSSibling(ptrRHSNode, m_ptrData->m_vtPivots[nChildIdx], key);
+				ptrChild->moveAnEntityFromRHSSibling(ptrRHSNode, m_data.m_vtPivots[nChildIdx], key);
 
-				m_ptrData->m_vtPivots[nChildIdx] = key;
+				m_data.m_vtPivots[nChildIdx] = key;
 				return ErrorCode::Success;
 			}
 		}
 
 		if (nChildIdx > 0)
 		{
-			ptrLHSNode->mergeNodes(ptrChild, m_ptrData->m_vtPivots[nChildIdx - 1]);
+			ptrLHSNode->mergeNodes(ptrChild, m_data.m_vtPivots[nChildIdx - 1]);
 
-			uidObjectToDelete = m_ptrData->m_vtChildren[nChildIdx];
+			uidObjectToDelete = m_data.m_vtChildren[nChildIdx];
 			if (uidObjectToDelete != uidChild)
 			{
 				throw new std::exception("should not occur!");
 			}
 
-			m_ptrData->m_vtPivots.erase(m_ptrData->m_vtPivots.begin() + nChildIdx - 1);
-			m_ptrData->m_vtChildren.erase(m_ptrData->m_vtChildren.begin() + nChildIdx);
+			m_data.m_vtPivots.erase(m_data.m_vtPivots.begin() + nChildIdx - 1);
+			m_data.m_vtChildren.erase(m_data.m_vtChildren.begin() + nChildIdx);
 
 			//uidObjectToDelete = uidChild;
 
 			return ErrorCode::Success;
 		}
 
-		if (nChildIdx < m_ptrData->m_vtPivots.size())
+		if (nChildIdx < m_data.m_vtPivots.size())
 		{
-			ptrChild->mergeNodes(ptrRHSNode, m_ptrData->m_vtPivots[nChildIdx]);
+			ptrChild->mergeNodes(ptrRHSNode, m_data.m_vtPivots[nChildIdx]);
 
-			assert(uidChild == m_ptrData->m_vtChildren[nChildIdx]);
+			assert(uidChild == m_data.m_vtChildren[nChildIdx]);
 
-			uidObjectToDelete = m_ptrData->m_vtChildren[nChildIdx + 1];
+			uidObjectToDelete = m_data.m_vtChildren[nChildIdx + 1];
 
-			m_ptrData->m_vtPivots.erase(m_ptrData->m_vtPivots.begin() + nChildIdx);
-			m_ptrData->m_vtChildren.erase(m_ptrData->m_vtChildren.begin() + nChildIdx + 1);
+			m_data.m_vtPivots.erase(m_data.m_vtPivots.begin() + nChildIdx);
+			m_data.m_vtChildren.erase(m_data.m_vtChildren.begin() + nChildIdx + 1);
 
 			return ErrorCode::Success;
 		}
@@ -231,23 +266,25 @@ public:
 	template <typename CacheType, typename ObjectCoreType>
 	inline ErrorCode rebalanceDataNode(CacheType ptrCache, const ObjectUIDType& uidChild, ObjectCoreType ptrChild, const KeyType& key, size_t nDegree, std::optional<ObjectUIDType>& uidObjectToDelete)
 	{
+		invalidateLayout();
+
 		ObjectCoreType ptrLHSNode = nullptr;
 		ObjectCoreType ptrRHSNode = nullptr;
 
-		size_t nChildIdx = getChildNodeIdx(key);
+		size_t nChildIdx = KeySearch::upperBound(m_data.m_vtPivots, key);
 
 		if (nChildIdx > 0)
 		{
 #ifdef __TREE_AWARE_CACHE__
 			std::optional<ObjectUIDType> uidUpdated = std::nullopt;
-			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx - 1], ptrLHSNode, uidUpdated);    //TODO: lock
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_data.m_vtChildren[nChildIdx - 1], ptrLHSNode, uidUpdated);    //TODO: lock
 
 			if (uidUpdated != std::nullopt)
 			{
-				m_ptrData->m_vtChildren[nChildIdx - 1] = *uidUpdated;
+				m_data.m_vtChildren[nChildIdx - 1] = *uidUpdated;
 			}
 #else __TREE_AWARE_CACHE__
-			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx - 1], ptrLHSNode);    //TODO: lock
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_data.m_vtChildren[nChildIdx - 1], ptrLHSNode);    //TODO: lock
 #endif __TREE_AWARE_CACHE__
 
 			if (ptrLHSNode->getKeysCount() > std::ceil(nDegree / 2.0f))
@@ -255,23 +292,23 @@ public:
 				KeyType key;
 				ptrChild->moveAnEntityFromLHSSibling(ptrLHSNode, key);
 
-				m_ptrData->m_vtPivots[nChildIdx - 1] = key;
+				m_data.m_vtPivots[nChildIdx - 1] = key;
 				return ErrorCode::Success;
 			}
 		}
 
-		if (nChildIdx < m_ptrData->m_vtPivots.size())
+		if (nChildIdx < m_data.m_vtPivots.size())
 		{
 #ifdef __TREE_AWARE_CACHE__
 			std::optional<ObjectUIDType> uidUpdated = std::nullopt;
-			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx + 1], ptrRHSNode, uidUpdated);    //TODO: lock
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_data.m_vtChildren[nChildIdx + 1], ptrRHSNode, uidUpdated);    //TODO: lock
 
 			if (uidUpdated != std::nullopt)
 			{
-				m_ptrData->m_vtChildren[nChildIdx + 1] = *uidUpdated;
+				m_data.m_vtChildren[nChildIdx + 1] = *uidUpdated;
 			}
 #else __TREE_AWARE_CACHE__
-			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx + 1], ptrRHSNode);    //TODO: lock
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_data.m_vtChildren[nChildIdx + 1], ptrRHSNode);    //TODO: lock
 #endif __TREE_AWARE_CACHE__
 
 
@@ -280,7 +317,7 @@ public:
 				KeyType key;
 				ptrChild->moveAnEntityFromRHSSibling(ptrRHSNode, key);
 
-				m_ptrData->m_vtPivots[nChildIdx] = key;
+				m_data.m_vtPivots[nChildIdx] = key;
 				return ErrorCode::Success;
 			}
 		}
@@ -289,28 +326,28 @@ public:
 		{
 			ptrLHSNode->mergeNode(ptrChild);
 
-			uidObjectToDelete = m_ptrData->m_vtChildren[nChildIdx];
+			uidObjectToDelete = m_data.m_vtChildren[nChildIdx];
 			if (uidObjectToDelete != uidChild)
 			{
 				throw new std::exception("should not occur!");
 			}
 
-			m_ptrData->m_vtPivots.erase(m_ptrData->m_vtPivots.begin() + nChildIdx - 1);
-			m_ptrData->m_vtChildren.erase(m_ptrData->m_vtChildren.begin() + nChildIdx);
+			m_data.m_vtPivots.erase(m_data.m_vtPivots.begin() + nChildIdx - 1);
+			m_data.m_vtChildren.erase(m_data.m_vtChildren.begin() + nChildIdx);
 
 			//uidObjectToDelete = uidChild;
 
 			return ErrorCode::Success;
 		}
 
-		if (nChildIdx < m_ptrData->m_vtPivots.size())
+		if (nChildIdx < m_data.m_vtPivots.size())
 		{
 			ptrChild->mergeNode(ptrRHSNode);
 
-			uidObjectToDelete = m_ptrData->m_vtChildren[nChildIdx + 1];
+			uidObjectToDelete = m_data.m_vtChildren[nChildIdx + 1];
 
-			m_ptrData->m_vtPivots.erase(m_ptrData->m_vtPivots.begin() + nChildIdx);
-			m_ptrData->m_vtChildren.erase(m_ptrData->m_vtChildren.begin() + nChildIdx + 1);
+			m_data.m_vtPivots.erase(m_data.m_vtPivots.begin() + nChildIdx);
+			m_data.m_vtChildren.erase(m_data.m_vtChildren.begin() + nChildIdx + 1);
 
 			return ErrorCode::Success;
 		}
@@ -320,116 +357,184 @@ public:
 
 	inline size_t getKeysCount() 
 	{
-		return m_ptrData->m_vtPivots.size();
+		return m_data.m_vtPivots.size();
+	}
+
+	inline std::optional<std::pair<KeyType, ObjectUIDType>>& getRightLink()
+	{
+		return m_prRightLink;
+	}
+
+	inline uint32_t& getVersion()
+	{
+		return m_nVersion;
 	}
 
 	inline size_t getChildNodeIdx(const KeyType& key)
 	{
-		size_t nChildIdx = 0;
-		while (nChildIdx < m_ptrData->m_vtPivots.size() && key >= m_ptrData->m_vtPivots[nChildIdx])
+#ifdef __EYTZINGER_LAYOUT__
+		uint8_t nState = m_nLayoutState.load(std::memory_order_acquire);
+		if (nState == LayoutReady)
 		{
-			nChildIdx++;
+			return KeySearch::upperBoundEytzinger(m_vtEytzinger, m_vtEytzingerRanks, key);
 		}
 
-		return nChildIdx;
+		if (nState == NoLayout && m_data.m_vtPivots.size() >= EYTZINGER_MIN_PIVOTS)
+		{
+			// Not an atomic increment, concurrent lookups would all write the same cache line; a lost count only delays the build.
+			uint32_t nLookups = m_nLookups.load(std::memory_order_relaxed) + 1;
+			m_nLookups.store(nLookups, std::memory_order_relaxed);
+
+			if (nLookups >= EYTZINGER_BUILD_AFTER_LOOKUPS && m_nLayoutState.compare_exchange_strong(nState, BuildingLayout))
+			{
+				KeySearch::buildEytzinger(m_data.m_vtPivots, m_vtEytzinger, m_vtEytzingerRanks);
+				m_nLayoutState.store(LayoutReady, std::memory_order_release);
+			}
+		}
+#endif __EYTZINGER_LAYOUT__
+
+		return KeySearch::upperBound(m_data.m_vtPivots, key);
 	}
 
 	inline ObjectUIDType getChildAt(size_t nIdx) 
 	{
-		return m_ptrData->m_vtChildren[nIdx];
+		return m_data.m_vtChildren[nIdx];
 	}
 
 	inline ObjectUIDType getChild(const KeyType& key)
 	{
-		return m_ptrData->m_vtChildren[getChildNodeIdx(key)];
+		return m_data.m_vtChildren[getChildNodeIdx(key)];
+	}
+
+	inline size_t getChildrenCount()
+	{
+		return m_data.m_vtChildren.size();
+	}
+
+	inline const KeyType& getPivotAt(size_t nIdx)
+	{
+		return m_data.m_vtPivots[nIdx];
 	}
 
 	inline bool requireSplit(size_t nDegree)
 	{
-		return m_ptrData->m_vtPivots.size() > nDegree;
+		return m_data.m_vtPivots.size() > nDegree;
 	}
 
 	inline bool canTriggerSplit(size_t nDegree)
 	{
-		return m_ptrData->m_vtPivots.size() + 1 > nDegree;
+		return m_data.m_vtPivots.size() + 1 > nDegree;
 	}
 
 	inline bool canTriggerMerge(size_t nDegree)
 	{
-		return m_ptrData->m_vtPivots.size() <= std::ceil(nDegree / 2.0f) + 1;	// TODO: macro!
+		return m_data.m_vtPivots.size() <= std::ceil(nDegree / 2.0f) + 1;	// TODO: macro!
 
 	}
 
 	inline bool requireMerge(size_t nDegree)
 	{
-		return m_ptrData->m_vtPivots.size() <= std::ceil(nDegree / 2.0f);
+		return m_data.m_vtPivots.size() <= std::ceil(nDegree / 2.0f);
 	}
 
 	template <typename Cache>
 	inline ErrorCode split(Cache ptrCache, std::optional<ObjectUIDType>& uidSibling, KeyType& pivotKeyForParent)
 	{
-		size_t nMid = m_ptrData->m_vtPivots.size() / 2;
+		invalidateLayout();
+
+		size_t nMid = m_data.m_vtPivots.size() / 2;
 
 		ptrCache->template createObjectOfType<SelfType>(uidSibling,
-			m_ptrData->m_vtPivots.begin() + nMid + 1, m_ptrData->m_vtPivots.end(),
-			m_ptrData->m_vtChildren.begin() + nMid + 1, m_ptrData->m_vtChildren.end());
+			m_data.m_vtPivots.begin() + nMid + 1, m_data.m_vtPivots.end(),
+			m_data.m_vtChildren.begin() + nMid + 1, m_data.m_vtChildren.end());
 
 		if (!uidSibling)
 		{
 			return ErrorCode::Error;
 		}
 
-		pivotKeyForParent = m_ptrData->m_vtPivots[nMid];
+		pivotKeyForParent = m_data.m_vtPivots[nMid];
 
-		m_ptrData->m_vtPivots.resize(nMid);
-		m_ptrData->m_vtChildren.resize(nMid + 1);
+		m_data.m_vtPivots.resize(nMid);
+		m_data.m_vtChildren.resize(nMid + 1);
 
 		return ErrorCode::Success;
 	}
 
 	inline void moveAnEntityFromLHSSibling(shared_ptr<SelfType> ptrLHSSibling, KeyType& pivotKeyForEntity, KeyType& pivotKeyForParent)
 	{
-		KeyType key = ptrLHSSibling->m_ptrData->m_vtPivots.back();
-		ObjectUIDType value = ptrLHSSibling->m_ptrData->m_vtChildren.back();
+		invalidateLayout();
+		ptrLHSSibling->invalidateLayout();
+
+		KeyType key = ptrLHSSibling->m_data.m_vtPivots.back();
+		ObjectUIDType value = ptrLHSSibling->m_data.m_vtChildren.back();
 
-		ptrLHSSibling->m_ptrData->m_vtPivots.pop_back();
-		ptrLHSSibling->m_ptrData->m_vtChildren.pop_back();
+		ptrLHSSibling->m_data.m_vtPivots.pop_back();
+		ptrLHSSibling->m_data.m_vtChildren.pop_back();
 
-		if (ptrLHSSibling->m_ptrData->m_vtPivots.size() == 0)
+		if (ptrLHSSibling->m_data.m_vtPivots.size() == 0)
 		{
 			throw new std::exception("should not occur!");
 		}
 
-		m_ptrData->m_vtPivots.insert(m_ptrData->m_vtPivots.begin(), pivotKeyForEntity);
-		m_ptrData->m_vtChildren.insert(m_ptrData->m_vtChildren.begin(), value);
+		m_data.reserve(m_data.m_vtChildren.size() + 1);
+
+		m_data.m_vtPivots.insert(m_data.m_vtPivots.begin(), pivotKeyForEntity);
+		m_data.m_vtChildren.insert(m_data.m_vtChildren.begin(), value);
 
 		pivotKeyForParent = key;
 	}
 
 	inline void moveAnEntityFromRHSSibling(shared_ptr<SelfType> ptrRHSSibling, KeyType& pivotKeyForEntity, KeyType& pivotKeyForParent)
 	{
-		KeyType key = ptrRHSSibling->m_ptrData->m_vtPivots.front();
-		ObjectUIDType value = ptrRHSSibling->m_ptrData->m_vtChildren.front();
+		invalidateLayout();
+		ptrRHSSibling->invalidateLayout();
 
-		ptrRHSSibling->m_ptrData->m_vtPivots.erase(ptrRHSSibling->m_ptrData->m_vtPivots.begin());
-		ptrRHSSibling->m_ptrData->m_vtChildren.erase(ptrRHSSibling->m_ptrData->m_vtChildren.begin());
+		KeyType key = ptrRHSSibling->m_data.m_vtPivots.front();
+		ObjectUIDType value = ptrRHSSibling->m_data.m_vtChildren.front();
 
-		if (ptrRHSSibling->m_ptrData->m_vtPivots.size() == 0)
+		ptrRHSSibling->m_data.m_vtPivots.erase(ptrRHSSibling->m_data.m_vtPivots.begin());
+		ptrRHSSibling->m_data.m_vtChildren.erase(ptrRHSSibling->m_data.m_vtChildren.begin());
+
+		if (ptrRHSSibling->m_data.m_vtPivots.size() == 0)
 		{
 			throw new std::exception("should not occur!");
 		}
 
-		m_ptrData->m_vtPivots.push_back(pivotKeyForEntity);
-		m_ptrData->m_vtChildren.push_back(value);
+		m_data.reserve(m_data.m_vtChildren.size() + 1);
+
+		m_data.m_vtPivots.push_back(pivotKeyForEntity);
+		m_data.m_vtChildren.push_back(value);
 
-		pivotKeyForParent = key;// ptrRHSSibling->m_ptrData->m_vtPivots.front();
+		pivotKeyForParent = key;// ptrRHSSibling->m_data.m_vtPivots.front();
 	}
 
 	inline void mergeNodes(shared_ptr<SelfType> ptrSibling, KeyType& pivotKey)
 	{
-		m_ptrData->m_vtPivots.push_back(pivotKey);
-		m_ptrData->m_vtPivots.insert(m_ptrData->m_vtPivots.end(), ptrSibling->m_ptrData->m_vtPivots.begin(), ptrSibling->m_ptrData->m_vtPivots.end());
-		m_ptrData->m_vtChildren.insert(m_ptrData->m_vtChildren.end(), ptrSibling->m_ptrData->m_vtChildren.begin(), ptrSibling->m_ptrData->m_vtChildren.end());
+		invalidateLayout();
+
+		m_data.reserve(m_data.m_vtChildren.size() + ptrSibling->m_data.m_vtChildren.size());
+
+		m_data.m_vtPivots.push_back(pivotKey);
+		m_data.m_vtPivots.insert(m_data.m_vtPivots.end(), ptrSibling->m_data.m_vtPivots.begin(), ptrSibling->m_data.m_vtPivots.end());
+		m_data.m_vtChildren.insert(m_data.m_vtChildren.end(), ptrSibling->m_data.m_vtChildren.begin(), ptrSibling->m_data.m_vtChildren.end());
+	}
+
+private:
+	// Called first by every method that changes the pivots, these search m_vtPivots directly rather than through
+	// getChildNodeIdx so that the layout is not rebuilt halfway through the change. The node's lock is held exclusively.
+	inline void invalidateLayout()
+	{
+#ifdef __EYTZINGER_LAYOUT__
+		if (m_nLayoutState.load(std::memory_order_relaxed) != NoLayout)
+		{
+			m_vtEytzinger.clear();
+			m_vtEytzingerRanks.clear();
+			m_nLayoutState.store(NoLayout, std::memory_order_relaxed);
+		}
+
+		m_nLookups.store(0, std::memory_order_relaxed);
+#endif __EYTZINGER_LAYOUT__
 	}
 
 public:
@@ -444,20 +549,20 @@ public:
 
 		uidObjectType = UID;
 
-		size_t nKeyCount = m_ptrData->m_vtPivots.size();
-		size_t nValueCount = m_ptrData->m_vtChildren.size();
+		size_t nKeyCount = m_data.m_vtPivots.size();
+		size_t nValueCount = m_data.m_vtChildren.size();
 
 		nDataSize = sizeof(uint8_t) + (nKeyCount * sizeof(KeyType)) + (nValueCount * sizeof(ObjectUIDType::NodeUID)) + sizeof(size_t) + sizeof(size_t);
 
 		os.write(reinterpret_cast<const char*>(&UID), sizeof(uint8_t));
 		os.write(reinterpret_cast<const char*>(&nKeyCount), sizeof(size_t));
 		os.write(reinterpret_cast<const char*>(&nValueCount), sizeof(size_t));
-		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtPivots.data()), nKeyCount * sizeof(KeyType));
-		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::NodeUID));	// fix it!
+		os.write(reinterpret_cast<const char*>(m_data.m_vtPivots.data()), nKeyCount * sizeof(KeyType));
+		os.write(reinterpret_cast<const char*>(m_data.m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::NodeUID));	// fix it!
 
 
-		auto it = m_ptrData->m_vtChildren.begin();
-		while (it != m_ptrData->m_vtChildren.end())
+		auto it = m_data.m_vtChildren.begin();
+		while (it != m_data.m_vtChildren.end())
 		{
 			if (( * it).m_uid.m_nMediaType < 3)
 			{
@@ -469,9 +574,9 @@ public:
 		// hint
 		/*
 		if (std::is_trivial<ObjectUIDType>::value && std::is_standard_layout<ObjectUIDType>::value)
-		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::NodeUID));
+		os.write(reinterpret_cast<const char*>(m_data.m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::NodeUID));
 		else
-		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::PODType));
+		os.write(reinterpret_cast<const char*>(m_data.m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::PODType));
 
 		*/
 	}
@@ -487,8 +592,8 @@ public:
 
 		uidObjectType = UID;
 
-		size_t nKeyCount = m_ptrData->m_vtPivots.size();
-		size_t nValueCount = m_ptrData->m_vtChildren.size();
+		size_t nKeyCount = m_data.m_vtPivots.size();
+		size_t nValueCount = m_data.m_vtChildren.size();
 
 		nBufferSize = sizeof(uint8_t) + (nKeyCount * sizeof(KeyType)) + (nValueCount * sizeof(ObjectUIDType::NodeUID)) + sizeof(size_t) + sizeof(size_t);
 
@@ -506,32 +611,32 @@ public:
 		nOffset += sizeof(size_t);
 
 		size_t nKeysSize = nKeyCount * sizeof(KeyType);
-		memcpy(szBuffer + nOffset, m_ptrData->m_vtPivots.data(), nKeysSize);
+		memcpy(szBuffer + nOffset, m_data.m_vtPivots.data(), nKeysSize);
 		nOffset += nKeysSize;
 
 		size_t nValuesSize = nValueCount * sizeof(ObjectUIDType::NodeUID);
-		memcpy(szBuffer + nOffset, m_ptrData->m_vtChildren.data(), nValuesSize);
+		memcpy(szBuffer + nOffset, m_data.m_vtChildren.data(), nValuesSize);
 		nOffset += nValuesSize;
 
 		assert(nBufferSize == nOffset);
 
 		SelfType* _t = new SelfType(szBuffer);
-		for (int i = 0; i < _t->m_ptrData->m_vtPivots.size(); i++)
+		for (int i = 0; i < _t->m_data.m_vtPivots.size(); i++)
 		{
-			assert(_t->m_ptrData->m_vtPivots[i] == m_ptrData->m_vtPivots[i]);
+			assert(_t->m_data.m_vtPivots[i] == m_data.m_vtPivots[i]);
 		}
-		for (int i = 0; i < _t->m_ptrData->m_vtChildren.size(); i++)
+		for (int i = 0; i < _t->m_data.m_vtChildren.size(); i++)
 		{
-			assert(_t->m_ptrData->m_vtChildren[i] == m_ptrData->m_vtChildren[i]);
+			assert(_t->m_data.m_vtChildren[i] == m_data.m_vtChildren[i]);
 		}
 		delete _t;
 
 		// hint
 		/*
 		if (std::is_trivial<ObjectUIDType>::value && std::is_standard_layout<ObjectUIDType>::value)
-		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::NodeUID));
+		os.write(reinterpret_cast<const char*>(m_data.m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::NodeUID));
 		else
-		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::PODType));
+		os.write(reinterpret_cast<const char*>(m_data.m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::PODType));
 
 		*/
 	}
@@ -542,14 +647,14 @@ public:
 			sizeof(uint8_t)
 			+ sizeof(size_t)
 			+ sizeof(size_t)
-			+ (m_ptrData->m_vtPivots.size() * sizeof(KeyType))
-			+ (m_ptrData->m_vtChildren.size() * sizeof(ObjectUIDType::NodeUID));
+			+ (m_data.m_vtPivots.size() * sizeof(KeyType))
+			+ (m_data.m_vtChildren.size() * sizeof(ObjectUIDType::NodeUID));
 	}
 
 	void updateChildUID(const ObjectUIDType& uidOld, const ObjectUIDType& uidNew)
 	{
-		auto it = m_ptrData->m_vtChildren.begin();
-		while (it != m_ptrData->m_vtChildren.end())
+		auto it = m_data.m_vtChildren.begin();
+		while (it != m_data.m_vtChildren.end())
 		{
 			if (*it == uidOld)
 			{
@@ -559,6 +664,12 @@ public:
 			it++;
 		}
 
+		// Readers that missed the same child at once all get the updated UID, the first one has patched it already.
+		if (std::find(m_data.m_vtChildren.begin(), m_data.m_vtChildren.end(), uidNew) != m_data.m_vtChildren.end())
+		{
+			return;
+		}
+
 		throw new std::exception("should not occur!");
 	}
 
@@ -570,27 +681,27 @@ public:
 
 		prefix.append(std::string(nSpace - 1, ' '));
 		prefix.append("|");
-		for (size_t nIndex = 0; nIndex < m_ptrData->m_vtChildren.size(); nIndex++)
+		for (size_t nIndex = 0; nIndex < m_data.m_vtChildren.size(); nIndex++)
 		{
 			out << " " << prefix << std::endl;
 			out << " " << prefix << std::string(nSpace, '-').c_str();// << std::endl;
 
-			if (nIndex < m_ptrData->m_vtPivots.size())
+			if (nIndex < m_data.m_vtPivots.size())
 			{
-				out << " < (" << m_ptrData->m_vtPivots[nIndex] << ")";// << std::endl;
+				out << " < (" << m_data.m_vtPivots[nIndex] << ")";// << std::endl;
 			}
 			else {
-				out << " >= (" << m_ptrData->m_vtPivots[nIndex - 1] << ")";// << std::endl;
+				out << " >= (" << m_data.m_vtPivots[nIndex - 1] << ")";// << std::endl;
 			}
 
 
 			ObjectType ptrNode = nullptr;
 			std::optional<ObjectUIDType> uidUpdated = std::nullopt;
-			ptrCache->getObject(m_ptrData->m_vtChildren[nIndex], ptrNode, uidUpdated);
+			ptrCache->getObject(m_data.m_vtChildren[nIndex], ptrNode, uidUpdated);
 
 			if (uidUpdated != std::nullopt)
 			{
-				m_ptrData->m_vtChildren[nIndex] = *uidUpdated;
+				m_data.m_vtChildren[nIndex] = *uidUpdated;
 			}
 
 			out << std::endl;
@@ -0,0 +1,857 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <string>
+#include <map>
+#include <sstream>
+#include <iterator>
+#include <iostream>
+#include <cmath>
+#include <optional>
+#include <algorithm>
+
+#include <iostream>
+#include <fstream>
+#include <assert.h>
+
+#include "ErrorCodes.h"
+#include "KeySearch.hpp"
+
+//#define __TREE_AWARE_CACHE__
+
+using namespace std;
+
+/*
+ * IndexNode of the B-epsilon tree (see BEpsilonStore). Besides the pivots and the children it carries a buffer of
+ * pending changes (messages) for the keys under it. The buffer is sorted by key and holds at most one message per
+ * key, a message that arrives for a key already in the buffer is folded into it. A message is always newer than
+ * the messages for the same key further down the tree.
+ */
+template <typename KeyType, typename ValueType, typename ObjectUIDType, uint8_t TYPE_UID>
+class IndexNodeWithBuffer
+{
+public:
+	static const uint8_t UID = TYPE_UID;
+
+	enum MessageType : uint8_t
+	{
+		Insert = 1,		// sets the value.
+		Delete = 2,
+		Upsert = 3		// adds to the value, a missing key takes the message's value.
+	};
+
+private:
+	typedef IndexNodeWithBuffer<KeyType, ValueType, ObjectUIDType, UID> SelfType;
+
+	typedef std::vector<KeyType>::const_iterator KeyTypeIterator;
+	typedef std::vector<ObjectUIDType>::const_iterator CacheKeyTypeIterator;
+	typedef std::vector<uint8_t>::const_iterator MessageTypeIterator;
+	typedef std::vector<ValueType>::const_iterator ValueTypeIterator;
+
+public:
+	struct INDEXNODESTRUCT
+	{
+		std::vector<KeyType> m_vtPivots;
+		std::vector<ObjectUIDType> m_vtChildren;
+
+		std::vector<KeyType> m_vtMessageKeys;
+		std::vector<uint8_t> m_vtMessageTypes;
+		std::vector<ValueType> m_vtMessageValues;
+	};
+
+	std::shared_ptr<INDEXNODESTRUCT> m_ptrData;
+
+public:
+	~IndexNodeWithBuffer()
+	{
+		// TODO: check for ref count?
+		m_ptrData.reset();
+	}
+
+	IndexNodeWithBuffer()
+		: m_ptrData(make_shared<INDEXNODESTRUCT>())
+	{
+	}
+
+	IndexNodeWithBuffer(const IndexNodeWithBuffer& source)
+		: m_ptrData(make_shared<INDEXNODESTRUCT>())
+	{
+		m_ptrData->m_vtPivots.assign(source.m_ptrData->m_vtPivots.begin(), source.m_ptrData->m_vtPivots.end());
+		m_ptrData->m_vtChildren.assign(source.m_ptrData->m_vtChildren.begin(), source.m_ptrData->m_vtChildren.end());
+
+		m_ptrData->m_vtMessageKeys.assign(source.m_ptrData->m_vtMessageKeys.begin(), source.m_ptrData->m_vtMessageKeys.end());
+		m_ptrData->m_vtMessageTypes.assign(source.m_ptrData->m_vtMessageTypes.begin(), source.m_ptrData->m_vtMessageTypes.end());
+		m_ptrData->m_vtMessageValues.assign(source.m_ptrData->m_vtMessageValues.begin(), source.m_ptrData->m_vtMessageValues.end());
+	}
+
+	IndexNodeWithBuffer(const char* szData)
+		: m_ptrData(make_shared<INDEXNODESTRUCT>())
+	{
+		size_t nKeyCount, nValueCount, nMessageCount = 0;
+
+		size_t nOffset = sizeof(uint8_t);
+
+		memcpy(&nKeyCount, szData + nOffset, sizeof(size_t));
+		nOffset += sizeof(size_t);
+
+		memcpy(&nValueCount, szData + nOffset, sizeof(size_t));
+		nOffset += sizeof(size_t);
+
+		memcpy(&nMessageCount, szData + nOffset, sizeof(size_t));
+		nOffset += sizeof(size_t);
+
+		m_ptrData->m_vtPivots.resize(nKeyCount);
+		m_ptrData->m_vtChildren.resize(nValueCount);
+		m_ptrData->m_vtMessageKeys.resize(nMessageCount);
+		m_ptrData->m_vtMessageTypes.resize(nMessageCount);
+		m_ptrData->m_vtMessageValues.resize(nMessageCount);
+
+		size_t nKeysSize = nKeyCount * sizeof(KeyType);
+		memcpy(m_ptrData->m_vtPivots.data(), szData + nOffset, nKeysSize);
+		nOffset += nKeysSize;
+
+		size_t nValuesSize = nValueCount * sizeof(ObjectUIDType::NodeUID);
+		memcpy(m_ptrData->m_vtChildren.data(), szData + nOffset, nValuesSize);
+		nOffset += nValuesSize;
+
+		memcpy(m_ptrData->m_vtMessageKeys.data(), szData + nOffset, nMessageCount * sizeof(KeyType));
+		nOffset += nMessageCount * sizeof(KeyType);
+
+		memcpy(m_ptrData->m_vtMessageTypes.data(), szData + nOffset, nMessageCount * sizeof(uint8_t));
+		nOffset += nMessageCount * sizeof(uint8_t);
+
+		memcpy(m_ptrData->m_vtMessageValues.data(), szData + nOffset, nMessageCount * sizeof(ValueType));
+	}
+
+	IndexNodeWithBuffer(std::fstream& is)
+		: m_ptrData(make_shared<INDEXNODESTRUCT>())
+	{
+		size_t nKeyCount, nValueCount, nMessageCount;
+		is.read(reinterpret_cast<char*>(&nKeyCount), sizeof(size_t));
+		is.read(reinterpret_cast<char*>(&nValueCount), sizeof(size_t));
+		is.read(reinterpret_cast<char*>(&nMessageCount), sizeof(size_t));
+
+		m_ptrData->m_vtPivots.resize(nKeyCount);
+		m_ptrData->m_vtChildren.resize(nValueCount);
+		m_ptrData->m_vtMessageKeys.resize(nMessageCount);
+		m_ptrData->m_vtMessageTypes.resize(nMessageCount);
+		m_ptrData->m_vtMessageValues.resize(nMessageCount);
+
+		is.read(reinterpret_cast<char*>(m_ptrData->m_vtPivots.data()), nKeyCount * sizeof(KeyType));
+		is.read(reinterpret_cast<char*>(m_ptrData->m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::NodeUID));
+		is.read(reinterpret_cast<char*>(m_ptrData->m_vtMessageKeys.data()), nMessageCount * sizeof(KeyType));
+		is.read(reinterpret_cast<char*>(m_ptrData->m_vtMessageTypes.data()), nMessageCount * sizeof(uint8_t));
+		is.read(reinterpret_cast<char*>(m_ptrData->m_vtMessageValues.data()), nMessageCount * sizeof(ValueType));
+	}
+
+	IndexNodeWithBuffer(KeyTypeIterator itBeginPivots, KeyTypeIterator itEndPivots, CacheKeyTypeIterator itBeginChildren, CacheKeyTypeIterator itEndChildren
+		, KeyTypeIterator itBeginMessageKeys, KeyTypeIterator itEndMessageKeys, MessageTypeIterator itBeginMessageTypes, MessageTypeIterator itEndMessageTypes
+		, ValueTypeIterator itBeginMessageValues, ValueTypeIterator itEndMessageValues)
+		: m_ptrData(make_shared<INDEXNODESTRUCT>())
+	{
+		m_ptrData->m_vtPivots.assign(itBeginPivots, itEndPivots);
+		m_ptrData->m_vtChildren.assign(itBeginChildren, itEndChildren);
+
+		m_ptrData->m_vtMessageKeys.assign(itBeginMessageKeys, itEndMessageKeys);
+		m_ptrData->m_vtMessageTypes.assign(itBeginMessageTypes, itEndMessageTypes);
+		m_ptrData->m_vtMessageValues.assign(itBeginMessageValues, itEndMessageValues);
+	}
+
+	// A node with a single child and no pivots, the root takes this shape for a moment while it grows a level.
+	IndexNodeWithBuffer(const ObjectUIDType& uidChild)
+		: m_ptrData(make_shared<INDEXNODESTRUCT>())
+	{
+		m_ptrData->m_vtChildren.push_back(uidChild);
+	}
+
+	inline ErrorCode insert(const KeyType& pivotKey, const ObjectUIDType& uidSibling)
+	{
+		size_t nChildIdx = KeySearch::upperBound(m_ptrData->m_vtPivots, pivotKey);
+
+		m_ptrData->m_vtPivots.insert(m_ptrData->m_vtPivots.begin() + nChildIdx, pivotKey);
+		m_ptrData->m_vtChildren.insert(m_ptrData->m_vtChildren.begin() + nChildIdx + 1, uidSibling);
+
+		return ErrorCode::Success;
+	}
+
+	// Folds a newer message for the same key into the message already held.
+	static inline void combineMessages(uint8_t& nType, ValueType& value, uint8_t nNewerType, const ValueType& newerValue)
+	{
+		if (nNewerType != MessageType::Upsert)
+		{
+			nType = nNewerType;
+			value = newerValue;
+			return;
+		}
+
+		switch (nType)
+		{
+		case MessageType::Insert:
+		case MessageType::Upsert:
+			value = value + newerValue;
+			break;
+		case MessageType::Delete:
+			nType = MessageType::Insert;
+			value = newerValue;
+			break;
+		}
+	}
+
+	inline void addMessage(const KeyType& key, uint8_t nType, const ValueType& value)
+	{
+		KeyTypeIterator it = std::lower_bound(m_ptrData->m_vtMessageKeys.begin(), m_ptrData->m_vtMessageKeys.end(), key);
+		size_t nIdx = it - m_ptrData->m_vtMessageKeys.begin();
+
+		if (it != m_ptrData->m_vtMessageKeys.end() && *it == key)
+		{
+			combineMessages(m_ptrData->m_vtMessageTypes[nIdx], m_ptrData->m_vtMessageValues[nIdx], nType, value);
+			return;
+		}
+
+		m_ptrData->m_vtMessageKeys.insert(m_ptrData->m_vtMessageKeys.begin() + nIdx, key);
+		m_ptrData->m_vtMessageTypes.insert(m_ptrData->m_vtMessageTypes.begin() + nIdx, nType);
+		m_ptrData->m_vtMessageValues.insert(m_ptrData->m_vtMessageValues.begin() + nIdx, value);
+	}
+
+	// Merges a batch flushed down from the parent (sorted by key, and newer than the messages held) into the buffer.
+	inline void addMessages(const std::vector<KeyType>& vtKeys, const std::vector<uint8_t>& vtTypes, const std::vector<ValueType>& vtValues)
+	{
+		std::vector<KeyType> vtMessageKeys;
+		std::vector<uint8_t> vtMessageTypes;
+		std::vector<ValueType> vtMessageValues;
+
+		size_t nSize = m_ptrData->m_vtMessageKeys.size() + vtKeys.size();
+		vtMessageKeys.reserve(nSize);
+		vtMessageTypes.reserve(nSize);
+		vtMessageValues.reserve(nSize);
+
+		size_t nIdx = 0, nNewIdx = 0;
+		while (nIdx < m_ptrData->m_vtMessageKeys.size() || nNewIdx < vtKeys.size())
+		{
+			if (nNewIdx == vtKeys.size() || (nIdx < m_ptrData->m_vtMessageKeys.size() && m_ptrData->m_vtMessageKeys[nIdx] < vtKeys[nNewIdx]))
+			{
+				vtMessageKeys.push_back(m_ptrData->m_vtMessageKeys[nIdx]);
+				vtMessageTypes.push_back(m_ptrData->m_vtMessageTypes[nIdx]);
+				vtMessageValues.push_back(m_ptrData->m_vtMessageValues[nIdx]);
+				nIdx++;
+			}
+			else if (nIdx == m_ptrData->m_vtMessageKeys.size() || vtKeys[nNewIdx] < m_ptrData->m_vtMessageKeys[nIdx])
+			{
+				vtMessageKeys.push_back(vtKeys[nNewIdx]);
+				vtMessageTypes.push_back(vtTypes[nNewIdx]);
+				vtMessageValues.push_back(vtValues[nNewIdx]);
+				nNewIdx++;
+			}
+			else
+			{
+				vtMessageKeys.push_back(m_ptrData->m_vtMessageKeys[nIdx]);
+				vtMessageTypes.push_back(m_ptrData->m_vtMessageTypes[nIdx]);
+				vtMessageValues.push_back(m_ptrData->m_vtMessageValues[nIdx]);
+
+				combineMessages(vtMessageTypes.back(), vtMessageValues.back(), vtTypes[nNewIdx], vtValues[nNewIdx]);
+				nIdx++;
+				nNewIdx++;
+			}
+		}
+
+		m_ptrData->m_vtMessageKeys.swap(vtMessageKeys);
+		m_ptrData->m_vtMessageTypes.swap(vtMessageTypes);
+		m_ptrData->m_vtMessageValues.swap(vtMessageValues);
+	}
+
+	inline ErrorCode getMessage(const KeyType& key, uint8_t& nType, ValueType& value)
+	{
+		KeyTypeIterator it = std::lower_bound(m_ptrData->m_vtMessageKeys.begin(), m_ptrData->m_vtMessageKeys.end(), key);
+		if (it != m_ptrData->m_vtMessageKeys.end() && *it == key)
+		{
+			size_t nIdx = it - m_ptrData->m_vtMessageKeys.begin();
+			nType = m_ptrData->m_vtMessageTypes[nIdx];
+			value = m_ptrData->m_vtMessageValues[nIdx];
+
+			return ErrorCode::Success;
+		}
+
+		return ErrorCode::KeyDoesNotExist;
+	}
+
+	// Moves the messages that belong to the child at nChildIdx out of the buffer.
+	inline void takeMessages(size_t nChildIdx, std::vector<KeyType>& vtKeys, std::vector<uint8_t>& vtTypes, std::vector<ValueType>& vtValues)
+	{
+		size_t nBegin = 0;
+		size_t nEnd = m_ptrData->m_vtMessageKeys.size();
+
+		if (nChildIdx > 0)
+		{
+			nBegin = std::lower_bound(m_ptrData->m_vtMessageKeys.begin(), m_ptrData->m_vtMessageKeys.end(), m_ptrData->m_vtPivots[nChildIdx - 1]) - m_ptrData->m_vtMessageKeys.begin();
+		}
+
+		if (nChildIdx < m_ptrData->m_vtPivots.size())
+		{
+			nEnd = std::lower_bound(m_ptrData->m_vtMessageKeys.begin(), m_ptrData->m_vtMessageKeys.end(), m_ptrData->m_vtPivots[nChildIdx]) - m_ptrData->m_vtMessageKeys.begin();
+		}
+
+		vtKeys.assign(m_ptrData->m_vtMessageKeys.begin() + nBegin, m_ptrData->m_vtMessageKeys.begin() + nEnd);
+		vtTypes.assign(m_ptrData->m_vtMessageTypes.begin() + nBegin, m_ptrData->m_vtMessageTypes.begin() + nEnd);
+		vtValues.assign(m_ptrData->m_vtMessageValues.begin() + nBegin, m_ptrData->m_vtMessageValues.begin() + nEnd);
+
+		m_ptrData->m_vtMessageKeys.erase(m_ptrData->m_vtMessageKeys.begin() + nBegin, m_ptrData->m_vtMessageKeys.begin() + nEnd);
+		m_ptrData->m_vtMessageTypes.erase(m_ptrData->m_vtMessageTypes.begin() + nBegin, m_ptrData->m_vtMessageTypes.begin() + nEnd);
+		m_ptrData->m_vtMessageValues.erase(m_ptrData->m_vtMessageValues.begin() + nBegin, m_ptrData->m_vtMessageValues.begin() + nEnd);
+	}
+
+	// The child with the most messages pending, flushing it moves the largest batch down.
+	inline size_t getChildNodeIdxWithMostMessages()
+	{
+		size_t nChildIdx = 0, nMessages = 0;
+		size_t nBusiestChildIdx = 0, nBusiestChildMessages = 0;
+
+		for (const KeyType& key : m_ptrData->m_vtMessageKeys)
+		{
+			while (nChildIdx < m_ptrData->m_vtPivots.size() && key >= m_ptrData->m_vtPivots[nChildIdx])
+			{
+				nChildIdx++;
+				nMessages = 0;
+			}
+
+			if (++nMessages > nBusiestChildMessages)
+			{
+				nBusiestChildIdx = nChildIdx;
+				nBusiestChildMessages = nMessages;
+			}
+		}
+
+		return nBusiestChildIdx;
+	}
+
+	inline size_t getMessagesCount()
+	{
+		return m_ptrData->m_vtMessageKeys.size();
+	}
+
+	inline bool requireFlush(size_t nBufferSize)
+	{
+		return m_ptrData->m_vtMessageKeys.size() > nBufferSize;
+	}
+
+	template <typename CacheType, typename ObjectCoreType>
+	inline ErrorCode rebalanceIndexNode(CacheType ptrCache, const ObjectUIDType& uidChild, ObjectCoreType ptrChild, const KeyType& key, size_t nDegree, std::optional<ObjectUIDType>& uidObjectToDelete)
+	{
+		ObjectCoreType ptrLHSNode = nullptr;
+		ObjectCoreType ptrRHSNode = nullptr;
+
+		size_t nChildIdx = getChildNodeIdx(key);
+
+		if (nChildIdx > 0)
+		{
+#ifdef __TREE_AWARE_CACHE__
+			std::optional<ObjectUIDType> uidUpdated = std::nullopt;
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx - 1], ptrLHSNode, uidUpdated);    //TODO: lock
+
+			if (uidUpdated != std::nullopt)
+			{
+				m_ptrData->m_vtChildren[nChildIdx - 1] = *uidUpdated;
+			}
+#else __TREE_AWARE_CACHE__
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx - 1], ptrLHSNode);    //TODO: lock
+#endif __TREE_AWARE_CACHE__
+
+			if (ptrLHSNode->getKeysCount() > std::ceil(nDegree / 2.0f))	// TODO: macro?
+			{
+				KeyType key;
+				ptrChild->moveAnEntityFromLHSSibling(ptrLHSNode, m_ptrData->m_vtPivots[nChildIdx - 1], key);
+
+				m_ptrData->m_vtPivots[nChildIdx - 1] = key;
+				return ErrorCode::Success;
+			}
+		}
+
+		if (nChildIdx < m_ptrData->m_vtPivots.size())
+		{
+#ifdef __TREE_AWARE_CACHE__
+			std::optional<ObjectUIDType> uidUpdated = std::nullopt;
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx + 1], ptrRHSNode, uidUpdated);    //TODO: lock
+
+			if (uidUpdated != std::nullopt)
+			{
+				m_ptrData->m_vtChildren[nChildIdx + 1] = *uidUpdated;
+			}
+#else __TREE_AWARE_CACHE__
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx + 1], ptrRHSNode);    //TODO: lock
+#endif __TREE_AWARE_CACHE__
+
+			if (ptrRHSNode->getKeysCount() > std::ceil(nDegree / 2.0f))
+			{
+				KeyType key;
+				ptrChild->moveAnEntityFromRHSSibling(ptrRHSNode, m_ptrData->m_vtPivots[nChildIdx], key);
+
+				m_ptrData->m_vtPivots[nChildIdx] = key;
+				return ErrorCode::Success;
+			}
+		}
+
+		if (nChildIdx > 0)
+		{
+			ptrLHSNode->mergeNodes(ptrChild, m_ptrData->m_vtPivots[nChildIdx - 1]);
+
+			uidObjectToDelete = m_ptrData->m_vtChildren[nChildIdx];
+			if (uidObjectToDelete != uidChild)
+			{
+				throw new std::exception("should not occur!");
+			}
+
+			m_ptrData->m_vtPivots.erase(m_ptrData->m_vtPivots.begin() + nChildIdx - 1);
+			m_ptrData->m_vtChildren.erase(m_ptrData->m_vtChildren.begin() + nChildIdx);
+
+			return ErrorCode::Success;
+		}
+
+		if (nChildIdx < m_ptrData->m_vtPivots.size())
+		{
+			ptrChild->mergeNodes(ptrRHSNode, m_ptrData->m_vtPivots[nChildIdx]);
+
+			assert(uidChild == m_ptrData->m_vtChildren[nChildIdx]);
+
+			uidObjectToDelete = m_ptrData->m_vtChildren[nChildIdx + 1];
+
+			m_ptrData->m_vtPivots.erase(m_ptrData->m_vtPivots.begin() + nChildIdx);
+			m_ptrData->m_vtChildren.erase(m_ptrData->m_vtChildren.begin() + nChildIdx + 1);
+
+			return ErrorCode::Success;
+		}
+
+		throw new exception("should not occur!"); // TODO: critical log entry.
+	}
+
+	template <typename CacheType, typename ObjectCoreType>
+	inline ErrorCode rebalanceDataNode(CacheType ptrCache, const ObjectUIDType& uidChild, ObjectCoreType ptrChild, const KeyType& key, size_t nDegree, std::optional<ObjectUIDType>& uidObjectToDelete)
+	{
+		ObjectCoreType ptrLHSNode = nullptr;
+		ObjectCoreType ptrRHSNode = nullptr;
+
+		size_t nChildIdx = getChildNodeIdx(key);
+
+		if (nChildIdx > 0)
+		{
+#ifdef __TREE_AWARE_CACHE__
+			std::optional<ObjectUIDType> uidUpdated = std::nullopt;
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx - 1], ptrLHSNode, uidUpdated);    //TODO: lock
+
+			if (uidUpdated != std::nullopt)
+			{
+				m_ptrData->m_vtChildren[nChildIdx - 1] = *uidUpdated;
+			}
+#else __TREE_AWARE_CACHE__
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx - 1], ptrLHSNode);    //TODO: lock
+#endif __TREE_AWARE_CACHE__
+
+			if (ptrLHSNode->getKeysCount() > std::ceil(nDegree / 2.0f))
+			{
+				KeyType key;
+				ptrChild->moveAnEntityFromLHSSibling(ptrLHSNode, key);
+
+				m_ptrData->m_vtPivots[nChildIdx - 1] = key;
+				return ErrorCode::Success;
+			}
+		}
+
+		if (nChildIdx < m_ptrData->m_vtPivots.size())
+		{
+#ifdef __TREE_AWARE_CACHE__
+			std::optional<ObjectUIDType> uidUpdated = std::nullopt;
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx + 1], ptrRHSNode, uidUpdated);    //TODO: lock
+
+			if (uidUpdated != std::nullopt)
+			{
+				m_ptrData->m_vtChildren[nChildIdx + 1] = *uidUpdated;
+			}
+#else __TREE_AWARE_CACHE__
+			ptrCache->template getObjectOfType<ObjectCoreType>(m_ptrData->m_vtChildren[nChildIdx + 1], ptrRHSNode);    //TODO: lock
+#endif __TREE_AWARE_CACHE__
+
+			if (ptrRHSNode->getKeysCount() > std::ceil(nDegree / 2.0f))
+			{
+				KeyType key;
+				ptrChild->moveAnEntityFromRHSSibling(ptrRHSNode, key);
+
+				m_ptrData->m_vtPivots[nChildIdx] = key;
+				return ErrorCode::Success;
+			}
+		}
+
+		if (nChildIdx > 0)
+		{
+			ptrLHSNode->mergeNode(ptrChild);
+
+			uidObjectToDelete = m_ptrData->m_vtChildren[nChildIdx];
+			if (uidObjectToDelete != uidChild)
+			{
+				throw new std::exception("should not occur!");
+			}
+
+			m_ptrData->m_vtPivots.erase(m_ptrData->m_vtPivots.begin() + nChildIdx - 1);
+			m_ptrData->m_vtChildren.erase(m_ptrData->m_vtChildren.begin() + nChildIdx);
+
+			return ErrorCode::Success;
+		}
+
+		if (nChildIdx < m_ptrData->m_vtPivots.size())
+		{
+			ptrChild->mergeNode(ptrRHSNode);
+
+			uidObjectToDelete = m_ptrData->m_vtChildren[nChildIdx + 1];
+
+			m_ptrData->m_vtPivots.erase(m_ptrData->m_vtPivots.begin() + nChildIdx);
+			m_ptrData->m_vtChildren.erase(m_ptrData->m_vtChildren.begin() + nChildIdx + 1);
+
+			return ErrorCode::Success;
+		}
+
+		throw new exception("should not occur!"); // TODO: critical log entry.
+	}
+
+	inline size_t getKeysCount()
+	{
+		return m_ptrData->m_vtPivots.size();
+	}
+
+	inline size_t getChildNodeIdx(const KeyType& key)
+	{
+		return KeySearch::upperBound(m_ptrData->m_vtPivots, key);
+	}
+
+	inline ObjectUIDType getChildAt(size_t nIdx)
+	{
+		return m_ptrData->m_vtChildren[nIdx];
+	}
+
+	inline ObjectUIDType getChild(const KeyType& key)
+	{
+		return m_ptrData->m_vtChildren[getChildNodeIdx(key)];
+	}
+
+	inline size_t getChildrenCount()
+	{
+		return m_ptrData->m_vtChildren.size();
+	}
+
+	inline const KeyType& getPivotAt(size_t nIdx)
+	{
+		return m_ptrData->m_vtPivots[nIdx];
+	}
+
+	inline bool requireSplit(size_t nDegree)
+	{
+		return m_ptrData->m_vtPivots.size() > nDegree;
+	}
+
+	inline bool requireMerge(size_t nDegree)
+	{
+		return m_ptrData->m_vtPivots.size() <= std::ceil(nDegree / 2.0f);
+	}
+
+	// Same as IndexNode::split, the messages from the pivot on go to the sibling along with the children.
+	template <typename Cache>
+	inline ErrorCode split(Cache ptrCache, std::optional<ObjectUIDType>& uidSibling, KeyType& pivotKeyForParent)
+	{
+		size_t nMid = m_ptrData->m_vtPivots.size() / 2;
+
+		size_t nMessageIdx = std::lower_bound(m_ptrData->m_vtMessageKeys.begin(), m_ptrData->m_vtMessageKeys.end(), m_ptrData->m_vtPivots[nMid]) - m_ptrData->m_vtMessageKeys.begin();
+
+		ptrCache->template createObjectOfType<SelfType>(uidSibling,
+			m_ptrData->m_vtPivots.begin() + nMid + 1, m_ptrData->m_vtPivots.end(),
+			m_ptrData->m_vtChildren.begin() + nMid + 1, m_ptrData->m_vtChildren.end(),
+			m_ptrData->m_vtMessageKeys.begin() + nMessageIdx, m_ptrData->m_vtMessageKeys.end(),
+			m_ptrData->m_vtMessageTypes.begin() + nMessageIdx, m_ptrData->m_vtMessageTypes.end(),
+			m_ptrData->m_vtMessageValues.begin() + nMessageIdx, m_ptrData->m_vtMessageValues.end());
+
+		if (!uidSibling)
+		{
+			return ErrorCode::Error;
+		}
+
+		pivotKeyForParent = m_ptrData->m_vtPivots[nMid];
+
+		m_ptrData->m_vtPivots.resize(nMid);
+		m_ptrData->m_vtChildren.resize(nMid + 1);
+
+		m_ptrData->m_vtMessageKeys.resize(nMessageIdx);
+		m_ptrData->m_vtMessageTypes.resize(nMessageIdx);
+		m_ptrData->m_vtMessageValues.resize(nMessageIdx);
+
+		return ErrorCode::Success;
+	}
+
+	inline void moveAnEntityFromLHSSibling(shared_ptr<SelfType> ptrLHSSibling, KeyType& pivotKeyForEntity, KeyType& pivotKeyForParent)
+	{
+		KeyType key = ptrLHSSibling->m_ptrData->m_vtPivots.back();
+		ObjectUIDType value = ptrLHSSibling->m_ptrData->m_vtChildren.back();
+
+		ptrLHSSibling->m_ptrData->m_vtPivots.pop_back();
+		ptrLHSSibling->m_ptrData->m_vtChildren.pop_back();
+
+		if (ptrLHSSibling->m_ptrData->m_vtPivots.size() == 0)
+		{
+			throw new std::exception("should not occur!");
+		}
+
+		m_ptrData->m_vtPivots.insert(m_ptrData->m_vtPivots.begin(), pivotKeyForEntity);
+		m_ptrData->m_vtChildren.insert(m_ptrData->m_vtChildren.begin(), value);
+
+		// The messages for the child that moved over, i.e. those from its pivot on.
+		size_t nMessageIdx = std::lower_bound(ptrLHSSibling->m_ptrData->m_vtMessageKeys.begin(), ptrLHSSibling->m_ptrData->m_vtMessageKeys.end(), key) - ptrLHSSibling->m_ptrData->m_vtMessageKeys.begin();
+
+		m_ptrData->m_vtMessageKeys.insert(m_ptrData->m_vtMessageKeys.begin(), ptrLHSSibling->m_ptrData->m_vtMessageKeys.begin() + nMessageIdx, ptrLHSSibling->m_ptrData->m_vtMessageKeys.end());
+		m_ptrData->m_vtMessageTypes.insert(m_ptrData->m_vtMessageTypes.begin(), ptrLHSSibling->m_ptrData->m_vtMessageTypes.begin() + nMessageIdx, ptrLHSSibling->m_ptrData->m_vtMessageTypes.end());
+		m_ptrData->m_vtMessageValues.insert(m_ptrData->m_vtMessageValues.begin(), ptrLHSSibling->m_ptrData->m_vtMessageValues.begin() + nMessageIdx, ptrLHSSibling->m_ptrData->m_vtMessageValues.end());
+
+		ptrLHSSibling->m_ptrData->m_vtMessageKeys.resize(nMessageIdx);
+		ptrLHSSibling->m_ptrData->m_vtMessageTypes.resize(nMessageIdx);
+		ptrLHSSibling->m_ptrData->m_vtMessageValues.resize(nMessageIdx);
+
+		pivotKeyForParent = key;
+	}
+
+	inline void moveAnEntityFromRHSSibling(shared_ptr<SelfType> ptrRHSSibling, KeyType& pivotKeyForEntity, KeyType& pivotKeyForParent)
+	{
+		KeyType key = ptrRHSSibling->m_ptrData->m_vtPivots.front();
+		ObjectUIDType value = ptrRHSSibling->m_ptrData->m_vtChildren.front();
+
+		ptrRHSSibling->m_ptrData->m_vtPivots.erase(ptrRHSSibling->m_ptrData->m_vtPivots.begin());
+		ptrRHSSibling->m_ptrData->m_vtChildren.erase(ptrRHSSibling->m_ptrData->m_vtChildren.begin());
+
+		if (ptrRHSSibling->m_ptrData->m_vtPivots.size() == 0)
+		{
+			throw new std::exception("should not occur!");
+		}
+
+		m_ptrData->m_vtPivots.push_back(pivotKeyForEntity);
+		m_ptrData->m_vtChildren.push_back(value);
+
+		// The messages for the child that moved over, i.e. those below the sibling's first pivot.
+		size_t nMessageIdx = std::lower_bound(ptrRHSSibling->m_ptrData->m_vtMessageKeys.begin(), ptrRHSSibling->m_ptrData->m_vtMessageKeys.end(), key) - ptrRHSSibling->m_ptrData->m_vtMessageKeys.begin();
+
+		m_ptrData->m_vtMessageKeys.insert(m_ptrData->m_vtMessageKeys.end(), ptrRHSSibling->m_ptrData->m_vtMessageKeys.begin(), ptrRHSSibling->m_ptrData->m_vtMessageKeys.begin() + nMessageIdx);
+		m_ptrData->m_vtMessageTypes.insert(m_ptrData->m_vtMessageTypes.end(), ptrRHSSibling->m_ptrData->m_vtMessageTypes.begin(), ptrRHSSibling->m_ptrData->m_vtMessageTypes.begin() + nMessageIdx);
+		m_ptrData->m_vtMessageValues.insert(m_ptrData->m_vtMessageValues.end(), ptrRHSSibling->m_ptrData->m_vtMessageValues.begin(), ptrRHSSibling->m_ptrData->m_vtMessageValues.begin() + nMessageIdx);
+
+		ptrRHSSibling->m_ptrData->m_vtMessageKeys.erase(ptrRHSSibling->m_ptrData->m_vtMessageKeys.begin(), ptrRHSSibling->m_ptrData->m_vtMessageKeys.begin() + nMessageIdx);
+		ptrRHSSibling->m_ptrData->m_vtMessageTypes.erase(ptrRHSSibling->m_ptrData->m_vtMessageTypes.begin(), ptrRHSSibling->m_ptrData->m_vtMessageTypes.begin() + nMessageIdx);
+		ptrRHSSibling->m_ptrData->m_vtMessageValues.erase(ptrRHSSibling->m_ptrData->m_vtMessageValues.begin(), ptrRHSSibling->m_ptrData->m_vtMessageValues.begin() + nMessageIdx);
+
+		pivotKeyForParent = key;
+	}
+
+	inline void mergeNodes(shared_ptr<SelfType> ptrSibling, KeyType& pivotKey)
+	{
+		m_ptrData->m_vtPivots.push_back(pivotKey);
+		m_ptrData->m_vtPivots.insert(m_ptrData->m_vtPivots.end(), ptrSibling->m_ptrData->m_vtPivots.begin(), ptrSibling->m_ptrData->m_vtPivots.end());
+		m_ptrData->m_vtChildren.insert(m_ptrData->m_vtChildren.end(), ptrSibling->m_ptrData->m_vtChildren.begin(), ptrSibling->m_ptrData->m_vtChildren.end());
+
+		m_ptrData->m_vtMessageKeys.insert(m_ptrData->m_vtMessageKeys.end(), ptrSibling->m_ptrData->m_vtMessageKeys.begin(), ptrSibling->m_ptrData->m_vtMessageKeys.end());
+		m_ptrData->m_vtMessageTypes.insert(m_ptrData->m_vtMessageTypes.end(), ptrSibling->m_ptrData->m_vtMessageTypes.begin(), ptrSibling->m_ptrData->m_vtMessageTypes.end());
+		m_ptrData->m_vtMessageValues.insert(m_ptrData->m_vtMessageValues.end(), ptrSibling->m_ptrData->m_vtMessageValues.begin(), ptrSibling->m_ptrData->m_vtMessageValues.end());
+	}
+
+public:
+	inline void writeToStream(std::fstream& os, uint8_t& uidObjectType, size_t& nDataSize)
+	{
+		static_assert(
+			std::is_trivial<KeyType>::value &&
+			std::is_standard_layout<KeyType>::value &&
+			std::is_trivial<ValueType>::value &&
+			std::is_standard_layout<ValueType>::value &&
+			std::is_trivial<ObjectUIDType::NodeUID>::value &&
+			std::is_standard_layout<ObjectUIDType::NodeUID>::value,
+			"Can only deserialize POD types with this function");
+
+		uidObjectType = UID;
+
+		size_t nKeyCount = m_ptrData->m_vtPivots.size();
+		size_t nValueCount = m_ptrData->m_vtChildren.size();
+		size_t nMessageCount = m_ptrData->m_vtMessageKeys.size();
+
+		nDataSize = getSize();
+
+		os.write(reinterpret_cast<const char*>(&UID), sizeof(uint8_t));
+		os.write(reinterpret_cast<const char*>(&nKeyCount), sizeof(size_t));
+		os.write(reinterpret_cast<const char*>(&nValueCount), sizeof(size_t));
+		os.write(reinterpret_cast<const char*>(&nMessageCount), sizeof(size_t));
+		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtPivots.data()), nKeyCount * sizeof(KeyType));
+		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtChildren.data()), nValueCount * sizeof(ObjectUIDType::NodeUID));
+		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtMessageKeys.data()), nMessageCount * sizeof(KeyType));
+		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtMessageTypes.data()), nMessageCount * sizeof(uint8_t));
+		os.write(reinterpret_cast<const char*>(m_ptrData->m_vtMessageValues.data()), nMessageCount * sizeof(ValueType));
+
+		auto it = m_ptrData->m_vtChildren.begin();
+		while (it != m_ptrData->m_vtChildren.end())
+		{
+			if ((*it).m_uid.m_nMediaType < 3)
+			{
+				throw new std::exception("should not occur!");
+			}
+			it++;
+		}
+	}
+
+	inline void serialize(char*& szBuffer, uint8_t& uidObjectType, size_t& nBufferSize)
+	{
+		static_assert(
+			std::is_trivial<KeyType>::value &&
+			std::is_standard_layout<KeyType>::value &&
+			std::is_trivial<ValueType>::value &&
+			std::is_standard_layout<ValueType>::value &&
+			std::is_trivial<ObjectUIDType::NodeUID>::value &&
+			std::is_standard_layout<ObjectUIDType::NodeUID>::value,
+			"Can only deserialize POD types with this function");
+
+		uidObjectType = UID;
+
+		size_t nKeyCount = m_ptrData->m_vtPivots.size();
+		size_t nValueCount = m_ptrData->m_vtChildren.size();
+		size_t nMessageCount = m_ptrData->m_vtMessageKeys.size();
+
+		nBufferSize = getSize();
+
+		szBuffer = new char[nBufferSize + 1];
+		memset(szBuffer, '\0', nBufferSize + 1);
+
+		size_t nOffset = 0;
+		memcpy(szBuffer, &UID, sizeof(uint8_t));
+		nOffset += sizeof(uint8_t);
+
+		memcpy(szBuffer + nOffset, &nKeyCount, sizeof(size_t));
+		nOffset += sizeof(size_t);
+
+		memcpy(szBuffer + nOffset, &nValueCount, sizeof(size_t));
+		nOffset += sizeof(size_t);
+
+		memcpy(szBuffer + nOffset, &nMessageCount, sizeof(size_t));
+		nOffset += sizeof(size_t);
+
+		size_t nKeysSize = nKeyCount * sizeof(KeyType);
+		memcpy(szBuffer + nOffset, m_ptrData->m_vtPivots.data(), nKeysSize);
+		nOffset += nKeysSize;
+
+		size_t nValuesSize = nValueCount * sizeof(ObjectUIDType::NodeUID);
+		memcpy(szBuffer + nOffset, m_ptrData->m_vtChildren.data(), nValuesSize);
+		nOffset += nValuesSize;
+
+		memcpy(szBuffer + nOffset, m_ptrData->m_vtMessageKeys.data(), nMessageCount * sizeof(KeyType));
+		nOffset += nMessageCount * sizeof(KeyType);
+
+		memcpy(szBuffer + nOffset, m_ptrData->m_vtMessageTypes.data(), nMessageCount * sizeof(uint8_t));
+		nOffset += nMessageCount * sizeof(uint8_t);
+
+		memcpy(szBuffer + nOffset, m_ptrData->m_vtMessageValues.data(), nMessageCount * sizeof(ValueType));
+		nOffset += nMessageCount * sizeof(ValueType);
+
+		assert(nBufferSize == nOffset);
+
+		SelfType* _t = new SelfType(szBuffer);
+		for (int i = 0; i < _t->m_ptrData->m_vtPivots.size(); i++)
+		{
+			assert(_t->m_ptrData->m_vtPivots[i] == m_ptrData->m_vtPivots[i]);
+		}
+		for (int i = 0; i < _t->m_ptrData->m_vtChildren.size(); i++)
+		{
+			assert(_t->m_ptrData->m_vtChildren[i] == m_ptrData->m_vtChildren[i]);
+		}
+		for (int i = 0; i < _t->m_ptrData->m_vtMessageKeys.size(); i++)
+		{
+			assert(_t->m_ptrData->m_vtMessageKeys[i] == m_ptrData->m_vtMessageKeys[i]);
+			assert(_t->m_ptrData->m_vtMessageTypes[i] == m_ptrData->m_vtMessageTypes[i]);
+		}
+		delete _t;
+	}
+
+	inline size_t getSize()
+	{
+		return
+			sizeof(uint8_t)
+			+ sizeof(size_t)
+			+ sizeof(size_t)
+			+ sizeof(size_t)
+			+ (m_ptrData->m_vtPivots.size() * sizeof(KeyType))
+			+ (m_ptrData->m_vtChildren.size() * sizeof(ObjectUIDType::NodeUID))
+			+ (m_ptrData->m_vtMessageKeys.size() * (sizeof(KeyType) + sizeof(uint8_t) + sizeof(ValueType)));
+	}
+
+	void updateChildUID(const ObjectUIDType& uidOld, const ObjectUIDType& uidNew)
+	{
+		auto it = m_ptrData->m_vtChildren.begin();
+		while (it != m_ptrData->m_vtChildren.end())
+		{
+			if (*it == uidOld)
+			{
+				*it = uidNew;
+				return;
+			}
+			it++;
+		}
+
+		// Readers that missed the same child at once all get the updated UID, the first one has patched it already.
+		if (std::find(m_ptrData->m_vtChildren.begin(), m_ptrData->m_vtChildren.end(), uidNew) != m_ptrData->m_vtChildren.end())
+		{
+			return;
+		}
+
+		throw new std::exception("should not occur!");
+	}
+
+public:
+	template <typename CacheType, typename ObjectType, typename DataNodeType>
+	void print(std::ofstream& out, CacheType ptrCache, size_t nLevel, string prefix)
+	{
+		int nSpace = 7;
+
+		prefix.append(std::string(nSpace - 1, ' '));
+		prefix.append("|");
+
+		for (size_t nIndex = 0; nIndex < m_ptrData->m_vtMessageKeys.size(); nIndex++)
+		{
+			out << " " << prefix << "(M: " << (int)m_ptrData->m_vtMessageTypes[nIndex] << ", K: " << m_ptrData->m_vtMessageKeys[nIndex] << ", V: " << m_ptrData->m_vtMessageValues[nIndex] << ")" << std::endl;
+		}
+
+		for (size_t nIndex = 0; nIndex < m_ptrData->m_vtChildren.size(); nIndex++)
+		{
+			out << " " << prefix << std::endl;
+			out << " " << prefix << std::string(nSpace, '-').c_str();
+
+			if (nIndex < m_ptrData->m_vtPivots.size())
+			{
+				out << " < (" << m_ptrData->m_vtPivots[nIndex] << ")";
+			}
+			else if (nIndex > 0)
+			{
+				out << " >= (" << m_ptrData->m_vtPivots[nIndex - 1] << ")";
+			}
+
+			ObjectType ptrNode = nullptr;
+			std::optional<ObjectUIDType> uidUpdated = std::nullopt;
+			ptrCache->getObject(m_ptrData->m_vtChildren[nIndex], ptrNode, uidUpdated);
+
+			if (uidUpdated != std::nullopt)
+			{
+				m_ptrData->m_vtChildren[nIndex] = *uidUpdated;
+			}
+
+			out << std::endl;
+
+			if (std::holds_alternative<shared_ptr<SelfType>>(*ptrNode->data))
+			{
+				shared_ptr<SelfType> ptrIndexNode = std::get<shared_ptr<SelfType>>(*ptrNode->data);
+
+				ptrIndexNode->template print<CacheType, ObjectType, DataNodeType>(out, ptrCache, nLevel + 1, prefix);
+			}
+			else if (std::holds_alternative<shared_ptr<DataNodeType>>(*ptrNode->data))
+			{
+				shared_ptr<DataNodeType> ptrDataNode = std::get<shared_ptr<DataNodeType>>(*ptrNode->data);
+				ptrDataNode->print(out, nLevel + 1, prefix);
+			}
+		}
+	}
+
+	void wieHiestDu() {
+		printf("ich heisse InternalNodeWithBuffer.\n");
+	}
+};
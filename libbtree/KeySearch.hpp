@@ -0,0 +1,241 @@
+#pragma once
+#include <vector>
+#include <bit>
+#include <type_traits>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define __KEY_SEARCH_AVX2__
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define __AVX2_TARGET__
+#else // !_MSC_VER
+#define __AVX2_TARGET__ __attribute__((target("avx2")))
+#endif _MSC_VER
+#endif __KEY_SEARCH_AVX2__
+
+// Up to this many keys a linear scan is cheaper than the binary search, see test_for_key_search in the sandbox.
+#define LINEAR_SEARCH_CUTOFF 32
+#define SIMD_LINEAR_SEARCH_CUTOFF 64
+
+/*
+ * Searches over the sorted keys of a node. Both the linear scan and the binary search are branch-free, i.e. the
+ * comparisons only feed additions and conditional moves, so a search does not suffer from mispredictions however
+ * the keys are spread. The binary search narrows the range down to the cutoff and the linear scan counts the keys
+ * in front of the position within it.
+ * For 32 and 64-bit integer keys the scan compares 8 or 4 keys per instruction with AVX2 when the CPU supports it
+ * (checked once at startup) and takes over from the binary search earlier, otherwise the scalar loop is used.
+ */
+class KeySearch
+{
+public:
+	// Position of the first key that is not less than the given key (as std::lower_bound). The keys can be held by
+	// any contiguous container with data() and size().
+	template <typename KeyArray, typename KeyType>
+	static inline size_t lowerBound(const KeyArray& vtKeys, const KeyType& key, size_t nLinearSearchCutoff = getLinearSearchCutoff<KeyType>())
+	{
+		const KeyType* ptrKeys = vtKeys.data();
+		const KeyType* ptrBase = ptrKeys;
+		size_t nCount = vtKeys.size();
+
+		while (nCount > nLinearSearchCutoff && nCount > 1)
+		{
+			size_t nHalf = nCount / 2;
+			ptrBase = (ptrBase[nHalf - 1] < key) ? ptrBase + nHalf : ptrBase;
+			nCount -= nHalf;
+		}
+
+		return (ptrBase - ptrKeys) + countLess<false>(ptrBase, nCount, key);
+	}
+
+	// Position of the first key that is greater than the given key (as std::upper_bound).
+	template <typename KeyArray, typename KeyType>
+	static inline size_t upperBound(const KeyArray& vtKeys, const KeyType& key, size_t nLinearSearchCutoff = getLinearSearchCutoff<KeyType>())
+	{
+		const KeyType* ptrKeys = vtKeys.data();
+		const KeyType* ptrBase = ptrKeys;
+		size_t nCount = vtKeys.size();
+
+		while (nCount > nLinearSearchCutoff && nCount > 1)
+		{
+			size_t nHalf = nCount / 2;
+			ptrBase = !(key < ptrBase[nHalf - 1]) ? ptrBase + nHalf : ptrBase;
+			nCount -= nHalf;
+		}
+
+		return (ptrBase - ptrKeys) + countLess<true>(ptrBase, nCount, key);
+	}
+
+	/*
+	 * Eytzinger layout: the keys are stored in the order of a breadth-first walk of the implicit binary search tree,
+	 * i.e. the children of slot k are 2k and 2k+1 (slot 0 is unused). The first levels of the tree share cache lines,
+	 * and the line holding the descendants a few levels down is prefetched while the current level is compared.
+	 * vtRanks maps a slot back to the position of its key in the sorted keys, slot 0 to the end.
+	 */
+	template <typename KeyArray, typename KeyType>
+	static inline void buildEytzinger(const KeyArray& vtKeys, std::vector<KeyType>& vtLayout, std::vector<size_t>& vtRanks)
+	{
+		vtLayout.resize(vtKeys.size() + 1);
+		vtRanks.resize(vtKeys.size() + 1);
+
+		size_t nRank = 0;
+		fillEytzinger(vtKeys, vtLayout, vtRanks, nRank, 1);
+
+		vtRanks[0] = vtKeys.size();
+	}
+
+	// Same result as upperBound over the keys the layout was built from.
+	template <typename KeyType>
+	static inline size_t upperBoundEytzinger(const std::vector<KeyType>& vtLayout, const std::vector<size_t>& vtRanks, const KeyType& key)
+	{
+		const KeyType* ptrLayout = vtLayout.data();
+		const size_t nSize = vtLayout.size();
+		const size_t nKeysPerLine = sizeof(KeyType) < 64 ? 64 / sizeof(KeyType) : 1;
+
+		size_t nIdx = 1;
+		while (nIdx < nSize)
+		{
+			prefetch(ptrLayout + nIdx * nKeysPerLine);
+			nIdx = 2 * nIdx + !(key < ptrLayout[nIdx]);
+		}
+
+		// Drop the right turns taken after the last left turn, the node where it was taken holds the upper bound.
+		nIdx >>= std::countr_one(nIdx) + 1;
+
+		return vtRanks[nIdx];
+	}
+
+	template <typename KeyType>
+	static inline size_t getLinearSearchCutoff()
+	{
+		return hasSIMDScan<KeyType>() ? SIMD_LINEAR_SEARCH_CUTOFF : LINEAR_SEARCH_CUTOFF;
+	}
+
+private:
+	template <typename KeyType>
+	static inline bool hasSIMDScan()
+	{
+#ifdef __KEY_SEARCH_AVX2__
+		if constexpr (std::is_integral<KeyType>::value && std::is_signed<KeyType>::value && (sizeof(KeyType) == 4 || sizeof(KeyType) == 8))
+		{
+			return s_bAVX2;
+		}
+#endif __KEY_SEARCH_AVX2__
+
+		return false;
+	}
+
+	template <typename KeyArray, typename KeyType>
+	static void fillEytzinger(const KeyArray& vtKeys, std::vector<KeyType>& vtLayout, std::vector<size_t>& vtRanks, size_t& nRank, size_t nIdx)
+	{
+		if (nIdx >= vtLayout.size())
+		{
+			return;
+		}
+
+		fillEytzinger(vtKeys, vtLayout, vtRanks, nRank, 2 * nIdx);
+
+		vtLayout[nIdx] = vtKeys[nRank];
+		vtRanks[nIdx] = nRank++;
+
+		fillEytzinger(vtKeys, vtLayout, vtRanks, nRank, 2 * nIdx + 1);
+	}
+
+	static inline void prefetch(const void* ptr)
+	{
+#if defined(_M_X64) || defined(__x86_64__)
+		_mm_prefetch(reinterpret_cast<const char*>(ptr), _MM_HINT_T0);
+#elif defined(__GNUC__)
+		__builtin_prefetch(ptr);
+#endif
+	}
+
+	// Number of keys less than (or, with bOrEqual, not greater than) the given key.
+	template <bool bOrEqual, typename KeyType>
+	static inline size_t countLess(const KeyType* ptrKeys, size_t nCount, const KeyType& key)
+	{
+#ifdef __KEY_SEARCH_AVX2__
+		if constexpr (std::is_integral<KeyType>::value && std::is_signed<KeyType>::value && (sizeof(KeyType) == 4 || sizeof(KeyType) == 8))
+		{
+			if (s_bAVX2 && nCount >= 32 / sizeof(KeyType))
+			{
+				return countLessAVX2<bOrEqual>(ptrKeys, nCount, key);
+			}
+		}
+#endif __KEY_SEARCH_AVX2__
+
+		size_t nIdx = 0;
+		for (size_t nCntr = 0; nCntr < nCount; nCntr++)
+		{
+			nIdx += bOrEqual ? !(key < ptrKeys[nCntr]) : (ptrKeys[nCntr] < key);
+		}
+		return nIdx;
+	}
+
+#ifdef __KEY_SEARCH_AVX2__
+	static inline bool hasAVX2()
+	{
+#ifdef _MSC_VER
+		int vtInfo[4];
+		__cpuid(vtInfo, 0);
+		if (vtInfo[0] < 7)
+		{
+			return false;
+		}
+
+		__cpuid(vtInfo, 1);
+		bool bOSXSave = (vtInfo[2] & (1 << 27)) != 0;
+
+		__cpuidex(vtInfo, 7, 0);
+		bool bAVX2 = (vtInfo[1] & (1 << 5)) != 0;
+
+		// The OS must save the ymm registers as well.
+		return bOSXSave && bAVX2 && (_xgetbv(0) & 6) == 6;
+#else // !_MSC_VER
+		return __builtin_cpu_supports("avx2");
+#endif _MSC_VER
+	}
+
+	static inline const bool s_bAVX2 = hasAVX2();
+
+	// The keys past the last full vector are compared one at a time.
+	template <bool bOrEqual, typename KeyType>
+	__AVX2_TARGET__ static size_t countLessAVX2(const KeyType* ptrKeys, size_t nCount, const KeyType& key)
+	{
+		const size_t nLanes = 32 / sizeof(KeyType);
+
+		size_t nGreater = 0;	// keys greater than (or, without bOrEqual, not less than) the key.
+		size_t nCntr = 0;
+
+		if constexpr (sizeof(KeyType) == 4)
+		{
+			__m256i vtKey = _mm256_set1_epi32(key);
+			for (; nCntr + nLanes <= nCount; nCntr += nLanes)
+			{
+				__m256i vtKeys = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptrKeys + nCntr));
+				__m256i vtMask = bOrEqual ? _mm256_cmpgt_epi32(vtKeys, vtKey) : _mm256_cmpgt_epi32(vtKey, vtKeys);
+				size_t nHits = std::popcount((unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(vtMask)));
+				nGreater += bOrEqual ? nHits : nLanes - nHits;
+			}
+		}
+		else
+		{
+			__m256i vtKey = _mm256_set1_epi64x(key);
+			for (; nCntr + nLanes <= nCount; nCntr += nLanes)
+			{
+				__m256i vtKeys = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptrKeys + nCntr));
+				__m256i vtMask = bOrEqual ? _mm256_cmpgt_epi64(vtKeys, vtKey) : _mm256_cmpgt_epi64(vtKey, vtKeys);
+				size_t nHits = std::popcount((unsigned int)_mm256_movemask_pd(_mm256_castsi256_pd(vtMask)));
+				nGreater += bOrEqual ? nHits : nLanes - nHits;
+			}
+		}
+
+		size_t nIdx = nCntr - nGreater;
+		for (; nCntr < nCount; nCntr++)
+		{
+			nIdx += bOrEqual ? !(key < ptrKeys[nCntr]) : (ptrKeys[nCntr] < key);
+		}
+		return nIdx;
+	}
+#endif __KEY_SEARCH_AVX2__
+};
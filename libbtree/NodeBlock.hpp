@@ -0,0 +1,282 @@
+#pragma once
+#include <new>
+#include <memory>
+#include <iterator>
+#include <algorithm>
+#include <exception>
+
+// Every array of a node starts on a cache line of its own.
+#define NODE_BLOCK_ALIGNMENT 64
+
+class NodeBlock;
+
+/*
+ * The part of the std::vector interface the nodes use, over memory owned by the node's NodeBlock so that all the
+ * arrays of a node share one allocation. An array never allocates itself, the node reserves room for the entries
+ * it is about to add and the array only checks that it got it.
+ */
+template <typename T>
+class NodeArray
+{
+	friend class NodeBlock;
+
+public:
+	typedef T value_type;
+	typedef T* iterator;
+	typedef const T* const_iterator;
+
+private:
+	T* m_ptrItems = nullptr;
+	size_t m_nSize = 0;
+	size_t m_nCapacity = 0;
+
+public:
+	NodeArray() = default;
+	NodeArray(const NodeArray&) = delete;
+	NodeArray& operator=(const NodeArray&) = delete;
+
+	~NodeArray()
+	{
+		std::destroy_n(m_ptrItems, m_nSize);
+	}
+
+	inline size_t size() const
+	{
+		return m_nSize;
+	}
+
+	inline size_t capacity() const
+	{
+		return m_nCapacity;
+	}
+
+	inline bool empty() const
+	{
+		return m_nSize == 0;
+	}
+
+	inline T* data()
+	{
+		return m_ptrItems;
+	}
+
+	inline const T* data() const
+	{
+		return m_ptrItems;
+	}
+
+	inline iterator begin()
+	{
+		return m_ptrItems;
+	}
+
+	inline const_iterator begin() const
+	{
+		return m_ptrItems;
+	}
+
+	inline iterator end()
+	{
+		return m_ptrItems + m_nSize;
+	}
+
+	inline const_iterator end() const
+	{
+		return m_ptrItems + m_nSize;
+	}
+
+	inline T& operator[](size_t nIdx)
+	{
+		return m_ptrItems[nIdx];
+	}
+
+	inline const T& operator[](size_t nIdx) const
+	{
+		return m_ptrItems[nIdx];
+	}
+
+	inline T& front()
+	{
+		return m_ptrItems[0];
+	}
+
+	inline T& back()
+	{
+		return m_ptrItems[m_nSize - 1];
+	}
+
+	inline void push_back(const T& item)
+	{
+		checkCapacity(m_nSize + 1);
+
+		new (m_ptrItems + m_nSize) T(item);
+		m_nSize++;
+	}
+
+	inline void pop_back()
+	{
+		m_nSize--;
+		std::destroy_at(m_ptrItems + m_nSize);
+	}
+
+	inline iterator insert(const_iterator itPos, const T& item)
+	{
+		size_t nIdx = itPos - m_ptrItems;
+
+		checkCapacity(m_nSize + 1);
+
+		if (nIdx == m_nSize)
+		{
+			new (m_ptrItems + m_nSize) T(item);
+		}
+		else
+		{
+			T copy(item);	// the item may live in this array.
+
+			new (m_ptrItems + m_nSize) T(std::move(m_ptrItems[m_nSize - 1]));
+			std::move_backward(m_ptrItems + nIdx, m_ptrItems + m_nSize - 1, m_ptrItems + m_nSize);
+			m_ptrItems[nIdx] = std::move(copy);
+		}
+
+		m_nSize++;
+
+		return m_ptrItems + nIdx;
+	}
+
+	// The range must not come from this array.
+	template <typename InputIterator>
+	inline iterator insert(const_iterator itPos, InputIterator itBegin, InputIterator itEnd)
+	{
+		size_t nIdx = itPos - m_ptrItems;
+		size_t nCount = std::distance(itBegin, itEnd);
+
+		checkCapacity(m_nSize + nCount);
+
+		std::uninitialized_copy(itBegin, itEnd, m_ptrItems + m_nSize);
+		m_nSize += nCount;
+
+		std::rotate(m_ptrItems + nIdx, m_ptrItems + m_nSize - nCount, m_ptrItems + m_nSize);
+
+		return m_ptrItems + nIdx;
+	}
+
+	inline iterator erase(const_iterator itPos)
+	{
+		size_t nIdx = itPos - m_ptrItems;
+
+		std::move(m_ptrItems + nIdx + 1, m_ptrItems + m_nSize, m_ptrItems + nIdx);
+		pop_back();
+
+		return m_ptrItems + nIdx;
+	}
+
+	inline void resize(size_t nSize)
+	{
+		if (nSize < m_nSize)
+		{
+			std::destroy_n(m_ptrItems + nSize, m_nSize - nSize);
+		}
+		else
+		{
+			checkCapacity(nSize);
+			std::uninitialized_value_construct_n(m_ptrItems + m_nSize, nSize - m_nSize);
+		}
+
+		m_nSize = nSize;
+	}
+
+	template <typename InputIterator>
+	inline void assign(InputIterator itBegin, InputIterator itEnd)
+	{
+		clear();
+		insert(end(), itBegin, itEnd);
+	}
+
+	inline void clear()
+	{
+		resize(0);
+	}
+
+private:
+	inline void checkCapacity(size_t nSize)
+	{
+		if (nSize > m_nCapacity)
+		{
+			throw new std::exception("should not occur!"); // the node did not reserve the room.
+		}
+	}
+};
+
+/*
+ * The single cache-line-aligned allocation behind the NodeArrays of a node, the node's data struct derives from it
+ * and passes its arrays to reserve(). Every array gets room for the same number of items, the arrays are laid out
+ * one after the other in the given order.
+ */
+class NodeBlock
+{
+private:
+	char* m_ptrBlock = nullptr;
+	size_t m_nCapacity = 0;
+
+public:
+	NodeBlock() = default;
+	NodeBlock(const NodeBlock&) = delete;
+	NodeBlock& operator=(const NodeBlock&) = delete;
+
+	~NodeBlock()
+	{
+		// The arrays, being members of the derived struct, have destroyed their items by now.
+		::operator delete(m_ptrBlock, std::align_val_t(NODE_BLOCK_ALIGNMENT));
+	}
+
+	inline size_t capacity() const
+	{
+		return m_nCapacity;
+	}
+
+	// Makes room for nCapacity items per array. A larger block at least doubles the capacity, so that a node that
+	// grows one entry at a time moves its arrays only a few times.
+	template <typename... ArrayTypes>
+	inline void reserve(size_t nCapacity, ArrayTypes&... vtArrays)
+	{
+		if (nCapacity <= m_nCapacity)
+		{
+			return;
+		}
+
+		nCapacity = std::max(nCapacity, m_nCapacity * 2);
+
+		size_t nBlockSize = (getArraySize<typename ArrayTypes::value_type>(nCapacity) + ...);
+
+		char* ptrBlock = static_cast<char*>(::operator new(nBlockSize, std::align_val_t(NODE_BLOCK_ALIGNMENT)));
+
+		size_t nOffset = 0;
+		(relocate(vtArrays, ptrBlock, nOffset, nCapacity), ...);
+
+		::operator delete(m_ptrBlock, std::align_val_t(NODE_BLOCK_ALIGNMENT));
+
+		m_ptrBlock = ptrBlock;
+		m_nCapacity = nCapacity;
+	}
+
+private:
+	template <typename T>
+	static inline size_t getArraySize(size_t nCapacity)
+	{
+		return (nCapacity * sizeof(T) + NODE_BLOCK_ALIGNMENT - 1) / NODE_BLOCK_ALIGNMENT * NODE_BLOCK_ALIGNMENT;
+	}
+
+	template <typename T>
+	static inline void relocate(NodeArray<T>& vtArray, char* ptrBlock, size_t& nOffset, size_t nCapacity)
+	{
+		T* ptrItems = reinterpret_cast<T*>(ptrBlock + nOffset);
+
+		std::uninitialized_move_n(vtArray.m_ptrItems, vtArray.m_nSize, ptrItems);
+		std::destroy_n(vtArray.m_ptrItems, vtArray.m_nSize);
+
+		vtArray.m_ptrItems = ptrItems;
+		vtArray.m_nCapacity = nCapacity;
+
+		nOffset += getArraySize<T>(nCapacity);
+	}
+};
@@ -6,4 +6,6 @@ enum TYPE_UID
 
 	DATA_NODE_STRING_STRING = 3,
 	INDEX_NODE_STRING_STRING = 4,
+
+	INDEX_NODE_WITH_BUFFER_INT_INT = 5,
 };
\ No newline at end of file
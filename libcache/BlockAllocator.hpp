@@ -0,0 +1,172 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <iterator>
+#include <mutex>
+#include <cstdint>
+#include <exception>
+
+/*
+ * Hands out runs of consecutive blocks of a file. Freed runs are merged with free neighbours and kept by start, an
+ * allocation takes the lowest free run that fits (splitting off the rest) so that rewritten objects drift towards the
+ * front of the file and the tail can be given back. Only when no free run fits is the file extended past the highest
+ * block in use so far.
+ * The bitmap tells which blocks are in use and catches double frees.
+ */
+class BlockAllocator
+{
+private:
+	std::vector<bool> m_vtAllocationTable;
+	size_t m_nNextBlock;	// the blocks from here on have never been used.
+
+	std::map<size_t, size_t> m_mpFreeRuns;		// start -> length.
+	size_t m_nFreeBlocks;
+
+	std::mutex m_mtxAllocator;
+
+public:
+	BlockAllocator(size_t nBlocks)
+		: m_nNextBlock(0)
+		, m_nFreeBlocks(0)
+	{
+		m_vtAllocationTable.resize(nBlocks, false);
+	}
+
+	// The first of nBlocks consecutive blocks.
+	size_t allocate(size_t nBlocks)
+	{
+		std::unique_lock<std::mutex> lock_allocator(m_mtxAllocator);
+
+		size_t nStart;
+
+		auto itFit = m_mpFreeRuns.begin();
+		while (itFit != m_mpFreeRuns.end() && (*itFit).second < nBlocks)
+		{
+			itFit++;
+		}
+
+		if (itFit != m_mpFreeRuns.end())
+		{
+			nStart = (*itFit).first;
+			size_t nLength = (*itFit).second;
+
+			removeFreeRun(nStart, nLength);
+
+			if (nLength > nBlocks)
+			{
+				addFreeRun(nStart + nBlocks, nLength - nBlocks);
+			}
+		}
+		else
+		{
+			if (m_nNextBlock + nBlocks > m_vtAllocationTable.size())
+			{
+				throw new std::exception("should not occur!");   // TODO: critical log.
+			}
+
+			nStart = m_nNextBlock;
+			m_nNextBlock += nBlocks;
+		}
+
+		for (size_t idx = nStart; idx < nStart + nBlocks; idx++)
+		{
+			m_vtAllocationTable[idx] = true;
+		}
+
+		return nStart;
+	}
+
+	void free(size_t nStart, size_t nBlocks)
+	{
+		std::unique_lock<std::mutex> lock_allocator(m_mtxAllocator);
+
+		for (size_t idx = nStart; idx < nStart + nBlocks; idx++)
+		{
+			if (!m_vtAllocationTable[idx])
+			{
+				throw new std::exception("should not occur!");
+			}
+			m_vtAllocationTable[idx] = false;
+		}
+
+		// Merge with the free runs right before and after.
+		auto itNext = m_mpFreeRuns.lower_bound(nStart);
+		if (itNext != m_mpFreeRuns.begin())
+		{
+			auto itPrev = std::prev(itNext);
+			if ((*itPrev).first + (*itPrev).second == nStart)
+			{
+				nStart = (*itPrev).first;
+				nBlocks += (*itPrev).second;
+
+				removeFreeRun((*itPrev).first, (*itPrev).second);
+			}
+		}
+
+		itNext = m_mpFreeRuns.lower_bound(nStart + nBlocks);
+		if (itNext != m_mpFreeRuns.end() && (*itNext).first == nStart + nBlocks)
+		{
+			nBlocks += (*itNext).second;
+
+			removeFreeRun((*itNext).first, (*itNext).second);
+		}
+
+		// A run that reaches the unused end of the file goes back to it.
+		if (nStart + nBlocks == m_nNextBlock)
+		{
+			m_nNextBlock = nStart;
+			return;
+		}
+
+		addFreeRun(nStart, nBlocks);
+	}
+
+	// Whether the run lies past where the blocks in use would end if they were packed, and a free run further down can
+	// take it, i.e. whether moving it helps to shrink the part of the file in use.
+	bool isRelocatable(size_t nStart, size_t nBlocks)
+	{
+		std::unique_lock<std::mutex> lock_allocator(m_mtxAllocator);
+
+		if (nStart + nBlocks <= m_nNextBlock - m_nFreeBlocks)
+		{
+			return false;
+		}
+
+		for (auto it = m_mpFreeRuns.begin(); it != m_mpFreeRuns.end() && (*it).first < nStart; it++)
+		{
+			if ((*it).second >= nBlocks)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// The blocks up to the end of the highest run in use.
+	inline size_t getUsedBlocks()
+	{
+		std::unique_lock<std::mutex> lock_allocator(m_mtxAllocator);
+		return m_nNextBlock;
+	}
+
+	// The blocks below getUsedBlocks that are free.
+	inline size_t getFreeBlocks()
+	{
+		std::unique_lock<std::mutex> lock_allocator(m_mtxAllocator);
+		return m_nFreeBlocks;
+	}
+
+private:
+	inline void addFreeRun(size_t nStart, size_t nLength)
+	{
+		m_mpFreeRuns[nStart] = nLength;
+		m_nFreeBlocks += nLength;
+	}
+
+	inline void removeFreeRun(size_t nStart, size_t nLength)
+	{
+		m_mpFreeRuns.erase(nStart);
+		m_nFreeBlocks -= nLength;
+	}
+};
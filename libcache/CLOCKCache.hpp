@@ -0,0 +1,841 @@
+#pragma once
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <syncstream>
+#include <thread>
+#include <variant>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <atomic>
+#include <tuple>
+
+#include "ErrorCodes.h"
+#include "IFlushCallback.h"
+#include "VariadicNthType.h"
+
+#define __CONCURRENT__
+//#define __TREE_AWARE_CACHE__
+
+#define FLUSH_COUNT 100
+
+/*
+ * Same interface as LRUCache, but the objects sit in the slots of a ring instead of a linked list. A hit only sets the
+ * item's reference bit, hence lookups share the cache's lock and do not write anything else. The flush moves a hand
+ * over the ring: a referenced item loses its bit and stays, an item that was not referenced since the hand last
+ * passed it is evicted.
+ * The ring carries no recency order, so an object is evicted only once none of the objects it refers to (as reported
+ * by getChildUIDs) is left in the cache; a node still leaves the cache before its parent.
+ */
+template <typename ICallback, typename StorageType>
+class CLOCKCache : public ICallback
+{
+	typedef CLOCKCache<ICallback, StorageType> SelfType;
+
+public:
+	typedef StorageType::ObjectUIDType ObjectUIDType;
+	typedef StorageType::ObjectType ObjectType;
+	typedef std::shared_ptr<ObjectType> ObjectTypePtr;
+
+private:
+	struct Item
+	{
+	public:
+		ObjectUIDType m_uidSelf;
+		ObjectTypePtr m_ptrObject;
+		std::atomic<bool> m_bReferenced;
+		size_t m_nSlot;
+		size_t m_nEpoch;
+
+		Item(const ObjectUIDType& key, const ObjectTypePtr ptrObject)
+			: m_bReferenced(true)
+			, m_nSlot(0)
+			, m_nEpoch(0)
+		{
+			m_uidSelf = key;
+			m_ptrObject = ptrObject;
+		}
+
+		~Item()
+		{
+			m_ptrObject = nullptr;
+		}
+	};
+
+	ICallback* m_ptrCallback;
+
+	std::vector<std::shared_ptr<Item>> m_vtClock;
+	std::vector<size_t> m_vtFreeSlots;
+	size_t m_nHand;
+
+	// Number of calls to reorder, i.e. of operations the store has completed.
+	size_t m_nEpoch;
+
+	std::vector<ObjectUIDType> m_vtChildUIDs;	// scratch space for the flush.
+
+	std::unique_ptr<StorageType> m_ptrStorage;
+
+	size_t m_nCacheCapacity;
+	std::unordered_map<ObjectUIDType, std::shared_ptr<Item>> m_mpObjects;
+
+	std::unordered_map<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, ObjectTypePtr>> m_mpUpdatedUIDs;
+
+	// The UIDs the objects had before they were flushed, their parents refer to the new ones by now. They are handed
+	// back to the storage a flush after they were retired.
+	std::vector<ObjectUIDType> m_vtRetiredUIDs;
+	std::vector<ObjectUIDType> m_vtReleasableUIDs;
+	std::vector<ObjectUIDType> m_vtAppliedUIDs;	// flushed along with their parents, no reader has to look them up.
+
+#ifdef __CONCURRENT__
+	bool m_bStop;
+
+	std::thread m_threadCacheFlush;
+
+	std::condition_variable_any cv;
+
+	mutable std::shared_mutex m_mtxCache;
+	mutable std::shared_mutex m_mtxStorage;
+#endif __CONCURRENT__
+
+public:
+	~CLOCKCache()
+	{
+#ifdef __CONCURRENT__
+		m_bStop = true;
+		m_threadCacheFlush.join();
+#endif __CONCURRENT__
+
+		m_vtClock.clear();
+		m_vtFreeSlots.clear();
+		m_ptrStorage = nullptr;
+
+		m_mpObjects.clear();
+	}
+
+	template <typename... StorageArgs>
+	CLOCKCache(size_t nCapacity, StorageArgs... args)
+		: m_nCacheCapacity(nCapacity)
+		, m_nHand(0)
+		, m_nEpoch(0)
+	{
+		m_ptrStorage = std::make_unique<StorageType>(args...);
+
+#ifdef __CONCURRENT__
+		m_bStop = false;
+		m_threadCacheFlush = std::thread(handlerCacheFlush, this);
+#endif __CONCURRENT__
+	}
+
+	template <typename... InitArgs>
+	CacheErrorCode init(ICallback* ptrCallback, InitArgs... args)
+	{
+		m_ptrCallback = ptrCallback;
+		return m_ptrStorage->init(this/*getNthElement<0>(args...)*/);
+	}
+
+	CacheErrorCode remove(const ObjectUIDType& uidObject)
+	{
+		CacheErrorCode errCode = CacheErrorCode::Error;
+
+#ifdef __CONCURRENT__
+		std::unique_lock<std::shared_mutex>  lock_cache(m_mtxCache);
+#endif __CONCURRENT__
+
+		auto it = m_mpObjects.find(uidObject);
+		if (it != m_mpObjects.end())
+		{
+			removeFromClock((*it).second);
+			m_mpObjects.erase((*it).first);
+			errCode = CacheErrorCode::Success;
+		}
+
+#ifdef __CONCURRENT__
+		lock_cache.unlock();
+
+		std::unique_lock<std::shared_mutex> lock_storage(m_mtxStorage);
+#endif __CONCURRENT__
+
+		// The object may have been flushed already, its parent just did not pick up the new UID yet.
+		auto itUpdated = m_mpUpdatedUIDs.find(uidObject);
+		if (itUpdated != m_mpUpdatedUIDs.end())
+		{
+			if ((*itUpdated).second.first != std::nullopt)
+			{
+				m_ptrStorage->remove(*(*itUpdated).second.first);
+			}
+
+			m_mpUpdatedUIDs.erase(itUpdated);
+		}
+
+		if (m_ptrStorage->remove(uidObject) == CacheErrorCode::Success)
+		{
+			errCode = CacheErrorCode::Success;
+		}
+
+		return errCode;
+	}
+
+	CacheErrorCode getObject(const ObjectUIDType uidObject, ObjectTypePtr & ptrObject, std::optional<ObjectUIDType>& uidUpdated)
+	{
+#ifdef __CONCURRENT__
+		std::shared_lock<std::shared_mutex> lock_cache(m_mtxCache);
+#endif __CONCURRENT__
+
+		auto it = m_mpObjects.find(uidObject);
+		if (it != m_mpObjects.end())
+		{
+			setReferenced((*it).second);
+			ptrObject = (*it).second->m_ptrObject;
+			return CacheErrorCode::Success;
+		}
+
+#ifdef __CONCURRENT__
+		std::unique_lock<std::shared_mutex> lock_storage(m_mtxStorage); // TODO: requesting the same key?
+		lock_cache.unlock();
+#endif __CONCURRENT__
+
+		ObjectUIDType _uidUpdated = uidObject;
+		if (m_mpUpdatedUIDs.find(uidObject) != m_mpUpdatedUIDs.end())
+		{
+
+#ifdef __CONCURRENT__
+			std::optional< ObjectUIDType >& _condition = m_mpUpdatedUIDs[uidObject].first;
+			cv.wait(lock_storage, [&_condition] { return _condition != std::nullopt; });
+#endif __CONCURRENT__
+
+			uidUpdated = m_mpUpdatedUIDs[uidObject].first;
+
+			assert(uidUpdated != std::nullopt);
+
+			m_mpUpdatedUIDs.erase(uidObject);	// Applied.
+			m_vtRetiredUIDs.push_back(uidObject);
+			_uidUpdated = *uidUpdated;
+		}
+
+#ifdef __CONCURRENT__
+		lock_storage.unlock();
+#endif __CONCURRENT__
+
+		std::shared_ptr<ObjectType> _ptrObject = m_ptrStorage->getObject(_uidUpdated);
+
+		if (_ptrObject != nullptr)
+		{
+			std::shared_ptr<Item> ptrItem = std::make_shared<Item>(_uidUpdated, _ptrObject);
+
+#ifdef __CONCURRENT__
+			std::unique_lock<std::shared_mutex> re_lock_cache(m_mtxCache);
+
+			if (m_mpObjects.find(_uidUpdated) != m_mpObjects.end())
+			{
+				std::shared_ptr<Item> ptrItem = m_mpObjects[_uidUpdated];
+				setReferenced(ptrItem);
+				ptrObject = ptrItem->m_ptrObject;
+				return CacheErrorCode::Success;
+			}
+#endif __CONCURRENT__
+
+			m_mpObjects[_uidUpdated] = ptrItem;
+
+			addToClock(ptrItem);
+
+			ptrObject = _ptrObject;
+
+#ifndef __CONCURRENT__
+			flushItemsToStorage();
+#endif __CONCURRENT__
+
+			return CacheErrorCode::Success;
+		}
+
+		return CacheErrorCode::Error;
+	}
+
+	CacheErrorCode reorder(std::vector<std::pair<ObjectUIDType, ObjectTypePtr>>& vt, bool ensure = true)
+	{
+#ifdef __CONCURRENT__
+		std::shared_lock<std::shared_mutex> lock_cache(m_mtxCache);
+#endif __CONCURRENT__
+
+		while (vt.size() > 0)
+		{
+			std::pair<ObjectUIDType, ObjectTypePtr> prNode = vt.back();
+
+			auto it = m_mpObjects.find(prNode.first);
+			if (it != m_mpObjects.end())
+			{
+				setReferenced((*it).second);
+			}
+			else
+			{
+				if (ensure)
+				{
+					throw new std::exception("should not occur!");
+				}
+			}
+
+			vt.pop_back();
+		}
+
+#ifndef __CONCURRENT__
+		m_nEpoch++;
+#endif __CONCURRENT__
+
+		return CacheErrorCode::Success;
+	}
+
+	template <typename Type>
+	CacheErrorCode getObjectOfType(const ObjectUIDType key, Type& ptrObject, std::optional<ObjectUIDType>& uidUpdated)
+	{
+#ifdef __CONCURRENT__
+		std::unique_lock<std::shared_mutex> lock_cache(m_mtxCache);	// the object is marked dirty.
+#endif __CONCURRENT__
+
+		auto it = m_mpObjects.find(key);
+		if (it != m_mpObjects.end())
+		{
+			std::shared_ptr<Item> ptrItem = (*it).second;
+
+			setReferenced(ptrItem);
+
+			ptrItem->m_ptrObject->dirty = true; //todo fix it later..
+
+			if (std::holds_alternative<Type>(*ptrItem->m_ptrObject->data))
+			{
+				ptrObject = std::get<Type>(*ptrItem->m_ptrObject->data);
+				return CacheErrorCode::Success;
+			}
+
+			return CacheErrorCode::Error;
+		}
+
+#ifdef __CONCURRENT__
+		std::unique_lock<std::shared_mutex> lock_storage(m_mtxStorage);
+		lock_cache.unlock();
+#endif __CONCURRENT__
+
+		ObjectUIDType _uidUpdated = key;
+		if (m_mpUpdatedUIDs.find(key) != m_mpUpdatedUIDs.end())
+		{
+#ifdef __CONCURRENT__
+			std::optional< ObjectUIDType >& _condition = m_mpUpdatedUIDs[key].first;
+			cv.wait(lock_storage, [&_condition] { return _condition != std::nullopt; });
+#endif __CONCURRENT__
+
+			uidUpdated = m_mpUpdatedUIDs[key].first;
+
+			assert(uidUpdated != std::nullopt);
+
+			m_mpUpdatedUIDs.erase(key);	// Applied.
+			m_vtRetiredUIDs.push_back(key);
+			_uidUpdated = *uidUpdated;
+		}
+
+#ifdef __CONCURRENT__
+		lock_storage.unlock();
+#endif __CONCURRENT__
+
+		std::shared_ptr<ObjectType> ptrValue = m_ptrStorage->getObject(_uidUpdated);
+
+		if (ptrValue != nullptr)
+		{
+			std::shared_ptr<Item> ptrItem = std::make_shared<Item>(_uidUpdated, ptrValue);
+
+			ptrValue->dirty = true; //todo fix it later..
+
+#ifdef __CONCURRENT__
+			std::unique_lock<std::shared_mutex> re_lock_cache(m_mtxCache);
+
+			if (m_mpObjects.find(_uidUpdated) != m_mpObjects.end())
+			{
+				std::shared_ptr<Item> ptrItem = m_mpObjects[_uidUpdated];
+				setReferenced(ptrItem);
+
+				if (std::holds_alternative<Type>(*ptrItem->m_ptrObject->data))
+				{
+					ptrObject = std::get<Type>(*ptrItem->m_ptrObject->data);
+					return CacheErrorCode::Success;
+				}
+
+				return CacheErrorCode::Error;
+			}
+#endif __CONCURRENT__
+
+			m_mpObjects[_uidUpdated] = ptrItem;
+
+			addToClock(ptrItem);
+
+			if (std::holds_alternative<Type>(*ptrValue->data))
+			{
+				ptrObject = std::get<Type>(*ptrValue->data);
+				return CacheErrorCode::Success;
+			}
+
+#ifndef __CONCURRENT__
+			flushItemsToStorage();
+#endif __CONCURRENT__
+
+			return CacheErrorCode::Error;
+		}
+
+		return CacheErrorCode::Error;
+	}
+
+	template<class Type, typename... ArgsType>
+	CacheErrorCode createObjectOfType(std::optional<ObjectUIDType>& uidObject, const ArgsType... args)
+	{
+		std::shared_ptr<ObjectType> ptrObject = std::make_shared<ObjectType>(std::make_shared<Type>(args...));
+
+		uidObject = ObjectUIDType::createAddressFromVolatilePointer(reinterpret_cast<uintptr_t>(ptrObject.get()));
+
+		std::shared_ptr<Item> ptrItem = std::make_shared<Item>(*uidObject, ptrObject);
+
+#ifdef __CONCURRENT__
+		std::unique_lock<std::shared_mutex> lock_cache(m_mtxCache);
+#endif __CONCURRENT__
+
+		if (m_mpObjects.find(*uidObject) != m_mpObjects.end())
+		{
+			std::shared_ptr<Item> ptrItem = m_mpObjects[*uidObject];
+			ptrItem->m_ptrObject = ptrObject;
+			setReferenced(ptrItem);
+		}
+		else
+		{
+			m_mpObjects[*uidObject] = ptrItem;
+			addToClock(ptrItem);
+		}
+
+#ifdef __CONCURRENT__
+		//..
+#else
+		flushItemsToStorage();
+#endif __CONCURRENT__
+
+		return CacheErrorCode::Success;
+	}
+
+	template<class Type, typename... ArgsType>
+	CacheErrorCode createObjectOfType(std::optional<ObjectUIDType>& uidObject, std::shared_ptr<Type>& ptrCoreObject, const ArgsType... args)
+	{
+		std::shared_ptr<ObjectType> ptrObject = std::make_shared<ObjectType>(std::make_shared<Type>(args...));
+
+		ptrCoreObject = ptrObject->data;
+
+		uidObject = ObjectUIDType::createAddressFromVolatilePointer(reinterpret_cast<uintptr_t>(ptrObject.get()));
+
+		std::shared_ptr<Item> ptrItem = std::make_shared<Item>(*uidObject, ptrObject);
+
+#ifdef __CONCURRENT__
+		std::unique_lock<std::shared_mutex> lock_cache(m_mtxCache);
+#endif __CONCURRENT__
+
+		if (m_mpObjects.find(*uidObject) != m_mpObjects.end())
+		{
+			std::shared_ptr<Item> ptrItem = m_mpObjects[*uidObject];
+			ptrItem->m_ptrObject = ptrObject;
+			setReferenced(ptrItem);
+		}
+		else
+		{
+			m_mpObjects[*uidObject] = ptrItem;
+			addToClock(ptrItem);
+		}
+
+#ifdef __CONCURRENT__
+		//..
+#else
+		flushItemsToStorage();
+#endif __CONCURRENT__
+
+		return CacheErrorCode::Success;
+	}
+
+	void getCacheState(size_t& lru, size_t& map)
+	{
+#ifdef __CONCURRENT__
+		std::shared_lock<std::shared_mutex> lock_cache(m_mtxCache);
+#endif __CONCURRENT__
+
+		lru = m_vtClock.size() - m_vtFreeSlots.size();
+		map = m_mpObjects.size();
+	}
+
+	// Whether writing the object out again would move it towards the front of the storage, the stores use it to
+	// compact the storage online.
+	inline bool isRelocatable(const ObjectUIDType& uidObject)
+	{
+		return m_ptrStorage->isRelocatable(uidObject);
+	}
+
+	inline double getStorageFragmentation()
+	{
+		return m_ptrStorage->getFragmentation();
+	}
+
+	inline size_t getStorageUsedSize()
+	{
+		return m_ptrStorage->getUsedSize();
+	}
+
+private:
+	// Writes the bit only when it is not set yet, so that hits on a hot item do not keep bouncing its cache line.
+	inline void setReferenced(const std::shared_ptr<Item>& ptrItem)
+	{
+		if (!ptrItem->m_bReferenced.load(std::memory_order_relaxed))
+		{
+			ptrItem->m_bReferenced.store(true, std::memory_order_relaxed);
+		}
+	}
+
+	inline void addToClock(std::shared_ptr<Item> ptrItem)
+	{
+		ptrItem->m_nEpoch = m_nEpoch;
+
+		if (m_vtFreeSlots.size() > 0)
+		{
+			ptrItem->m_nSlot = m_vtFreeSlots.back();
+			m_vtFreeSlots.pop_back();
+
+			m_vtClock[ptrItem->m_nSlot] = ptrItem;
+		}
+		else
+		{
+			ptrItem->m_nSlot = m_vtClock.size();
+			m_vtClock.push_back(ptrItem);
+
+			// The new item goes right behind the hand, i.e. the hand reaches it last. The item it takes the place of
+			// was passed just now and moves to the end.
+			if (m_nHand > 0 && m_nHand <= ptrItem->m_nSlot)
+			{
+				std::swap(m_vtClock[m_nHand - 1], m_vtClock[ptrItem->m_nSlot]);
+
+				m_vtClock[ptrItem->m_nSlot]->m_nSlot = ptrItem->m_nSlot;
+				ptrItem->m_nSlot = m_nHand - 1;
+			}
+		}
+	}
+
+	inline void removeFromClock(std::shared_ptr<Item> ptrItem)
+	{
+		m_vtClock[ptrItem->m_nSlot] = nullptr;
+		m_vtFreeSlots.push_back(ptrItem->m_nSlot);
+	}
+
+	// An object that is in use or still refers to cached objects is passed over, but keeps its (cleared) bit.
+	inline bool isEvictable(std::shared_ptr<Item> ptrItem)
+	{
+		if (ptrItem->m_ptrObject.use_count() > 1)
+		{
+			return false;
+		}
+
+#ifndef __CONCURRENT__
+		// The flush runs within the operation, whose new nodes are known to it only by their UIDs until the operation
+		// ends with reorder. The flush thread instead takes two runs, 100ms apart, to clear an item and evict it.
+		if (ptrItem->m_nEpoch == m_nEpoch)
+		{
+			return false;
+		}
+#endif __CONCURRENT__
+
+#ifdef __CONCURRENT__
+		// Check if the object is in use
+		if (!ptrItem->m_ptrObject->mutex.try_lock())
+		{
+			return false;
+		}
+		else
+		{
+			ptrItem->m_ptrObject->mutex.unlock();
+		}
+#endif __CONCURRENT__
+
+		m_ptrCallback->getChildUIDs(ptrItem->m_ptrObject, m_vtChildUIDs);
+
+		auto it = m_vtChildUIDs.begin();
+		while (it != m_vtChildUIDs.end())
+		{
+			if (m_mpObjects.find(*it) != m_mpObjects.end())
+			{
+				return false;
+			}
+			it++;
+		}
+
+		return true;
+	}
+
+	// Moves the hand to the next item to evict and takes it out of the ring, nullptr once the hand has taken nSteps
+	// steps. A flush moves the hand by at most one round, so an item is not cleared and evicted by the same flush.
+	inline std::shared_ptr<Item> evictNext(size_t& nSteps)
+	{
+		for (; nSteps > 0; nSteps--)
+		{
+			if (m_nHand >= m_vtClock.size())
+			{
+				m_nHand = 0;
+			}
+
+			std::shared_ptr<Item> ptrItem = m_vtClock[m_nHand++];
+
+			if (ptrItem == nullptr)
+			{
+				continue;
+			}
+
+			if (ptrItem->m_bReferenced.load(std::memory_order_relaxed))
+			{
+				ptrItem->m_bReferenced.store(false, std::memory_order_relaxed);
+				continue;
+			}
+
+			if (!isEvictable(ptrItem))
+			{
+				continue;
+			}
+
+			removeFromClock(ptrItem);
+			m_mpObjects.erase(ptrItem->m_uidSelf);
+
+			nSteps--;
+
+			return ptrItem;
+		}
+
+		return nullptr;
+	}
+
+	inline void flushItemsToStorage()
+	{
+#ifdef __CONCURRENT__
+		std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>> vtObjects;
+
+		std::unique_lock<std::shared_mutex> lock_cache(m_mtxCache);
+
+		if (m_mpObjects.size() < m_nCacheCapacity)
+			return;
+
+		size_t nFlushCount = m_mpObjects.size() - m_nCacheCapacity;
+
+		if (nFlushCount > FLUSH_COUNT)
+			nFlushCount = FLUSH_COUNT;
+
+		size_t nSteps = m_vtClock.size();
+
+		for (size_t idx = 0; idx < nFlushCount; idx++)
+		{
+			std::shared_ptr<Item> ptrItemToFlush = evictNext(nSteps);
+
+			if (ptrItemToFlush == nullptr)
+			{
+				break;
+			}
+
+			// The children of an object precede it, see prepareFlush.
+			vtObjects.push_back(std::make_pair(ptrItemToFlush->m_uidSelf, std::make_pair(std::nullopt, ptrItemToFlush->m_ptrObject)));
+		}
+
+		std::unique_lock<std::shared_mutex> lock_storage(m_mtxStorage);
+
+		lock_cache.unlock();
+
+		releaseRetiredUIDs();
+
+		if (m_mpUpdatedUIDs.size() > 0)
+		{
+			for (auto& prObject : vtObjects)
+			{
+				retireAppliedUIDs(prObject.second.second);
+			}
+
+			m_ptrCallback->applyExistingUpdates(vtObjects, m_mpUpdatedUIDs);
+		}
+
+		// The storage hands out the blocks, freed ones included.
+		m_ptrCallback->prepareFlush(vtObjects, [this](size_t nBlocks) { return m_ptrStorage->allocate(nBlocks); }, m_ptrStorage->getBlockSize(), m_ptrStorage->getMediaType());
+
+		// The objects flushed along with their parents are referred to by the new UIDs already.
+		std::unordered_set<ObjectUIDType> stAppliedUIDs;
+		for (auto& prObject : vtObjects)
+		{
+			m_ptrCallback->getChildUIDs(prObject.second.second, m_vtChildUIDs);
+			stAppliedUIDs.insert(m_vtChildUIDs.begin(), m_vtChildUIDs.end());
+		}
+
+		auto it = vtObjects.begin();
+		while (it != vtObjects.end())
+		{
+			if ((*it).second.second.use_count() != 1)
+			{
+				throw new std::exception("should not occur!");
+			}
+
+			if (m_mpUpdatedUIDs.find((*it).first) != m_mpUpdatedUIDs.end())
+			{
+				throw new std::exception("should not occur!");
+			}
+			else
+			{
+				m_mpUpdatedUIDs[(*it).first] = std::make_pair(std::nullopt, (*it).second.second);
+			}
+
+			if (stAppliedUIDs.find(*(*it).second.first) != stAppliedUIDs.end())
+			{
+				m_vtAppliedUIDs.push_back((*it).first);
+			}
+
+			it++;
+		}
+
+		lock_storage.unlock();
+
+		m_ptrStorage->addObjects(vtObjects);
+
+		it = vtObjects.begin();
+		while (it != vtObjects.end())
+		{
+			if (m_mpUpdatedUIDs.find((*it).first) != m_mpUpdatedUIDs.end())
+			{
+				m_mpUpdatedUIDs[(*it).first] = std::make_pair((*it).second.first, (*it).second.second);
+			}
+			else
+			{
+				throw new std::exception("should not occur!");
+			}
+
+			it++;
+		}
+
+		cv.notify_all();
+
+		vtObjects.clear();
+#else
+		releaseRetiredUIDs();
+
+		size_t nSteps = m_vtClock.size();
+
+		while (m_mpObjects.size() > m_nCacheCapacity)
+		{
+			std::shared_ptr<Item> ptrItemToFlush = evictNext(nSteps);
+
+			if (ptrItemToFlush == nullptr)
+			{
+				break;
+			}
+
+			if (ptrItemToFlush->m_ptrObject->dirty)
+			{
+				if (m_mpUpdatedUIDs.size() > 0)
+				{
+					retireAppliedUIDs(ptrItemToFlush->m_ptrObject);
+
+					m_ptrCallback->applyExistingUpdates(ptrItemToFlush->m_ptrObject, m_mpUpdatedUIDs);
+				}
+
+				ObjectUIDType uidUpdated;
+				if (m_ptrStorage->addObject(ptrItemToFlush->m_uidSelf, ptrItemToFlush->m_ptrObject, uidUpdated) != CacheErrorCode::Success)
+				{
+					throw new std::exception("should not occur!");
+				}
+
+				if (m_mpUpdatedUIDs.find(ptrItemToFlush->m_uidSelf) != m_mpUpdatedUIDs.end())
+				{
+					throw new std::exception("should not occur!");
+				}
+
+				m_mpUpdatedUIDs[ptrItemToFlush->m_uidSelf] = std::make_pair(uidUpdated, ptrItemToFlush->m_ptrObject);
+			}
+		}
+#endif __CONCURRENT__
+	}
+
+	// The updates that applyExistingUpdates is about to apply to the given object.
+	inline void retireAppliedUIDs(std::shared_ptr<ObjectType> ptrObject)
+	{
+		m_ptrCallback->getChildUIDs(ptrObject, m_vtChildUIDs);
+
+		for (const ObjectUIDType& uidChild : m_vtChildUIDs)
+		{
+			if (m_mpUpdatedUIDs.find(uidChild) != m_mpUpdatedUIDs.end())
+			{
+				m_vtRetiredUIDs.push_back(uidChild);
+			}
+		}
+	}
+
+	// The storage takes the retired UIDs back a flush later, so that the caller that got the new UID has updated the
+	// parent and a reader that picked up the old one right before does not find its blocks handed out again already.
+	inline void releaseRetiredUIDs()
+	{
+		// A reader may have looked one up in the meantime and retired it already.
+		auto it = m_vtAppliedUIDs.begin();
+		while (it != m_vtAppliedUIDs.end())
+		{
+			auto itUpdated = m_mpUpdatedUIDs.find(*it);
+			if (itUpdated == m_mpUpdatedUIDs.end())
+			{
+				it = m_vtAppliedUIDs.erase(it);
+			}
+			else if ((*itUpdated).second.first != std::nullopt)
+			{
+				m_mpUpdatedUIDs.erase(itUpdated);	// Applied.
+				m_vtRetiredUIDs.push_back(*it);
+
+				it = m_vtAppliedUIDs.erase(it);
+			}
+			else
+			{
+				it++;
+			}
+		}
+
+		for (const ObjectUIDType& uidObject : m_vtReleasableUIDs)
+		{
+			m_ptrStorage->remove(uidObject);
+		}
+
+		m_vtReleasableUIDs.swap(m_vtRetiredUIDs);
+		m_vtRetiredUIDs.clear();
+	}
+
+#ifdef __CONCURRENT__
+	static void handlerCacheFlush(SelfType* ptrSelf)
+	{
+		do
+		{
+			ptrSelf->flushItemsToStorage();
+
+			std::this_thread::sleep_for(100ms);
+
+		} while (!ptrSelf->m_bStop);
+	}
+#endif __CONCURRENT__
+
+#ifdef __TREE_AWARE_CACHE__
+public:
+	void applyExistingUpdates(std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>>& vtNodes
+		, std::unordered_map<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>& mpUpdatedUIDs)
+	{
+
+	}
+
+	void applyExistingUpdates(std::shared_ptr<ObjectType> ptrObject
+		, std::unordered_map<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>& mpUpdatedUIDs)
+	{
+
+	}
+
+	void prepareFlush(std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>>& vtObjects
+		, const std::function<size_t(size_t)>& fnAllocate, size_t nBlockSize, ObjectUIDType::Media nMediaType)
+	{
+
+	}
+
+	void getChildUIDs(std::shared_ptr<ObjectType> ptrObject, std::vector<ObjectUIDType>& vtChildUIDs)
+	{
+
+	}
+#endif __TREE_AWARE_CACHE__
+};
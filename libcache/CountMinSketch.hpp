@@ -0,0 +1,113 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+/*
+ * Approximate access counts of the recent past, as used by TinyLFU. Each key has a 4-bit counter in each of four rows
+ * and its estimate is the smallest of them. The four counters of a key sit in the same 64-bit word, which holds 16
+ * counters in all. Once the number of increments reaches ten times the capacity, every counter is halved so that
+ * old accesses fade out.
+ * The sketch is not synchronized, the owner guards it.
+ */
+class CountMinSketch
+{
+private:
+	std::vector<uint64_t> m_vtTable;
+	size_t m_nMask;
+	size_t m_nSampleSize;
+	size_t m_nIncrements;
+
+public:
+	CountMinSketch()
+		: m_nMask(0)
+		, m_nSampleSize(0)
+		, m_nIncrements(0)
+	{
+	}
+
+	// nCapacity is the number of keys the owner holds at most.
+	void resize(size_t nCapacity)
+	{
+		nCapacity = std::max<size_t>(nCapacity, 16);
+
+		// Four words per key keep the counters sparse enough that a key seen once rarely estimates above one.
+		size_t nSize = 1;
+		while (nSize < 4 * nCapacity)
+		{
+			nSize <<= 1;
+		}
+
+		m_vtTable.assign(nSize, 0);
+		m_nMask = nSize - 1;
+		m_nSampleSize = 10 * nCapacity;
+		m_nIncrements = 0;
+	}
+
+	// The hash should be well mixed already.
+	inline void increment(uint64_t nHash)
+	{
+		size_t nStart = getStart(nHash);
+		bool bAdded = false;
+
+		for (size_t nRow = 0; nRow < 4; nRow++)
+		{
+			uint64_t& nWord = m_vtTable[getIndex(nHash, nRow)];
+			size_t nShift = (nStart + nRow) << 2;
+
+			if (((nWord >> nShift) & 0xF) < 0xF)
+			{
+				nWord += 1ull << nShift;
+				bAdded = true;
+			}
+		}
+
+		if (bAdded && ++m_nIncrements >= m_nSampleSize)
+		{
+			halve();
+		}
+	}
+
+	inline uint8_t estimate(uint64_t nHash) const
+	{
+		size_t nStart = getStart(nHash);
+		uint8_t nFrequency = 0xF;
+
+		for (size_t nRow = 0; nRow < 4; nRow++)
+		{
+			uint64_t nWord = m_vtTable[getIndex(nHash, nRow)];
+			size_t nShift = (nStart + nRow) << 2;
+
+			nFrequency = std::min<uint8_t>(nFrequency, (nWord >> nShift) & 0xF);
+		}
+
+		return nFrequency;
+	}
+
+private:
+	// Which four of the 16 counters of a word belong to the key.
+	inline size_t getStart(uint64_t nHash) const
+	{
+		return ((nHash >> 32) & 3) << 2;
+	}
+
+	inline size_t getIndex(uint64_t nHash, size_t nRow) const
+	{
+		static const uint64_t s_vtSeeds[4] = { 0xC3A5C85C97CB3127ull, 0xB492B66FBE98F273ull, 0x9AE16A3B2F90404Full, 0xCBF29CE484222325ull };
+
+		nHash = (nHash ^ (nHash >> 29)) * s_vtSeeds[nRow];
+		nHash ^= nHash >> 32;
+
+		return nHash & m_nMask;
+	}
+
+	void halve()
+	{
+		for (uint64_t& nWord : m_vtTable)
+		{
+			nWord = (nWord >> 1) & 0x7777777777777777ull;
+		}
+
+		m_nIncrements /= 2;
+	}
+};
@@ -7,12 +7,35 @@
 #include <fstream>
 #include <variant>
 #include <cmath>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+
+#ifdef _MSC_VER
+#define NOMINMAX
+#include <windows.h>
+#else // !_MSC_VER
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif _MSC_VER
 
 #include "ErrorCodes.h"
 #include "IFlushCallback.h"
+#include "BlockAllocator.hpp"
 
 #define __CONCURRENT__
 
+// The objects are read and written with O_DIRECT (FILE_FLAG_NO_BUFFERING on Windows), i.e. they are not kept in the
+// page cache besides the object cache. The block size must then be a multiple of the device's logical sector size.
+//#define __FILE_STORAGE_DIRECT_IO__
+// The aligned buffers kept for reuse at most.
+#define FILE_STORAGE_BUFFER_POOL_SIZE 32
+
+// The objects are deserialized straight from a read-only mapping of the file rather than read into a buffer first,
+// the OS keeps as many of the pages around as memory allows. The writes still go through the stream.
+//#define __FILE_STORAGE_MMAP__
+
 template<
 	typename ICallback,
 	typename ObjectUIDType, 
@@ -35,8 +58,29 @@ private:
 	std::string m_stFilename;
 	std::fstream m_fsStorage;
 
-	size_t m_nNextBlock;
-	std::vector<bool> m_vtAllocationTable;
+	// The objects are read through a separate handle with positional reads, i.e. without the stream's shared cursor,
+	// so that reads need no lock and any number of them can be outstanding at once.
+#ifdef _MSC_VER
+	HANDLE m_hFile;
+#else // !_MSC_VER
+	int m_nFile;
+#endif _MSC_VER
+
+#ifdef __FILE_STORAGE_MMAP__
+#ifdef _MSC_VER
+	HANDLE m_hMapping;
+#endif _MSC_VER
+	const char* m_szMapping;
+	size_t m_nMappingSize;
+#endif __FILE_STORAGE_MMAP__
+
+#ifdef __FILE_STORAGE_DIRECT_IO__
+	// Direct I/O goes through buffers aligned to (and sized in multiples of) the block size, these are reused.
+	std::vector<std::pair<char*, size_t>> m_vtBufferPool;
+	std::mutex m_mtxBufferPool;
+#endif __FILE_STORAGE_DIRECT_IO__
+
+	BlockAllocator m_allocator;
 
 	ICallback* m_ptrCallback;
 
@@ -59,17 +103,37 @@ public:
 
 		m_mpObjects.clear();
 #endif __CONCURRENT__
+
+#ifdef __FILE_STORAGE_MMAP__
+#ifdef _MSC_VER
+		UnmapViewOfFile(m_szMapping);
+		CloseHandle(m_hMapping);
+#else // !_MSC_VER
+		munmap((void*)m_szMapping, m_nMappingSize);
+#endif _MSC_VER
+#endif __FILE_STORAGE_MMAP__
+
+#ifdef _MSC_VER
+		CloseHandle(m_hFile);
+#else // !_MSC_VER
+		close(m_nFile);
+#endif _MSC_VER
+
+#ifdef __FILE_STORAGE_DIRECT_IO__
+		for (auto& prBuffer : m_vtBufferPool)
+		{
+			freeAligned(prBuffer.first);
+		}
+#endif __FILE_STORAGE_DIRECT_IO__
 	}
 
 	FileStorage(size_t nBlockSize, size_t nFileSize, const std::string& stFilename)
 		: m_nFileSize(nFileSize)
 		, m_nBlockSize(nBlockSize)
 		, m_stFilename(stFilename)
-		, m_nNextBlock(0)
+		, m_allocator(nFileSize / nBlockSize)
 		, m_ptrCallback(NULL)
 	{
-		m_vtAllocationTable.resize(nFileSize/nBlockSize, false);
-
 		//m_fsStorage.rdbuf()->pubsetbuf(0, 0);
 		m_fsStorage.open(stFilename.c_str(), std::ios::binary | std::ios::in | std::ios::out);
 		
@@ -78,6 +142,31 @@ public:
 			throw new exception("should not occur!");   // TODO: critical log.
 		}
 
+#ifdef __FILE_STORAGE_DIRECT_IO__
+#ifdef _MSC_VER
+		m_hFile = CreateFileA(stFilename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+		if (m_hFile == INVALID_HANDLE_VALUE)
+#else // !_MSC_VER
+		m_nFile = open(stFilename.c_str(), O_RDWR | O_DIRECT);
+		if (m_nFile == -1)
+#endif _MSC_VER
+#else // !__FILE_STORAGE_DIRECT_IO__
+#ifdef _MSC_VER
+		m_hFile = CreateFileA(stFilename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (m_hFile == INVALID_HANDLE_VALUE)
+#else // !_MSC_VER
+		m_nFile = open(stFilename.c_str(), O_RDONLY);
+		if (m_nFile == -1)
+#endif _MSC_VER
+#endif __FILE_STORAGE_DIRECT_IO__
+		{
+			throw new exception("should not occur!");   // TODO: critical log.
+		}
+
+#ifdef __FILE_STORAGE_MMAP__
+		mapFile();
+#endif __FILE_STORAGE_MMAP__
+
 #ifdef __CONCURRENT__
 		m_bStopFlush = false;
 		//m_threadBatchFlush = std::thread(handlerBatchFlush, this);
@@ -93,34 +182,53 @@ public:
 
 	std::shared_ptr<ObjectType> getObject(const ObjectUIDType& uidObject)
 	{
-		//char* szBuffer = new char[uidObject.m_uid.FATPOINTER.m_ptrFile.m_nSize + 1]; //2
-		//memset(szBuffer, '\0', uidObject.m_uid.FATPOINTER.m_ptrFile.m_nSize + 1); //2
-
-#ifdef __CONCURRENT__
-		std::unique_lock<std::shared_mutex> lock_file_storage(m_mtxStorage);
-#endif __CONCURRENT__
-
-		m_fsStorage.seekg(uidObject.m_uid.FATPOINTER.m_ptrFile.m_nOffset);
-		std::shared_ptr<ObjectType> ptrObject = std::make_shared<ObjectType>(m_fsStorage); //1
-		//m_fsStorage.read(szBuffer, uidObject.m_uid.FATPOINTER.m_ptrFile.m_nSize); //2
-
-#ifdef __CONCURRENT__
-		lock_file_storage.unlock();
-#endif __CONCURRENT__
-
+#ifdef __FILE_STORAGE_MMAP__
+		if (uidObject.m_uid.FATPOINTER.m_ptrFile.m_nOffset + uidObject.m_uid.FATPOINTER.m_ptrFile.m_nSize > m_nMappingSize)
+		{
+			return nullptr;
+		}
 
-		//std::shared_ptr<ObjectType> ptrObject = std::make_shared<ObjectType>(szBuffer); //2
-		
+		std::shared_ptr<ObjectType> ptrObject = std::make_shared<ObjectType>(m_szMapping + uidObject.m_uid.FATPOINTER.m_ptrFile.m_nOffset);
 		ptrObject->dirty = false;
 
-		//delete[] szBuffer; //2
+		return ptrObject;
+#else // !__FILE_STORAGE_MMAP__
+#ifdef __FILE_STORAGE_DIRECT_IO__
+		// The objects start at block boundaries, only the length needs rounding up.
+		size_t nSize = getAlignedSize(uidObject.m_uid.FATPOINTER.m_ptrFile.m_nSize);
+		char* szBuffer = acquireBuffer(nSize);
+#else // !__FILE_STORAGE_DIRECT_IO__
+		size_t nSize = uidObject.m_uid.FATPOINTER.m_ptrFile.m_nSize;
+		char* szBuffer = new char[nSize];
+#endif __FILE_STORAGE_DIRECT_IO__
+
+		std::shared_ptr<ObjectType> ptrObject = nullptr;
+
+		if (readAt(szBuffer, nSize, uidObject.m_uid.FATPOINTER.m_ptrFile.m_nOffset))
+		{
+			ptrObject = std::make_shared<ObjectType>(szBuffer);
+			ptrObject->dirty = false;
+		}
+
+#ifdef __FILE_STORAGE_DIRECT_IO__
+		releaseBuffer(szBuffer, nSize);
+#else // !__FILE_STORAGE_DIRECT_IO__
+		delete[] szBuffer;
+#endif __FILE_STORAGE_DIRECT_IO__
 
 		return ptrObject;
+#endif __FILE_STORAGE_MMAP__
 	}
 
 	CacheErrorCode remove(const ObjectUIDType& ptrKey)
 	{
-		//throw new std::exception("no implementation!");
+		// Called once nothing refers to the object under this uid anymore, the objects that never made it to the file
+		// have nothing to give back.
+		if (ptrKey.m_uid.m_nMediaType == ObjectUIDType::File)
+		{
+			freeObject(ptrKey);
+		}
+
 		return CacheErrorCode::Success;
 	}
 
@@ -132,16 +240,37 @@ public:
 		//char* szBuffer = NULL; //2
 		//ptrObject->serialize(szBuffer, uidObjectType, nBufferSize); //2
 
+		size_t nObjectSize = ptrObject->getSize();
+		size_t nPos = m_allocator.allocate(std::ceil(nObjectSize / (float)m_nBlockSize));
+
 #ifdef __CONCURRENT__
 		std::unique_lock<std::shared_mutex> lock_file_storage(m_mtxStorage);
 #endif __CONCURRENT__
 
-		m_fsStorage.seekp(m_nNextBlock * m_nBlockSize);
+#ifdef __FILE_STORAGE_DIRECT_IO__
+		char* szBuffer = NULL;
+		ptrObject->serialize(szBuffer, uidObjectType, nBufferSize);
+
+		size_t nAlignedSize = getAlignedSize(nBufferSize);
+		char* szAlignedBuffer = acquireBuffer(nAlignedSize);
+
+		memcpy(szAlignedBuffer, szBuffer, nBufferSize);
+		memset(szAlignedBuffer + nBufferSize, 0, nAlignedSize - nBufferSize);
+		delete[] szBuffer;
+
+		bool bWritten = writeAt(szAlignedBuffer, nAlignedSize, nPos * m_nBlockSize);
+		releaseBuffer(szAlignedBuffer, nAlignedSize);
+
+		if (!bWritten)
+		{
+			return CacheErrorCode::Error;
+		}
+#else // !__FILE_STORAGE_DIRECT_IO__
+		m_fsStorage.seekp(nPos * m_nBlockSize);
 		ptrObject->serialize(m_fsStorage, uidObjectType, nBufferSize); //1
 		//m_fsStorage.write(szBuffer, nBufferSize); //2
 		m_fsStorage.flush();
-
-		size_t nRequiredBlocks = std::ceil((nBufferSize + sizeof(uint8_t)) / (float)m_nBlockSize);
+#endif __FILE_STORAGE_DIRECT_IO__
 
 #ifdef __CONCURRENT__
 		lock_file_storage.unlock();
@@ -149,19 +278,213 @@ public:
 
 		//delete[] szBuffer; //2
 
-		uidUpdated = ObjectUIDType::createAddressFromFileOffset(m_nNextBlock, m_nBlockSize, nBufferSize + sizeof(uint8_t));
+		uidUpdated = ObjectUIDType::createAddressFromFileOffset(nPos, m_nBlockSize, nObjectSize);
 
-		for (int idx = 0; idx < nRequiredBlocks; idx++)
+		return CacheErrorCode::Success;
+	}
+
+	// Reads nSize bytes from nOffset on, retrying short reads.
+	bool readAt(char* szBuffer, size_t nSize, size_t nOffset)
+	{
+		while (nSize > 0)
+		{
+#ifdef _MSC_VER
+			OVERLAPPED ovOffset = {};
+			ovOffset.Offset = (DWORD)nOffset;
+			ovOffset.OffsetHigh = (DWORD)((uint64_t)nOffset >> 32);
+
+			DWORD nRead = 0;
+			if (!ReadFile(m_hFile, szBuffer, (DWORD)nSize, &nRead, &ovOffset) || nRead == 0)
+			{
+				return false;
+			}
+#else // !_MSC_VER
+			ssize_t nRead = pread(m_nFile, szBuffer, nSize, nOffset);
+			if (nRead <= 0)
+			{
+				return false;
+			}
+#endif _MSC_VER
+
+			szBuffer += nRead;
+			nSize -= nRead;
+			nOffset += nRead;
+		}
+
+		return true;
+	}
+
+#ifdef __FILE_STORAGE_MMAP__
+	// The whole file is mapped, as large as it is when the storage is opened.
+	void mapFile()
+	{
+#ifdef _MSC_VER
+		LARGE_INTEGER nFileSize;
+		if (!GetFileSizeEx(m_hFile, &nFileSize))
 		{
-			m_vtAllocationTable[m_nNextBlock++] = true;
+			throw new exception("should not occur!");   // TODO: critical log.
 		}
+		m_nMappingSize = (size_t)nFileSize.QuadPart;
 
-		return CacheErrorCode::Success;
+		m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		m_szMapping = m_hMapping == NULL ? NULL : (const char*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+		if (m_szMapping == NULL)
+		{
+			throw new exception("should not occur!");   // TODO: critical log.
+		}
+#else // !_MSC_VER
+		struct stat stFile;
+		if (fstat(m_nFile, &stFile) != 0)
+		{
+			throw new exception("should not occur!");   // TODO: critical log.
+		}
+		m_nMappingSize = stFile.st_size;
+
+		void* ptrMapping = mmap(NULL, m_nMappingSize, PROT_READ, MAP_SHARED, m_nFile, 0);
+		if (ptrMapping == MAP_FAILED)
+		{
+			throw new exception("should not occur!");   // TODO: critical log.
+		}
+		m_szMapping = (const char*)ptrMapping;
+
+		// The nodes are visited in no particular order, reading ahead would only pull in pages of other nodes.
+		madvise(ptrMapping, m_nMappingSize, MADV_RANDOM);
+#endif _MSC_VER
+	}
+#endif __FILE_STORAGE_MMAP__
+
+#ifdef __FILE_STORAGE_DIRECT_IO__
+	bool writeAt(const char* szBuffer, size_t nSize, size_t nOffset)
+	{
+		while (nSize > 0)
+		{
+#ifdef _MSC_VER
+			OVERLAPPED ovOffset = {};
+			ovOffset.Offset = (DWORD)nOffset;
+			ovOffset.OffsetHigh = (DWORD)((uint64_t)nOffset >> 32);
+
+			DWORD nWritten = 0;
+			if (!WriteFile(m_hFile, szBuffer, (DWORD)nSize, &nWritten, &ovOffset) || nWritten == 0)
+			{
+				return false;
+			}
+#else // !_MSC_VER
+			ssize_t nWritten = pwrite(m_nFile, szBuffer, nSize, nOffset);
+			if (nWritten <= 0)
+			{
+				return false;
+			}
+#endif _MSC_VER
+
+			szBuffer += nWritten;
+			nSize -= nWritten;
+			nOffset += nWritten;
+		}
+
+		return true;
+	}
+
+	inline size_t getAlignedSize(size_t nSize)
+	{
+		return ((nSize + m_nBlockSize - 1) / m_nBlockSize) * m_nBlockSize;
+	}
+
+	// The smallest pooled buffer that fits, or a new one.
+	char* acquireBuffer(size_t nSize)
+	{
+		{
+			std::unique_lock<std::mutex> lock_pool(m_mtxBufferPool);
+
+			auto itFit = m_vtBufferPool.end();
+			for (auto it = m_vtBufferPool.begin(); it != m_vtBufferPool.end(); it++)
+			{
+				if ((*it).second >= nSize && (itFit == m_vtBufferPool.end() || (*it).second < (*itFit).second))
+				{
+					itFit = it;
+				}
+			}
+
+			if (itFit != m_vtBufferPool.end())
+			{
+				char* szBuffer = (*itFit).first;
+				m_vtBufferPool.erase(itFit);
+				return szBuffer;
+			}
+		}
+
+#ifdef _MSC_VER
+		char* szBuffer = (char*)_aligned_malloc(nSize, m_nBlockSize);
+#else // !_MSC_VER
+		char* szBuffer = (char*)std::aligned_alloc(m_nBlockSize, nSize);
+#endif _MSC_VER
+
+		if (szBuffer == NULL)
+		{
+			throw new std::exception("should not occur!");   // TODO: critical log.
+		}
+
+		return szBuffer;
+	}
+
+	// nSize is the size the buffer was acquired with, the pool may remember a smaller one than the allocation.
+	void releaseBuffer(char* szBuffer, size_t nSize)
+	{
+		std::unique_lock<std::mutex> lock_pool(m_mtxBufferPool);
+
+		if (m_vtBufferPool.size() < FILE_STORAGE_BUFFER_POOL_SIZE)
+		{
+			m_vtBufferPool.push_back(std::make_pair(szBuffer, nSize));
+			return;
+		}
+
+		lock_pool.unlock();
+		freeAligned(szBuffer);
+	}
+
+	inline void freeAligned(char* szBuffer)
+	{
+#ifdef _MSC_VER
+		_aligned_free(szBuffer);
+#else // !_MSC_VER
+		std::free(szBuffer);
+#endif _MSC_VER
+	}
+#endif __FILE_STORAGE_DIRECT_IO__
+
+	// The first of nBlocks consecutive free blocks, see BlockAllocator.
+	inline size_t allocate(size_t nBlocks)
+	{
+		return m_allocator.allocate(nBlocks);
+	}
+
+	inline void freeObject(const ObjectUIDType& uidObject)
+	{
+		m_allocator.free(uidObject.m_uid.FATPOINTER.m_ptrFile.m_nOffset / m_nBlockSize, std::ceil(uidObject.m_uid.FATPOINTER.m_ptrFile.m_nSize / (float)m_nBlockSize));
 	}
 
-	inline size_t getWritePos()
+	// Whether writing the object out again would move it into a free run closer to the front of the file, see
+	// BlockAllocator::isRelocatable.
+	inline bool isRelocatable(const ObjectUIDType& uidObject)
 	{
-		return m_nNextBlock;
+		if (uidObject.m_uid.m_nMediaType != ObjectUIDType::File)
+		{
+			return false;
+		}
+
+		return m_allocator.isRelocatable(uidObject.m_uid.FATPOINTER.m_ptrFile.m_nOffset / m_nBlockSize, std::ceil(uidObject.m_uid.FATPOINTER.m_ptrFile.m_nSize / (float)m_nBlockSize));
+	}
+
+	// The share of the blocks below the highest one in use that are free.
+	inline double getFragmentation()
+	{
+		size_t nUsedBlocks = m_allocator.getUsedBlocks();
+		return nUsedBlocks == 0 ? 0 : m_allocator.getFreeBlocks() / (double)nUsedBlocks;
+	}
+
+	// The bytes up to the end of the highest block in use, the rest of the file holds nothing live.
+	inline size_t getUsedSize()
+	{
+		return m_allocator.getUsedBlocks() * m_nBlockSize;
 	}
 
 	inline size_t getBlockSize()
@@ -174,14 +497,71 @@ public:
 		return ObjectUIDType::File;
 	}
 
-	CacheErrorCode addObjects(std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>>& vtObjects, size_t nNewOffset)
+	// The blocks of the objects are allocated in prepareFlush.
+	CacheErrorCode addObjects(std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>>& vtObjects)
 	{
 #ifdef __CONCURRENT__
 		std::unique_lock<std::shared_mutex> lock_file_storage(m_mtxStorage);
 #endif __CONCURRENT__
 
-		m_nNextBlock = nNewOffset;
+#ifdef __FILE_STORAGE_DIRECT_IO__
+		if (vtObjects.size() == 0)
+		{
+			return CacheErrorCode::Success;
+		}
+
+		// The objects of a flush mostly take up consecutive blocks, each run of them is gathered in one buffer and written
+		// at once. The blocks reused from freed objects break a flush up into several runs.
+		std::vector<std::tuple<size_t, char*, size_t>> vtBuffers;	// offset, serialized object, size.
+		vtBuffers.reserve(vtObjects.size());
 
+		auto it = vtObjects.begin();
+		while (it != vtObjects.end())
+		{
+			size_t nBufferSize = 0;
+			uint8_t uidObjectType = 0;
+
+			char* szBuffer = NULL;
+			(*it).second.second->serialize(szBuffer, uidObjectType, nBufferSize);
+
+			vtBuffers.push_back(std::make_tuple((size_t)(*(*it).second.first).m_uid.FATPOINTER.m_ptrFile.m_nOffset, szBuffer, nBufferSize));
+
+			it++;
+		}
+
+		std::sort(vtBuffers.begin(), vtBuffers.end(), [](const auto& lhs, const auto& rhs) { return std::get<0>(lhs) < std::get<0>(rhs); });
+
+		bool bWritten = true;
+
+		size_t idx = 0;
+		while (idx < vtBuffers.size())
+		{
+			size_t nBegin = std::get<0>(vtBuffers[idx]);
+			size_t nEnd = nBegin + getAlignedSize(std::get<2>(vtBuffers[idx]));
+
+			size_t jdx = idx + 1;
+			while (jdx < vtBuffers.size() && std::get<0>(vtBuffers[jdx]) == nEnd)
+			{
+				nEnd += getAlignedSize(std::get<2>(vtBuffers[jdx]));
+				jdx++;
+			}
+
+			char* szAlignedBuffer = acquireBuffer(nEnd - nBegin);
+			memset(szAlignedBuffer, 0, nEnd - nBegin);
+
+			for (; idx < jdx; idx++)
+			{
+				memcpy(szAlignedBuffer + (std::get<0>(vtBuffers[idx]) - nBegin), std::get<1>(vtBuffers[idx]), std::get<2>(vtBuffers[idx]));
+
+				delete[] std::get<1>(vtBuffers[idx]);
+			}
+
+			bWritten = writeAt(szAlignedBuffer, nEnd - nBegin, nBegin) && bWritten;
+			releaseBuffer(szAlignedBuffer, nEnd - nBegin);
+		}
+
+		return bWritten ? CacheErrorCode::Success : CacheErrorCode::Error;
+#else // !__FILE_STORAGE_DIRECT_IO__
 		auto it = vtObjects.begin();
 		while (it != vtObjects.end())
 		{
@@ -202,6 +582,7 @@ public:
 		m_fsStorage.flush();
 
 		return CacheErrorCode::Success;
+#endif __FILE_STORAGE_DIRECT_IO__
 	}
 
 #ifdef __CONCURRENT__
@@ -217,19 +598,15 @@ public:
 		{
 			std::tuple<uint8_t, const std::byte*, size_t> tpSerializedData = it->second->serialize();
 
-			m_fsStorage.seekp(m_nNextBlock * m_nBlockSize);
+			size_t nBlockRequired = std::ceil(std::get<2>(tpSerializedData) / (float)m_nBlockSize);
+			size_t nPos = m_allocator.allocate(nBlockRequired);
+
+			m_fsStorage.seekp(nPos * m_nBlockSize);
 			m_fsStorage.write((char*)(&std::get<0>(tpSerializedData)), sizeof(uint8_t));
 			m_fsStorage.write((char*)(std::get<1>(tpSerializedData)), std::get<2>(tpSerializedData));
 
-			size_t nBlockRequired = std::ceil(std::get<2>(tpSerializedData) / (float)m_nBlockSize);
-
 			ObjectUIDType uid = ObjectUIDType::createAddressFromFileOffset(m_nBlockSize, nBlockRequired * m_nBlockSize);
 			mpUpdatedUIDs[it->first] = uid;
-
-			for (int idx = 0; idx < nBlockRequired; idx++)
-			{
-				m_vtAllocationTable[m_nNextBlock++] = true;
-			}
 		}
 		m_fsStorage.flush();
 
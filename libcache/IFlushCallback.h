@@ -1,5 +1,6 @@
 #pragma once
 #include <unordered_map>
+#include <functional>
 #include "CacheErrorCodes.h"
 
 template <typename ObjectUIDType, typename ObjectType>
@@ -12,6 +13,10 @@ public:
 	virtual void applyExistingUpdates(std::shared_ptr<ObjectType> ptrObject
 		, std::unordered_map<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>& mpUIDUpdates) = 0;
 
+	// fnAllocate takes a number of blocks and returns the first of that many consecutive blocks in the storage.
 	virtual void prepareFlush(std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>>& vtNodes
-		, size_t& nPos, size_t nBlockSize, ObjectUIDType::Media nMediaType) = 0;
+		, const std::function<size_t(size_t)>& fnAllocate, size_t nBlockSize, ObjectUIDType::Media nMediaType) = 0;
+
+	// The objects the given one refers to, a cache that does not evict in LRU order must flush them first.
+	virtual void getChildUIDs(std::shared_ptr<ObjectType> ptrObject, std::vector<ObjectUIDType>& vtChildUIDs) = 0;
 };
\ No newline at end of file
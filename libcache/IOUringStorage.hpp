@@ -0,0 +1,559 @@
+#pragma once
+#ifdef __linux__
+#include <memory>
+#include <iostream>
+#include <fcntl.h>
+#include <cstdlib>
+#include <cstring>
+#include <variant>
+#include <cmath>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <future>
+#include <optional>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "ErrorCodes.h"
+#include "IFlushCallback.h"
+#include "BlockAllocator.hpp"
+
+#define IOURING_QUEUE_DEPTH 256
+
+// Reads of objects up to this size go through buffers registered with the ring, larger ones get their own buffer.
+#define IOURING_FIXED_BUFFER_COUNT 64
+#define IOURING_FIXED_BUFFER_SIZE (64 * 1024)
+
+/*
+ * Same file layout as FileStorage, but the reads and writes are submitted to an io_uring instance rather than issued
+ * one by one, i.e. a miss costs a submission and a wait for its completion, and the objects of a flush all go out
+ * in one submission so the device sees them at once.
+ * The submissions are serialized by a lock, the completions are reaped by a thread of their own which runs the
+ * callback of the request each of them belongs to. The callers of getObject and addObjects wait on these callbacks.
+ * The ring is driven through the system calls directly, there is no dependency on liburing.
+ */
+template<
+	typename ICallback,
+	typename ObjectUIDType,
+	template <typename, typename...> typename ObjectType,
+	typename CoreTypesMarshaller,
+	typename... ObjectCoreTypes
+>
+class IOUringStorage
+{
+	typedef IOUringStorage<ICallback, ObjectUIDType, ObjectType, CoreTypesMarshaller, ObjectCoreTypes...> SelfType;
+
+public:
+	typedef ObjectUIDType ObjectUIDType;
+	typedef ObjectType<CoreTypesMarshaller, ObjectCoreTypes...> ObjectType;
+
+private:
+	// Created by the submitter and deleted by the completion thread once all of its operations are complete.
+	struct Request
+	{
+		std::function<void(int)> fnCompletion;	// gets the result of each operation, i.e. the bytes transferred or -errno.
+		size_t nPending;
+	};
+
+	size_t m_nFileSize;
+	size_t m_nBlockSize;
+
+	std::string m_stFilename;
+	int m_nFile;
+
+	BlockAllocator m_allocator;
+
+	ICallback* m_ptrCallback;
+
+	int m_nRing;
+
+	void* m_ptrSQRing;
+	size_t m_nSQRingSize;
+	void* m_ptrCQRing;
+	size_t m_nCQRingSize;
+
+	io_uring_sqe* m_ptrSQEs;
+	size_t m_nSQEsSize;
+
+	unsigned* m_ptrSQHead;
+	unsigned* m_ptrSQTail;
+	unsigned* m_ptrSQMask;
+	unsigned* m_ptrSQArray;
+	unsigned m_nSQEntries;
+
+	unsigned* m_ptrCQHead;
+	unsigned* m_ptrCQTail;
+	unsigned* m_ptrCQMask;
+	io_uring_cqe* m_ptrCQEs;
+
+	std::mutex m_mtxSubmit;
+
+	char* m_szFixedBuffers;
+	std::vector<size_t> m_vtFreeBuffers;
+	std::mutex m_mtxBuffers;
+
+	std::atomic<bool> m_bStop;
+	std::thread m_threadCompletion;
+
+public:
+	~IOUringStorage()
+	{
+		// A no-op without a request wakes the completion thread up so that it sees the flag.
+		m_bStop = true;
+		submit(IORING_OP_NOP, nullptr, 0, 0, 0, nullptr);
+		m_threadCompletion.join();
+
+		munmap(m_ptrSQEs, m_nSQEsSize);
+		if (m_ptrCQRing != m_ptrSQRing)
+		{
+			munmap(m_ptrCQRing, m_nCQRingSize);
+		}
+		munmap(m_ptrSQRing, m_nSQRingSize);
+
+		close(m_nRing);
+		close(m_nFile);
+
+		std::free(m_szFixedBuffers);
+	}
+
+	IOUringStorage(size_t nBlockSize, size_t nFileSize, const std::string& stFilename)
+		: m_nFileSize(nFileSize)
+		, m_nBlockSize(nBlockSize)
+		, m_stFilename(stFilename)
+		, m_allocator(nFileSize / nBlockSize)
+		, m_ptrCallback(NULL)
+		, m_bStop(false)
+	{
+		m_nFile = open(stFilename.c_str(), O_RDWR);
+		if (m_nFile == -1)
+		{
+			throw new exception("should not occur!");   // TODO: critical log.
+		}
+
+		setupRing();
+		registerBuffers();
+
+		m_threadCompletion = std::thread(handlerCompletion, this);
+	}
+
+	template <typename... InitArgs>
+	CacheErrorCode init(ICallback* ptrCallback, InitArgs... args)
+	{
+		m_ptrCallback = ptrCallback;
+		return CacheErrorCode::Success;
+	}
+
+	std::shared_ptr<ObjectType> getObject(const ObjectUIDType& uidObject)
+	{
+		size_t nSize = uidObject.m_uid.FATPOINTER.m_ptrFile.m_nSize;
+
+		size_t nBuffer = nSize <= IOURING_FIXED_BUFFER_SIZE ? acquireBuffer() : IOURING_FIXED_BUFFER_COUNT;
+		char* szBuffer = nBuffer < IOURING_FIXED_BUFFER_COUNT ? m_szFixedBuffers + nBuffer * IOURING_FIXED_BUFFER_SIZE : new char[nSize];
+
+		std::shared_ptr<std::promise<int>> ptrResult = std::make_shared<std::promise<int>>();
+		std::future<int> futResult = ptrResult->get_future();
+
+		Request* ptrRequest = new Request();
+		ptrRequest->fnCompletion = [ptrResult](int nResult) { ptrResult->set_value(nResult); };
+		ptrRequest->nPending = 1;
+
+		submit(nBuffer < IOURING_FIXED_BUFFER_COUNT ? IORING_OP_READ_FIXED : IORING_OP_READ
+			, szBuffer, nSize, uidObject.m_uid.FATPOINTER.m_ptrFile.m_nOffset, nBuffer, ptrRequest);
+
+		std::shared_ptr<ObjectType> ptrObject = nullptr;
+		if (futResult.get() == (int)nSize)
+		{
+			ptrObject = std::make_shared<ObjectType>(szBuffer);
+			ptrObject->dirty = false;
+		}
+
+		if (nBuffer < IOURING_FIXED_BUFFER_COUNT)
+		{
+			releaseBuffer(nBuffer);
+		}
+		else
+		{
+			delete[] szBuffer;
+		}
+
+		return ptrObject;
+	}
+
+	CacheErrorCode remove(const ObjectUIDType& ptrKey)
+	{
+		if (ptrKey.m_uid.m_nMediaType == ObjectUIDType::File)
+		{
+			freeObject(ptrKey);
+		}
+
+		return CacheErrorCode::Success;
+	}
+
+	CacheErrorCode addObject(ObjectUIDType uidObject, std::shared_ptr<ObjectType> ptrObject, ObjectUIDType& uidUpdated)
+	{
+		size_t nBufferSize = 0;
+		uint8_t uidObjectType = 0;
+
+		char* szBuffer = NULL;
+		ptrObject->serialize(szBuffer, uidObjectType, nBufferSize);
+
+		size_t nPos = m_allocator.allocate(std::ceil(nBufferSize / (float)m_nBlockSize));
+
+		std::shared_ptr<std::promise<int>> ptrResult = std::make_shared<std::promise<int>>();
+		std::future<int> futResult = ptrResult->get_future();
+
+		Request* ptrRequest = new Request();
+		ptrRequest->fnCompletion = [ptrResult](int nResult) { ptrResult->set_value(nResult); };
+		ptrRequest->nPending = 1;
+
+		submit(IORING_OP_WRITE, szBuffer, nBufferSize, nPos * m_nBlockSize, 0, ptrRequest);
+
+		int nResult = futResult.get();
+
+		delete[] szBuffer;
+
+		if (nResult != (int)nBufferSize)
+		{
+			m_allocator.free(nPos, std::ceil(nBufferSize / (float)m_nBlockSize));
+			return CacheErrorCode::Error;
+		}
+
+		uidUpdated = ObjectUIDType::createAddressFromFileOffset(nPos, m_nBlockSize, nBufferSize);
+
+		return CacheErrorCode::Success;
+	}
+
+	inline size_t allocate(size_t nBlocks)
+	{
+		return m_allocator.allocate(nBlocks);
+	}
+
+	inline void freeObject(const ObjectUIDType& uidObject)
+	{
+		m_allocator.free(uidObject.m_uid.FATPOINTER.m_ptrFile.m_nOffset / m_nBlockSize, std::ceil(uidObject.m_uid.FATPOINTER.m_ptrFile.m_nSize / (float)m_nBlockSize));
+	}
+
+	// Whether writing the object out again would move it into a free run closer to the front of the file, see
+	// BlockAllocator::isRelocatable.
+	inline bool isRelocatable(const ObjectUIDType& uidObject)
+	{
+		if (uidObject.m_uid.m_nMediaType != ObjectUIDType::File)
+		{
+			return false;
+		}
+
+		return m_allocator.isRelocatable(uidObject.m_uid.FATPOINTER.m_ptrFile.m_nOffset / m_nBlockSize, std::ceil(uidObject.m_uid.FATPOINTER.m_ptrFile.m_nSize / (float)m_nBlockSize));
+	}
+
+	// The share of the blocks below the highest one in use that are free.
+	inline double getFragmentation()
+	{
+		size_t nUsedBlocks = m_allocator.getUsedBlocks();
+		return nUsedBlocks == 0 ? 0 : m_allocator.getFreeBlocks() / (double)nUsedBlocks;
+	}
+
+	// The bytes up to the end of the highest block in use, the rest of the file holds nothing live.
+	inline size_t getUsedSize()
+	{
+		return m_allocator.getUsedBlocks() * m_nBlockSize;
+	}
+
+	inline size_t getBlockSize()
+	{
+		return m_nBlockSize;
+	}
+
+	inline ObjectUIDType::Media getMediaType()
+	{
+		return ObjectUIDType::File;
+	}
+
+	CacheErrorCode addObjects(std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>>& vtObjects)
+	{
+		if (vtObjects.size() == 0)
+		{
+			return CacheErrorCode::Success;
+		}
+
+		std::vector<char*> vtBuffers;
+		vtBuffers.reserve(vtObjects.size());
+
+		std::vector<size_t> vtSizes;
+		vtSizes.reserve(vtObjects.size());
+
+		auto it = vtObjects.begin();
+		while (it != vtObjects.end())
+		{
+			size_t nBufferSize = 0;
+			uint8_t uidObjectType = 0;
+
+			char* szBuffer = NULL;
+			(*it).second.second->serialize(szBuffer, uidObjectType, nBufferSize);
+
+			vtBuffers.push_back(szBuffer);
+			vtSizes.push_back(nBufferSize);
+
+			it++;
+		}
+
+		// All the writes share one request, the last completion releases the caller. The callbacks all run on the
+		// completion thread, one after the other.
+		std::shared_ptr<std::promise<bool>> ptrDone = std::make_shared<std::promise<bool>>();
+		std::future<bool> futDone = ptrDone->get_future();
+
+		Request* ptrRequest = new Request();
+		ptrRequest->fnCompletion = [ptrDone, nLeft = vtObjects.size(), bFailed = false](int nResult) mutable {
+			bFailed = bFailed || nResult < 0;
+
+			if (--nLeft == 0)
+			{
+				ptrDone->set_value(!bFailed);
+			}
+		};
+		ptrRequest->nPending = vtObjects.size();
+
+		{
+			std::unique_lock<std::mutex> lock_submit(m_mtxSubmit);
+
+			for (size_t idx = 0; idx < vtObjects.size(); idx++)
+			{
+				while (!queue(IORING_OP_WRITE, vtBuffers[idx], vtSizes[idx], (*vtObjects[idx].second.first).m_uid.FATPOINTER.m_ptrFile.m_nOffset, 0, ptrRequest))
+				{
+					enter();
+				}
+			}
+
+			enter();
+		}
+
+		bool bSucceeded = futDone.get();
+
+		for (char* szBuffer : vtBuffers)
+		{
+			delete[] szBuffer;
+		}
+
+		return bSucceeded ? CacheErrorCode::Success : CacheErrorCode::Error;
+	}
+
+private:
+	void setupRing()
+	{
+		io_uring_params params;
+		memset(&params, 0, sizeof(io_uring_params));
+
+		m_nRing = (int)syscall(__NR_io_uring_setup, IOURING_QUEUE_DEPTH, &params);
+		if (m_nRing < 0)
+		{
+			throw new exception("should not occur!");   // TODO: critical log.
+		}
+
+		m_nSQEntries = params.sq_entries;
+
+		m_nSQRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		m_nCQRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+		// Both rings can share one mapping on the kernels that support it.
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+			m_nSQRingSize = std::max(m_nSQRingSize, m_nCQRingSize);
+			m_nCQRingSize = m_nSQRingSize;
+		}
+
+		m_ptrSQRing = mmap(0, m_nSQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_nRing, IORING_OFF_SQ_RING);
+		if (m_ptrSQRing == MAP_FAILED)
+		{
+			throw new exception("should not occur!");   // TODO: critical log.
+		}
+
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+			m_ptrCQRing = m_ptrSQRing;
+		}
+		else
+		{
+			m_ptrCQRing = mmap(0, m_nCQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_nRing, IORING_OFF_CQ_RING);
+			if (m_ptrCQRing == MAP_FAILED)
+			{
+				throw new exception("should not occur!");   // TODO: critical log.
+			}
+		}
+
+		m_nSQEsSize = params.sq_entries * sizeof(io_uring_sqe);
+		m_ptrSQEs = (io_uring_sqe*)mmap(0, m_nSQEsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_nRing, IORING_OFF_SQES);
+		if (m_ptrSQEs == MAP_FAILED)
+		{
+			throw new exception("should not occur!");   // TODO: critical log.
+		}
+
+		char* ptrSQRing = (char*)m_ptrSQRing;
+		m_ptrSQHead = (unsigned*)(ptrSQRing + params.sq_off.head);
+		m_ptrSQTail = (unsigned*)(ptrSQRing + params.sq_off.tail);
+		m_ptrSQMask = (unsigned*)(ptrSQRing + params.sq_off.ring_mask);
+		m_ptrSQArray = (unsigned*)(ptrSQRing + params.sq_off.array);
+
+		char* ptrCQRing = (char*)m_ptrCQRing;
+		m_ptrCQHead = (unsigned*)(ptrCQRing + params.cq_off.head);
+		m_ptrCQTail = (unsigned*)(ptrCQRing + params.cq_off.tail);
+		m_ptrCQMask = (unsigned*)(ptrCQRing + params.cq_off.ring_mask);
+		m_ptrCQEs = (io_uring_cqe*)(ptrCQRing + params.cq_off.cqes);
+	}
+
+	// The kernel pins the registered buffers once, rather than mapping the pages of every read anew.
+	void registerBuffers()
+	{
+		m_szFixedBuffers = (char*)std::aligned_alloc(4096, IOURING_FIXED_BUFFER_COUNT * IOURING_FIXED_BUFFER_SIZE);
+
+		std::vector<iovec> vtBuffers(IOURING_FIXED_BUFFER_COUNT);
+		for (size_t idx = 0; idx < IOURING_FIXED_BUFFER_COUNT; idx++)
+		{
+			vtBuffers[idx].iov_base = m_szFixedBuffers + idx * IOURING_FIXED_BUFFER_SIZE;
+			vtBuffers[idx].iov_len = IOURING_FIXED_BUFFER_SIZE;
+
+			m_vtFreeBuffers.push_back(idx);
+		}
+
+		if (syscall(__NR_io_uring_register, m_nRing, IORING_REGISTER_BUFFERS, vtBuffers.data(), IOURING_FIXED_BUFFER_COUNT) < 0)
+		{
+			// Plain reads still work, e.g. when the locked memory limit is too low.
+			m_vtFreeBuffers.clear();
+		}
+	}
+
+	// IOURING_FIXED_BUFFER_COUNT if none is free.
+	inline size_t acquireBuffer()
+	{
+		std::unique_lock<std::mutex> lock_buffers(m_mtxBuffers);
+
+		if (m_vtFreeBuffers.size() == 0)
+		{
+			return IOURING_FIXED_BUFFER_COUNT;
+		}
+
+		size_t nBuffer = m_vtFreeBuffers.back();
+		m_vtFreeBuffers.pop_back();
+
+		return nBuffer;
+	}
+
+	inline void releaseBuffer(size_t nBuffer)
+	{
+		std::unique_lock<std::mutex> lock_buffers(m_mtxBuffers);
+		m_vtFreeBuffers.push_back(nBuffer);
+	}
+
+	void submit(uint8_t nOpCode, char* szBuffer, size_t nSize, size_t nOffset, size_t nBuffer, Request* ptrRequest)
+	{
+		std::unique_lock<std::mutex> lock_submit(m_mtxSubmit);
+
+		while (!queue(nOpCode, szBuffer, nSize, nOffset, nBuffer, ptrRequest))
+		{
+			enter();
+		}
+
+		enter();
+	}
+
+	// Fills the next entry of the submission queue, false if the queue is full. The caller holds m_mtxSubmit.
+	bool queue(uint8_t nOpCode, char* szBuffer, size_t nSize, size_t nOffset, size_t nBuffer, Request* ptrRequest)
+	{
+		unsigned nTail = *m_ptrSQTail;
+		unsigned nHead = std::atomic_ref<unsigned>(*m_ptrSQHead).load(std::memory_order_acquire);
+
+		if (nTail - nHead == m_nSQEntries)
+		{
+			return false;
+		}
+
+		unsigned nIdx = nTail & *m_ptrSQMask;
+
+		io_uring_sqe* ptrSQE = &m_ptrSQEs[nIdx];
+		memset(ptrSQE, 0, sizeof(io_uring_sqe));
+
+		ptrSQE->opcode = nOpCode;
+		ptrSQE->fd = nOpCode == IORING_OP_NOP ? -1 : m_nFile;
+		ptrSQE->addr = (uint64_t)szBuffer;
+		ptrSQE->len = (uint32_t)nSize;
+		ptrSQE->off = nOffset;
+		ptrSQE->buf_index = (uint16_t)nBuffer;
+		ptrSQE->user_data = (uint64_t)ptrRequest;
+
+		m_ptrSQArray[nIdx] = nIdx;
+
+		std::atomic_ref<unsigned>(*m_ptrSQTail).store(nTail + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// Hands all the queued entries over to the kernel. The caller holds m_mtxSubmit.
+	inline void enter()
+	{
+		unsigned nQueued = *m_ptrSQTail - std::atomic_ref<unsigned>(*m_ptrSQHead).load(std::memory_order_acquire);
+		while (nQueued > 0)
+		{
+			int nSubmitted = (int)syscall(__NR_io_uring_enter, m_nRing, nQueued, 0, 0, NULL, 0);
+			if (nSubmitted < 0)
+			{
+				if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+				{
+					throw new exception("should not occur!");   // TODO: critical log.
+				}
+				continue;
+			}
+
+			nQueued -= nSubmitted;
+		}
+	}
+
+	void reapCompletions()
+	{
+		while (!m_bStop)
+		{
+			unsigned nHead = *m_ptrCQHead;
+			unsigned nTail = std::atomic_ref<unsigned>(*m_ptrCQTail).load(std::memory_order_acquire);
+
+			if (nHead == nTail)
+			{
+				syscall(__NR_io_uring_enter, m_nRing, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+				continue;
+			}
+
+			while (nHead != nTail)
+			{
+				io_uring_cqe* ptrCQE = &m_ptrCQEs[nHead & *m_ptrCQMask];
+
+				Request* ptrRequest = (Request*)ptrCQE->user_data;
+				int nResult = ptrCQE->res;
+
+				// The entry is given back before the callback runs as the request may be gone right after it.
+				nHead++;
+				std::atomic_ref<unsigned>(*m_ptrCQHead).store(nHead, std::memory_order_release);
+
+				if (ptrRequest != nullptr)
+				{
+					ptrRequest->fnCompletion(nResult);
+
+					if (--ptrRequest->nPending == 0)
+					{
+						delete ptrRequest;
+					}
+				}
+			}
+		}
+	}
+
+	static void handlerCompletion(SelfType* ptrSelf)
+	{
+		ptrSelf->reapCompletions();
+	}
+};
+#endif __linux__
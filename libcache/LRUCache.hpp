@@ -7,19 +7,44 @@
 #include <variant>
 #include <typeinfo>
 #include <unordered_map>
+#include <unordered_set>
 #include <queue>
 #include  <algorithm>
 #include <tuple>
+#include <array>
+#include <atomic>
+#include <future>
+#include <optional>
 
 #include "ErrorCodes.h"
 #include "IFlushCallback.h"
 #include "VariadicNthType.h"
+#include "CountMinSketch.hpp"
 
 #define __CONCURRENT__
 //#define __TREE_AWARE_CACHE__
 
 #define FLUSH_COUNT 100
 
+// The capacity is a budget of bytes, as reported by the objects' getSize, rather than a number of objects.
+//#define __CACHE_CAPACITY_IN_BYTES__
+// The size of an object the per-object bookkeeping is dimensioned for when the capacity is in bytes.
+#define CACHE_OBJECT_SIZE_HINT 4096
+
+// The cache is split into 2^CACHE_SHARD_BITS shards by the hash of the object's UID.
+#define CACHE_SHARD_BITS 4
+#define CACHE_SHARD_COUNT (1 << CACHE_SHARD_BITS)
+
+// Objects read from the storage are only admitted to the LRU list once they have been accessed this many times lately.
+#define __SCAN_RESISTANT_CACHE__
+#define CACHE_ADMISSION_FREQUENCY 2
+
+// Objects of the top CACHE_PINNED_LEVELS levels of the tree (as reported through their depth) are kept out of the LRU
+// list, i.e. are never flushed, for as long as they take up no more than CACHE_PINNED_SHARE percent of the capacity.
+#define __LEVEL_AWARE_CACHE__
+#define CACHE_PINNED_LEVELS 2
+#define CACHE_PINNED_SHARE 20
+
 template <typename ICallback, typename StorageType>
 class LRUCache : public ICallback
 {
@@ -38,10 +63,18 @@ private:
 		ObjectTypePtr m_ptrObject;
 		std::shared_ptr<Item> m_ptrPrev;
 		std::shared_ptr<Item> m_ptrNext;
+		uint64_t m_nAccessStamp;
+		size_t m_nSize;
+		size_t m_nPinned;	// the part of the pinned share the item takes up, 0 unless it is pinned.
+		bool m_bProbation;
 
 		Item(const ObjectUIDType& key, const ObjectTypePtr ptrObject)
 			: m_ptrNext(nullptr)
 			, m_ptrPrev(nullptr)
+			, m_nAccessStamp(0)
+			, m_nSize(0)
+			, m_nPinned(0)
+			, m_bProbation(false)
 		{
 			m_uidSelf = key;
 			m_ptrObject = ptrObject;
@@ -55,18 +88,66 @@ private:
 		}
 	};
 
+	/*
+	 * Each shard has its own map, LRU list and lock, so that lookups of objects in different shards do not wait on each
+	 * other. An item moved to the front of a list takes its stamp from m_nAccessStamp while the shard is locked, hence
+	 * every list is ordered by stamp and the flush evicts the tail with the lowest stamp across the shards. That is the
+	 * order a single list would have, which the flush relies on: a node always leaves the cache before its parent.
+	 *
+	 * With __SCAN_RESISTANT_CACHE__ an unmodified object read from the storage first goes to the probation list and is
+	 * only moved to the LRU list once the shard's sketch has counted enough recent accesses to its UID. The flush
+	 * empties the probation list first, so the objects a scan touches once evict each other rather than the hot ones.
+	 * Taking them out of the LRU order is safe as they come from the storage unchanged, i.e. they only refer to
+	 * objects that are in the storage as well. A modified or newly created object always goes to the LRU list.
+	 */
+	struct alignas(64) Shard
+	{
+		std::shared_ptr<Item> m_ptrHead;
+		std::shared_ptr<Item> m_ptrTail;
+
+		std::unordered_map<ObjectUIDType, std::shared_ptr<Item>> m_mpObjects;
+
+		size_t m_nBytes = 0;	// the objects' sizes as of when they were last added or reordered.
+
+#ifdef __SCAN_RESISTANT_CACHE__
+		std::shared_ptr<Item> m_ptrProbationHead;
+		std::shared_ptr<Item> m_ptrProbationTail;
+
+		CountMinSketch m_sketch;
+#endif __SCAN_RESISTANT_CACHE__
+
+#ifdef __CONCURRENT__
+		mutable std::shared_mutex m_mtxCache;
+
+		// Reads from the storage in progress, by the requested UID. Threads that miss the same object meanwhile wait
+		// for the read of the first one instead of issuing their own.
+		std::unordered_map<ObjectUIDType, std::shared_future<std::pair<ObjectTypePtr, std::optional<ObjectUIDType>>>> m_mpPendingReads;
+#endif __CONCURRENT__
+	};
+
 	ICallback* m_ptrCallback;
 
-	std::shared_ptr<Item> m_ptrHead;
-	std::shared_ptr<Item> m_ptrTail;
+	std::array<Shard, CACHE_SHARD_COUNT> m_arrShards;
+	std::atomic<uint64_t> m_nAccessStamp;
 
 	std::unique_ptr<StorageType> m_ptrStorage;
 
-	size_t m_nCacheCapacity;
-	std::unordered_map<ObjectUIDType, std::shared_ptr<Item>> m_mpObjects;
+	size_t m_nCacheCapacity;	// objects, or bytes with __CACHE_CAPACITY_IN_BYTES__.
+
+#ifdef __LEVEL_AWARE_CACHE__
+	size_t m_nPinnedCapacity;
+	std::atomic<size_t> m_nPinnedUsage;
+#endif __LEVEL_AWARE_CACHE__
 
 	std::unordered_map<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, ObjectTypePtr>> m_mpUpdatedUIDs;
 
+	// The UIDs the objects had before they were flushed, their parents refer to the new ones by now. They are handed
+	// back to the storage a flush after they were retired.
+	std::vector<ObjectUIDType> m_vtRetiredUIDs;
+	std::vector<ObjectUIDType> m_vtReleasableUIDs;
+	std::vector<ObjectUIDType> m_vtAppliedUIDs;	// flushed along with their parents, no reader has to look them up.
+	std::vector<ObjectUIDType> m_vtChildUIDs;	// scratch space for the flush.
+
 #ifdef __CONCURRENT__
 	bool m_bStop;
 
@@ -74,7 +155,6 @@ private:
 
 	std::condition_variable_any cv;
 
-	mutable std::shared_mutex m_mtxCache;
 	mutable std::shared_mutex m_mtxStorage;
 #endif __CONCURRENT__
 
@@ -86,21 +166,47 @@ public:
 		m_threadCacheFlush.join();
 #endif __CONCURRENT__
 
-		m_ptrHead = nullptr;
-		m_ptrTail = nullptr;
-		m_ptrStorage = nullptr;
+		for (Shard& shard : m_arrShards)
+		{
+			shard.m_ptrHead = nullptr;
+			shard.m_ptrTail = nullptr;
+
+#ifdef __SCAN_RESISTANT_CACHE__
+			shard.m_ptrProbationHead = nullptr;
+			shard.m_ptrProbationTail = nullptr;
+#endif __SCAN_RESISTANT_CACHE__
 
-		m_mpObjects.clear();
+			shard.m_mpObjects.clear();
+		}
+
+		m_ptrStorage = nullptr;
 	}
 
 	template <typename... StorageArgs>
 	LRUCache(size_t nCapacity, StorageArgs... args)
 		: m_nCacheCapacity(nCapacity)
-		, m_ptrHead(nullptr)
-		, m_ptrTail(nullptr)
+		, m_nAccessStamp(0)
 	{
+#ifdef __LEVEL_AWARE_CACHE__
+		m_nPinnedCapacity = nCapacity * CACHE_PINNED_SHARE / 100;
+		m_nPinnedUsage = 0;
+#endif __LEVEL_AWARE_CACHE__
+
 		m_ptrStorage = std::make_unique<StorageType>(args...);
 
+#ifdef __SCAN_RESISTANT_CACHE__
+#ifdef __CACHE_CAPACITY_IN_BYTES__
+		size_t nObjects = nCapacity / CACHE_OBJECT_SIZE_HINT;
+#else // !__CACHE_CAPACITY_IN_BYTES__
+		size_t nObjects = nCapacity;
+#endif __CACHE_CAPACITY_IN_BYTES__
+
+		for (Shard& shard : m_arrShards)
+		{
+			shard.m_sketch.resize(nObjects / CACHE_SHARD_COUNT + 1);
+		}
+#endif __SCAN_RESISTANT_CACHE__
+
 #ifdef __CONCURRENT__
 		m_bStop = false;
 		m_threadCacheFlush = std::thread(handlerCacheFlush, this);
@@ -126,18 +232,38 @@ public:
 	{
 		CacheErrorCode errCode = CacheErrorCode::Error;
 
+		Shard& shard = getShard(uidObject);
+
 #ifdef __CONCURRENT__
-		std::unique_lock<std::shared_mutex>  lock_cache(m_mtxCache);
+		std::unique_lock<std::shared_mutex>  lock_cache(shard.m_mtxCache);
 #endif __CONCURRENT__
 
-		auto it = m_mpObjects.find(uidObject);
-		if (it != m_mpObjects.end()) 
+		auto it = shard.m_mpObjects.find(uidObject);
+		if (it != shard.m_mpObjects.end()) 
 		{
-			removeFromLRU((*it).second);
-			m_mpObjects.erase((*it).first);
+			removeFromLRU(shard, (*it).second);
+			shard.m_mpObjects.erase((*it).first);
 			errCode = CacheErrorCode::Success;
 		}
 
+#ifdef __CONCURRENT__
+		lock_cache.unlock();
+
+		std::unique_lock<std::shared_mutex> lock_storage(m_mtxStorage);
+#endif __CONCURRENT__
+
+		// The object may have been flushed already, its parent just did not pick up the new UID yet.
+		auto itUpdated = m_mpUpdatedUIDs.find(uidObject);
+		if (itUpdated != m_mpUpdatedUIDs.end())
+		{
+			if ((*itUpdated).second.first != std::nullopt)
+			{
+				m_ptrStorage->remove(*(*itUpdated).second.first);
+			}
+
+			m_mpUpdatedUIDs.erase(itUpdated);
+		}
+
 		m_ptrStorage->remove(uidObject);
 
 		return errCode;
@@ -145,20 +271,41 @@ public:
 
 	CacheErrorCode getObject(const ObjectUIDType uidObject, ObjectTypePtr & ptrObject, std::optional<ObjectUIDType>& uidUpdated)
 	{
+		Shard& shard = getShard(uidObject);
+
 #ifdef __CONCURRENT__
-		std::unique_lock<std::shared_mutex> lock_cache(m_mtxCache); // std::unique_lock due to LRU's linked-list update! is there any better way?
+		std::unique_lock<std::shared_mutex> lock_cache(shard.m_mtxCache); // std::unique_lock due to LRU's linked-list update! is there any better way?
 #endif __CONCURRENT__
 
-		if (m_mpObjects.find(uidObject) != m_mpObjects.end())
+		recordAccess(shard, uidObject);
+
+		if (shard.m_mpObjects.find(uidObject) != shard.m_mpObjects.end())
 		{
-			std::shared_ptr<Item> ptrItem = m_mpObjects[uidObject];
-			moveToFront(ptrItem);
+			std::shared_ptr<Item> ptrItem = shard.m_mpObjects[uidObject];
+			touch(shard, ptrItem);
 			ptrObject = ptrItem->m_ptrObject;
 			return CacheErrorCode::Success;
 		}
 
 #ifdef __CONCURRENT__
-		std::unique_lock<std::shared_mutex> lock_storage(m_mtxStorage); // TODO: requesting the same key?
+		auto itPending = shard.m_mpPendingReads.find(uidObject);
+		if (itPending != shard.m_mpPendingReads.end())
+		{
+			std::shared_future<std::pair<ObjectTypePtr, std::optional<ObjectUIDType>>> futRead = (*itPending).second;
+			lock_cache.unlock();
+
+			const std::pair<ObjectTypePtr, std::optional<ObjectUIDType>>& prRead = futRead.get();
+
+			ptrObject = prRead.first;
+			uidUpdated = prRead.second;
+
+			return ptrObject != nullptr ? CacheErrorCode::Success : CacheErrorCode::Error;
+		}
+
+		std::promise<std::pair<ObjectTypePtr, std::optional<ObjectUIDType>>> prmRead;
+		shard.m_mpPendingReads[uidObject] = prmRead.get_future().share();
+
+		std::unique_lock<std::shared_mutex> lock_storage(m_mtxStorage);
 		lock_cache.unlock();
 #endif __CONCURRENT__
 
@@ -178,6 +325,7 @@ public:
 			assert(uidUpdated != std::nullopt);
 
 			m_mpUpdatedUIDs.erase(uidObject);	// Applied.
+			m_vtRetiredUIDs.push_back(uidObject);
 			_uidUpdated = *uidUpdated;
 		}
 
@@ -187,63 +335,81 @@ public:
 
 		std::shared_ptr<ObjectType> _ptrObject = m_ptrStorage->getObject(_uidUpdated);
 
-
 		if (_ptrObject != nullptr)
 		{
 			std::shared_ptr<Item> ptrItem = std::make_shared<Item>(_uidUpdated, _ptrObject);
 
-#ifdef __CONCURRENT__
-			std::unique_lock<std::shared_mutex> re_lock_cache(m_mtxCache);
+			// The updated UID may belong to another shard.
+			Shard& shardUpdated = getShard(_uidUpdated);
 
-			if (m_mpObjects.find(_uidUpdated) != m_mpObjects.end())
-			{
-				std::shared_ptr<Item> ptrItem = m_mpObjects[_uidUpdated];
-				moveToFront(ptrItem);
-				ptrObject = ptrItem->m_ptrObject;
-				return CacheErrorCode::Success;
-			}
+#ifdef __CONCURRENT__
+			std::unique_lock<std::shared_mutex> re_lock_cache(shardUpdated.m_mtxCache);
 #endif __CONCURRENT__
 
-			m_mpObjects[_uidUpdated] = ptrItem;
-
-			if (!m_ptrHead)
+			auto it = shardUpdated.m_mpObjects.find(_uidUpdated);
+			if (it != shardUpdated.m_mpObjects.end())
 			{
-				m_ptrHead = ptrItem;
-				m_ptrTail = ptrItem;
+				touch(shardUpdated, (*it).second);
+				_ptrObject = (*it).second->m_ptrObject;
 			}
 			else
 			{
-				ptrItem->m_ptrNext = m_ptrHead;
-				m_ptrHead->m_ptrPrev = ptrItem;
-				m_ptrHead = ptrItem;
+				shardUpdated.m_mpObjects[_uidUpdated] = ptrItem;
+
+#ifdef __SCAN_RESISTANT_CACHE__
+				if (_uidUpdated != uidObject)
+				{
+					recordAccess(shardUpdated, _uidUpdated);
+				}
+
+				if (isAdmitted(shardUpdated, ptrItem))
+				{
+					addToFront(shardUpdated, ptrItem);
+				}
+				else
+				{
+					addToProbation(shardUpdated, ptrItem);
+				}
+#else // !__SCAN_RESISTANT_CACHE__
+				addToFront(shardUpdated, ptrItem);
+#endif __SCAN_RESISTANT_CACHE__
 			}
+		}
 
-			ptrObject = _ptrObject;
+		ptrObject = _ptrObject;
 
-#ifndef __CONCURRENT__
-			flushItemsToStorage();
-#endif __CONCURRENT__
+#ifdef __CONCURRENT__
+		// The object is in the cache by now, the threads waiting for it can go on.
+		lock_cache.lock();
+		shard.m_mpPendingReads.erase(uidObject);
+		lock_cache.unlock();
 
-			return CacheErrorCode::Success;
-		}
+		prmRead.set_value(std::make_pair(ptrObject, uidUpdated));
+#else // !__CONCURRENT__
+		flushItemsToStorage();
+#endif __CONCURRENT__
 
-		return CacheErrorCode::Error;
+		return ptrObject != nullptr ? CacheErrorCode::Success : CacheErrorCode::Error;
 	}
 
 	CacheErrorCode reorder(std::vector<std::pair<ObjectUIDType, ObjectTypePtr>>& vt, bool ensure = true)
 	{
-#ifdef __CONCURRENT__
-		std::unique_lock<std::shared_mutex> lock_cache(m_mtxCache); // std::unique_lock due to LRU's linked-list update! is there any better way?
-#endif __CONCURRENT__
-
 		while (vt.size() > 0)
 		{
 			std::pair<ObjectUIDType, ObjectTypePtr> prNode = vt.back();
 
-			if (m_mpObjects.find(prNode.first) != m_mpObjects.end())
+			// One shard at a time, the stamps keep the order across the shards.
+			Shard& shard = getShard(prNode.first);
+
+#ifdef __CONCURRENT__
+			std::unique_lock<std::shared_mutex> lock_cache(shard.m_mtxCache); // std::unique_lock due to LRU's linked-list update! is there any better way?
+#endif __CONCURRENT__
+
+			if (shard.m_mpObjects.find(prNode.first) != shard.m_mpObjects.end())
 			{
-				std::shared_ptr<Item> ptrItem = m_mpObjects[prNode.first];
-				moveToFront(ptrItem);
+				std::shared_ptr<Item> ptrItem = shard.m_mpObjects[prNode.first];
+				updateSize(shard, ptrItem);
+				touch(shard, ptrItem);
 			}
 			else
 			{
@@ -262,15 +428,19 @@ public:
 	template <typename Type>
 	CacheErrorCode getObjectOfType(const ObjectUIDType key, Type& ptrObject, std::optional<ObjectUIDType>& uidUpdated)
 	{
+		Shard& shard = getShard(key);
+
 #ifdef __CONCURRENT__
-		std::unique_lock<std::shared_mutex> lock_cache(m_mtxCache);
+		std::unique_lock<std::shared_mutex> lock_cache(shard.m_mtxCache);
 #endif __CONCURRENT__
 
-		if (m_mpObjects.find(key) != m_mpObjects.end())
+		recordAccess(shard, key);
+
+		if (shard.m_mpObjects.find(key) != shard.m_mpObjects.end())
 		{
-			std::shared_ptr<Item> ptrItem = m_mpObjects[key];
+			std::shared_ptr<Item> ptrItem = shard.m_mpObjects[key];
 
-			moveToFront(ptrItem);
+			moveToFront(shard, ptrItem);
 
 //#ifdef __CONCURRENT__
 //			lock_cache.unlock();
@@ -304,6 +474,7 @@ public:
 			assert(uidUpdated != std::nullopt);
 
 			m_mpUpdatedUIDs.erase(key);	// Applied.
+			m_vtRetiredUIDs.push_back(key);
 			_uidUpdated = *uidUpdated;
 		}
 
@@ -319,13 +490,15 @@ public:
 
 			ptrValue->dirty = true; //todo fix it later..
 
+			Shard& shardUpdated = getShard(_uidUpdated);
+
 #ifdef __CONCURRENT__
-			std::unique_lock<std::shared_mutex> re_lock_cache(m_mtxCache);
+			std::unique_lock<std::shared_mutex> re_lock_cache(shardUpdated.m_mtxCache);
 
-			if (m_mpObjects.find(_uidUpdated) != m_mpObjects.end())
+			if (shardUpdated.m_mpObjects.find(_uidUpdated) != shardUpdated.m_mpObjects.end())
 			{
-				std::shared_ptr<Item> ptrItem = m_mpObjects[_uidUpdated];
-				moveToFront(ptrItem);
+				std::shared_ptr<Item> ptrItem = shardUpdated.m_mpObjects[_uidUpdated];
+				moveToFront(shardUpdated, ptrItem);
 
 				if (std::holds_alternative<Type>(*ptrItem->m_ptrObject->data))
 				{
@@ -337,19 +510,9 @@ public:
 			}
 #endif __CONCURRENT__
 
-			m_mpObjects[_uidUpdated] = ptrItem;
+			shardUpdated.m_mpObjects[_uidUpdated] = ptrItem;
 
-			if (!m_ptrHead)
-			{
-				m_ptrHead = ptrItem;
-				m_ptrTail = ptrItem;
-			}
-			else
-			{
-				ptrItem->m_ptrNext = m_ptrHead;
-				m_ptrHead->m_ptrPrev = ptrItem;
-				m_ptrHead = ptrItem;
-			}
+			addToFront(shardUpdated, ptrItem);
 
 //#ifdef __CONCURRENT__
 //			lock_cache.unlock();
@@ -380,30 +543,23 @@ public:
 
 		std::shared_ptr<Item> ptrItem = std::make_shared<Item>(*uidObject, ptrObject);
 
+		Shard& shard = getShard(*uidObject);
+
 #ifdef __CONCURRENT__
-		std::unique_lock<std::shared_mutex> lock_cache(m_mtxCache);
+		std::unique_lock<std::shared_mutex> lock_cache(shard.m_mtxCache);
 #endif __CONCURRENT__
 
-		if (m_mpObjects.find(*uidObject) != m_mpObjects.end())
+		if (shard.m_mpObjects.find(*uidObject) != shard.m_mpObjects.end())
 		{
-			std::shared_ptr<Item> ptrItem = m_mpObjects[*uidObject];
+			std::shared_ptr<Item> ptrItem = shard.m_mpObjects[*uidObject];
 			ptrItem->m_ptrObject = ptrObject;
-			moveToFront(ptrItem);
+			updateSize(shard, ptrItem);
+			moveToFront(shard, ptrItem);
 		}
 		else
 		{
-			m_mpObjects[*uidObject] = ptrItem;
-			if (!m_ptrHead) 
-			{
-				m_ptrHead = ptrItem;
-				m_ptrTail = ptrItem;
-			}
-			else 
-			{
-				ptrItem->m_ptrNext = m_ptrHead;
-				m_ptrHead->m_ptrPrev = ptrItem;
-				m_ptrHead = ptrItem;
-			}
+			shard.m_mpObjects[*uidObject] = ptrItem;
+			addToFront(shard, ptrItem);
 		}
 
 #ifdef __CONCURRENT__
@@ -426,30 +582,23 @@ public:
 
 		std::shared_ptr<Item> ptrItem = std::make_shared<Item>(*uidObject, ptrObject);
 
+		Shard& shard = getShard(*uidObject);
+
 #ifdef __CONCURRENT__
-		std::unique_lock<std::shared_mutex> lock_cache(m_mtxCache);
+		std::unique_lock<std::shared_mutex> lock_cache(shard.m_mtxCache);
 #endif __CONCURRENT__
 
-		if (m_mpObjects.find(*uidObject) != m_mpObjects.end())
+		if (shard.m_mpObjects.find(*uidObject) != shard.m_mpObjects.end())
 		{
-			std::shared_ptr<Item> ptrItem = m_mpObjects[*uidObject];
+			std::shared_ptr<Item> ptrItem = shard.m_mpObjects[*uidObject];
 			ptrItem->m_ptrObject = ptrObject;
-			moveToFront(ptrItem);
+			updateSize(shard, ptrItem);
+			moveToFront(shard, ptrItem);
 		}
 		else
 		{
-			m_mpObjects[*uidObject] = ptrItem;
-			if (!m_ptrHead)
-			{
-				m_ptrHead = ptrItem;
-				m_ptrTail = ptrItem;
-			}
-			else
-			{
-				ptrItem->m_ptrNext = m_ptrHead;
-				m_ptrHead->m_ptrPrev = ptrItem;
-				m_ptrHead = ptrItem;
-			}
+			shard.m_mpObjects[*uidObject] = ptrItem;
+			addToFront(shard, ptrItem);
 		}
 
 #ifdef __CONCURRENT__
@@ -464,15 +613,65 @@ public:
 	void getCacheState(size_t& lru, size_t& map)
 	{
 		lru = 0;
-		std::shared_ptr<Item> _ptrItem = m_ptrHead;
-		do
+		map = 0;
+
+		for (Shard& shard : m_arrShards)
 		{
-			lru++;
-			_ptrItem = _ptrItem->m_ptrNext;
+#ifdef __CONCURRENT__
+			std::shared_lock<std::shared_mutex> lock_cache(shard.m_mtxCache);
+#endif __CONCURRENT__
 
-		} while (_ptrItem != nullptr);
+			std::shared_ptr<Item> _ptrItem = shard.m_ptrHead;
+			while (_ptrItem != nullptr)
+			{
+				lru++;
+				_ptrItem = _ptrItem->m_ptrNext;
+			}
 
-		map = m_mpObjects.size();
+#ifdef __SCAN_RESISTANT_CACHE__
+			_ptrItem = shard.m_ptrProbationHead;
+			while (_ptrItem != nullptr)
+			{
+				lru++;
+				_ptrItem = _ptrItem->m_ptrNext;
+			}
+#endif __SCAN_RESISTANT_CACHE__
+
+			map += shard.m_mpObjects.size();
+		}
+	}
+
+	void getCacheState(size_t& lru, size_t& map, size_t& bytes)
+	{
+		getCacheState(lru, map);
+
+		bytes = 0;
+
+		for (Shard& shard : m_arrShards)
+		{
+#ifdef __CONCURRENT__
+			std::shared_lock<std::shared_mutex> lock_cache(shard.m_mtxCache);
+#endif __CONCURRENT__
+
+			bytes += shard.m_nBytes;
+		}
+	}
+
+	// Whether writing the object out again would move it towards the front of the storage, the stores use it to
+	// compact the storage online.
+	inline bool isRelocatable(const ObjectUIDType& uidObject)
+	{
+		return m_ptrStorage->isRelocatable(uidObject);
+	}
+
+	inline double getStorageFragmentation()
+	{
+		return m_ptrStorage->getFragmentation();
+	}
+
+	inline size_t getStorageUsedSize()
+	{
+		return m_ptrStorage->getUsedSize();
 	}
 
 private:
@@ -510,8 +709,8 @@ private:
 		}
 	}
 
-	void interchangeWithTail(std::shared_ptr<Item> currentNode) {
-		if (currentNode == nullptr || currentNode == m_ptrTail) 
+	void interchangeWithTail(Shard& shard, std::shared_ptr<Item> currentNode) {
+		if (currentNode == nullptr || currentNode == shard.m_ptrTail) 
 		{
 			return;
 		}
@@ -522,7 +721,7 @@ private:
 		}
 		else 
 		{
-			m_ptrHead = currentNode->m_ptrNext;
+			shard.m_ptrHead = currentNode->m_ptrNext;
 		}
 
 		if (currentNode->m_ptrNext) 
@@ -530,17 +729,36 @@ private:
 			currentNode->m_ptrNext->m_ptrPrev = currentNode->m_ptrPrev;
 		}
 
-		currentNode->m_ptrPrev = m_ptrTail;
+		currentNode->m_ptrPrev = shard.m_ptrTail;
 		currentNode->m_ptrNext = nullptr;
 
-		m_ptrTail->m_ptrNext = currentNode;
+		shard.m_ptrTail->m_ptrNext = currentNode;
 
-		m_ptrTail = currentNode;
+		shard.m_ptrTail = currentNode;
 	}
 
-	inline void moveToFront(std::shared_ptr<Item> ptrItem)
+	inline void moveToFront(Shard& shard, std::shared_ptr<Item> ptrItem)
 	{
-		if (ptrItem == m_ptrHead)
+#ifdef __LEVEL_AWARE_CACHE__
+		if (ptrItem->m_nPinned > 0)
+		{
+			return;
+		}
+#endif __LEVEL_AWARE_CACHE__
+
+#ifdef __SCAN_RESISTANT_CACHE__
+		if (ptrItem->m_bProbation)
+		{
+			removeFromLRU(shard, ptrItem);
+			ptrItem->m_bProbation = false;
+			addToFront(shard, ptrItem);
+			return;
+		}
+#endif __SCAN_RESISTANT_CACHE__
+
+		ptrItem->m_nAccessStamp = m_nAccessStamp.fetch_add(1, std::memory_order_relaxed);
+
+		if (ptrItem == shard.m_ptrHead)
 		{
 			return;
 		}
@@ -555,33 +773,77 @@ private:
 			ptrItem->m_ptrNext->m_ptrPrev = ptrItem->m_ptrPrev;
 		}
 
-		if (ptrItem == m_ptrTail) 
+		if (ptrItem == shard.m_ptrTail) 
 		{
-			m_ptrTail = ptrItem->m_ptrPrev;
+			shard.m_ptrTail = ptrItem->m_ptrPrev;
 		}
 
 		ptrItem->m_ptrPrev = nullptr;
-		ptrItem->m_ptrNext = m_ptrHead;
+		ptrItem->m_ptrNext = shard.m_ptrHead;
 
-		if (m_ptrHead) 
+		if (shard.m_ptrHead) 
 		{
-			m_ptrHead->m_ptrPrev = ptrItem;
+			shard.m_ptrHead->m_ptrPrev = ptrItem;
 		}
-		m_ptrHead = ptrItem;
+		shard.m_ptrHead = ptrItem;
 	}
 
-	inline void removeFromLRU(std::shared_ptr<Item> ptrItem)
+	inline void addToFront(Shard& shard, std::shared_ptr<Item> ptrItem)
 	{
+		ptrItem->m_nAccessStamp = m_nAccessStamp.fetch_add(1, std::memory_order_relaxed);
+		updateSize(shard, ptrItem);
+
+		if (!shard.m_ptrHead)
+		{
+			shard.m_ptrHead = ptrItem;
+			shard.m_ptrTail = ptrItem;
+		}
+		else
+		{
+			ptrItem->m_ptrNext = shard.m_ptrHead;
+			shard.m_ptrHead->m_ptrPrev = ptrItem;
+			shard.m_ptrHead = ptrItem;
+		}
+	}
+
+	inline void removeFromLRU(Shard& shard, std::shared_ptr<Item> ptrItem)
+	{
+#ifdef __LEVEL_AWARE_CACHE__
+		if (ptrItem->m_nPinned > 0)
+		{
+			unpin(ptrItem);
+		}
+		else
+#endif __LEVEL_AWARE_CACHE__
+		{
+			unlink(shard, ptrItem);
+		}
+
+		shard.m_nBytes -= ptrItem->m_nSize;
+		ptrItem->m_nSize = 0;
+	}
+
+	// Unlinks the item from whichever list it is on.
+	inline void unlink(Shard& shard, std::shared_ptr<Item> ptrItem)
+	{
+#ifdef __SCAN_RESISTANT_CACHE__
+		std::shared_ptr<Item>& ptrHead = ptrItem->m_bProbation ? shard.m_ptrProbationHead : shard.m_ptrHead;
+		std::shared_ptr<Item>& ptrTail = ptrItem->m_bProbation ? shard.m_ptrProbationTail : shard.m_ptrTail;
+#else // !__SCAN_RESISTANT_CACHE__
+		std::shared_ptr<Item>& ptrHead = shard.m_ptrHead;
+		std::shared_ptr<Item>& ptrTail = shard.m_ptrTail;
+#endif __SCAN_RESISTANT_CACHE__
+
 		if (ptrItem->m_ptrPrev != nullptr) 
 		{
 			ptrItem->m_ptrPrev->m_ptrNext = ptrItem->m_ptrNext;
 		}
 		else 
 		{
-			m_ptrHead = ptrItem->m_ptrNext;
-			if (m_ptrHead != nullptr)
+			ptrHead = ptrItem->m_ptrNext;
+			if (ptrHead != nullptr)
 			{
-				m_ptrHead->m_ptrPrev = nullptr;
+				ptrHead->m_ptrPrev = nullptr;
 			}
 		}
 
@@ -591,89 +853,308 @@ private:
 		}
 		else 
 		{
-			m_ptrTail = ptrItem->m_ptrPrev;
-			if (m_ptrTail != nullptr)
+			ptrTail = ptrItem->m_ptrPrev;
+			if (ptrTail != nullptr)
 			{
-				m_ptrTail->m_ptrNext = nullptr;
+				ptrTail->m_ptrNext = nullptr;
 			}
 		}
+
+		ptrItem->m_ptrPrev = nullptr;
+		ptrItem->m_ptrNext = nullptr;
 	}
 
-	inline void flushItemsToStorage()
+	// The object may have grown or shrunk since it was last measured.
+	inline void updateSize(Shard& shard, std::shared_ptr<Item> ptrItem)
 	{
-#ifdef __CONCURRENT__
-		std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>> vtObjects;
+		size_t nSize = ptrItem->m_ptrObject->getSize();
 
-		std::unique_lock<std::shared_mutex> lock_cache(m_mtxCache);
+		shard.m_nBytes += nSize - ptrItem->m_nSize;
+		ptrItem->m_nSize = nSize;
+	}
 
-		if (m_mpObjects.size() < m_nCacheCapacity)
+	// An access through getObject or reorder, it refreshes the item unless it is still on probation.
+	inline void touch(Shard& shard, std::shared_ptr<Item> ptrItem)
+	{
+#ifdef __LEVEL_AWARE_CACHE__
+		if (ptrItem->m_ptrObject->depth.load(std::memory_order_relaxed) < CACHE_PINNED_LEVELS)
+		{
+			if (ptrItem->m_nPinned > 0 || pin(shard, ptrItem))
+			{
+				return;
+			}
+		}
+		else if (ptrItem->m_nPinned > 0)
+		{
+			// The tree has grown a level since.
+			unpin(ptrItem);
+			ptrItem->m_bProbation = false;
+			addToFront(shard, ptrItem);
 			return;
+		}
+#endif __LEVEL_AWARE_CACHE__
 
-		size_t nFlushCount = m_mpObjects.size() - m_nCacheCapacity;
+#ifdef __SCAN_RESISTANT_CACHE__
+		if (ptrItem->m_bProbation && !isAdmitted(shard, ptrItem))
+		{
+			return;
+		}
+#endif __SCAN_RESISTANT_CACHE__
+
+		moveToFront(shard, ptrItem);
+	}
+
+#ifdef __LEVEL_AWARE_CACHE__
+	// Takes the item off its list unless the pinned share of the capacity is used up.
+	inline bool pin(Shard& shard, std::shared_ptr<Item> ptrItem)
+	{
+		// An object that has not been to the storage yet has to leave the cache before its parent can, it is pinned
+		// only once it has been flushed and read again.
+		if (ptrItem->m_uidSelf.m_uid.m_nMediaType < ObjectUIDType::Media::PMem)
+		{
+			return false;
+		}
 
-		if (nFlushCount > FLUSH_COUNT)
-			nFlushCount = FLUSH_COUNT;
+#ifdef __CACHE_CAPACITY_IN_BYTES__
+		size_t nUsage = std::max<size_t>(ptrItem->m_nSize, 1);
+#else // !__CACHE_CAPACITY_IN_BYTES__
+		size_t nUsage = 1;
+#endif __CACHE_CAPACITY_IN_BYTES__
 
-		for (size_t idx = 0; idx < nFlushCount; idx++)
+		if (m_nPinnedUsage.load(std::memory_order_relaxed) + nUsage > m_nPinnedCapacity)
 		{
-			if (m_ptrTail->m_ptrObject.use_count() > 1)
+			return false;
+		}
+
+		unlink(shard, ptrItem);
+
+		ptrItem->m_nPinned = nUsage;
+		m_nPinnedUsage.fetch_add(nUsage, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	// Only gives the share back, the caller links the item again if it stays cached.
+	inline void unpin(std::shared_ptr<Item> ptrItem)
+	{
+		m_nPinnedUsage.fetch_sub(ptrItem->m_nPinned, std::memory_order_relaxed);
+		ptrItem->m_nPinned = 0;
+	}
+#endif __LEVEL_AWARE_CACHE__
+
+	inline void recordAccess(Shard& shard, const ObjectUIDType& uidObject)
+	{
+#ifdef __SCAN_RESISTANT_CACHE__
+		shard.m_sketch.increment(getHash(uidObject));
+#endif __SCAN_RESISTANT_CACHE__
+	}
+
+#ifdef __SCAN_RESISTANT_CACHE__
+	inline bool isAdmitted(Shard& shard, std::shared_ptr<Item> ptrItem)
+	{
+		return ptrItem->m_ptrObject->dirty || shard.m_sketch.estimate(getHash(ptrItem->m_uidSelf)) >= CACHE_ADMISSION_FREQUENCY;
+	}
+
+	inline void addToProbation(Shard& shard, std::shared_ptr<Item> ptrItem)
+	{
+		ptrItem->m_nAccessStamp = m_nAccessStamp.fetch_add(1, std::memory_order_relaxed);
+		ptrItem->m_bProbation = true;
+		updateSize(shard, ptrItem);
+
+		if (!shard.m_ptrProbationHead)
+		{
+			shard.m_ptrProbationHead = ptrItem;
+			shard.m_ptrProbationTail = ptrItem;
+		}
+		else
+		{
+			ptrItem->m_ptrNext = shard.m_ptrProbationHead;
+			shard.m_ptrProbationHead->m_ptrPrev = ptrItem;
+			shard.m_ptrProbationHead = ptrItem;
+		}
+	}
+#endif __SCAN_RESISTANT_CACHE__
+
+	inline uint64_t getHash(const ObjectUIDType& uidObject)
+	{
+		// std::hash can be the identity for integers and pointers, the multiplication spreads their (aligned) values.
+		return (uint64_t)std::hash<ObjectUIDType>()(uidObject) * 0x9E3779B97F4A7C15ull;
+	}
+
+	inline Shard& getShard(const ObjectUIDType& uidObject)
+	{
+		return m_arrShards[getHash(uidObject) >> (64 - CACHE_SHARD_BITS)];
+	}
+
+	// The shard whose tail was accessed the longest time ago, i.e. the tail of the cache as a whole.
+	inline Shard* getLeastRecentShard()
+	{
+		Shard* ptrShard = nullptr;
+		for (Shard& shard : m_arrShards)
+		{
+			if (shard.m_ptrTail != nullptr && (ptrShard == nullptr || shard.m_ptrTail->m_nAccessStamp < ptrShard->m_ptrTail->m_nAccessStamp))
 			{
-				/* Info: 
-				 * Should proceed with the preceeding one?
-				 * But since each operation reorders the items at the end, therefore, the prceeding items would be in use as well!
-				 */
-				break; 
+				ptrShard = &shard;
 			}
+		}
+		return ptrShard;
+	}
+
+	inline bool isInUse(std::shared_ptr<Item> ptrItem)
+	{
+		if (ptrItem->m_ptrObject.use_count() > 1)
+		{
+			return true;
+		}
 
-			// Check if the object is in use
-			if (!m_ptrTail->m_ptrObject->mutex.try_lock())
+#ifdef __CONCURRENT__
+		// Check if the object is in use
+		if (!ptrItem->m_ptrObject->mutex.try_lock())
+		{
+			return true;
+		}
+		ptrItem->m_ptrObject->mutex.unlock();
+#endif __CONCURRENT__
+
+		return false;
+	}
+
+	// The next item to flush, the least recent one on probation that is not in use or else the tail of the LRU list.
+	inline std::shared_ptr<Item> getItemToFlush(Shard*& ptrShard)
+	{
+#ifdef __SCAN_RESISTANT_CACHE__
+		// The objects on probation can go in any order, those still in use (e.g. the path of a running scan) are skipped.
+		std::shared_ptr<Item> ptrCandidate = nullptr;
+		for (Shard& shard : m_arrShards)
+		{
+			std::shared_ptr<Item> ptrItem = shard.m_ptrProbationTail;
+			while (ptrItem != nullptr && isInUse(ptrItem))
 			{
-				/* Info:
-				 * Should proceed with the preceeding one?
-				 * But since each operation reorders the items at the end, therefore, the prceeding items would be in use as well!
-				 */
-				break;
+				ptrItem = ptrItem->m_ptrPrev;
 			}
-			else
+
+			if (ptrItem != nullptr && (ptrCandidate == nullptr || ptrItem->m_nAccessStamp < ptrCandidate->m_nAccessStamp))
 			{
-				m_ptrTail->m_ptrObject->mutex.unlock();
+				ptrCandidate = ptrItem;
+				ptrShard = &shard;
 			}
+		}
 
+		if (ptrCandidate != nullptr)
+		{
+			if (ptrCandidate->m_ptrObject->dirty)
+			{
+				// Modified since it was read but not reordered yet, it has to take its place in the LRU order.
+				moveToFront(*ptrShard, ptrCandidate);
+				return getItemToFlush(ptrShard);
+			}
 
-			std::shared_ptr<Item> ptrItemToFlush = m_ptrTail;
+			return ptrCandidate;
+		}
+#endif __SCAN_RESISTANT_CACHE__
 
-			vtObjects.push_back(std::make_pair(ptrItemToFlush->m_uidSelf, std::make_pair(std::nullopt, ptrItemToFlush->m_ptrObject)));
+		ptrShard = getLeastRecentShard();
+		if (ptrShard == nullptr || isInUse(ptrShard->m_ptrTail))
+		{
+			/* Info:
+			 * Should proceed with the preceeding one?
+			 * But since each operation reorders the items at the end, therefore, the prceeding items would be in use as well!
+			 */
+			return nullptr;
+		}
 
-			m_mpObjects.erase(ptrItemToFlush->m_uidSelf);
+		return ptrShard->m_ptrTail;
+	}
 
-			m_ptrTail = ptrItemToFlush->m_ptrPrev;
+	inline size_t getObjectsCount()
+	{
+		size_t nCount = 0;
+		for (Shard& shard : m_arrShards)
+		{
+			nCount += shard.m_mpObjects.size();
+		}
+		return nCount;
+	}
 
-			ptrItemToFlush->m_ptrPrev = nullptr;
-			ptrItemToFlush->m_ptrNext = nullptr;
+	inline size_t getObjectsSize()
+	{
+		size_t nBytes = 0;
+		for (Shard& shard : m_arrShards)
+		{
+			nBytes += shard.m_nBytes;
+		}
+		return nBytes;
+	}
 
-			if (m_ptrTail)
-			{
-				m_ptrTail->m_ptrNext = nullptr;
-			}
-			else
+	// What the capacity is compared against.
+	inline size_t getCacheUsage()
+	{
+#ifdef __CACHE_CAPACITY_IN_BYTES__
+		return getObjectsSize();
+#else // !__CACHE_CAPACITY_IN_BYTES__
+		return getObjectsCount();
+#endif __CACHE_CAPACITY_IN_BYTES__
+	}
+
+	inline void flushItemsToStorage()
+	{
+#ifdef __CONCURRENT__
+		std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>> vtObjects;
+
+		// All the shards are locked (always in the same order) so that the tails can be compared.
+		std::vector<std::unique_lock<std::shared_mutex>> vtLocks;
+		vtLocks.reserve(CACHE_SHARD_COUNT);
+		for (Shard& shard : m_arrShards)
+		{
+			vtLocks.emplace_back(shard.m_mtxCache);
+		}
+
+		if (getCacheUsage() < m_nCacheCapacity)
+			return;
+
+		for (size_t idx = 0; idx < FLUSH_COUNT && getCacheUsage() > m_nCacheCapacity; idx++)
+		{
+			Shard* ptrShard = nullptr;
+			std::shared_ptr<Item> ptrItemToFlush = getItemToFlush(ptrShard);
+
+			if (ptrItemToFlush == nullptr)
 			{
-				m_ptrHead = nullptr;
+				break;
 			}
+
+			vtObjects.push_back(std::make_pair(ptrItemToFlush->m_uidSelf, std::make_pair(std::nullopt, ptrItemToFlush->m_ptrObject)));
+
+			ptrShard->m_mpObjects.erase(ptrItemToFlush->m_uidSelf);
+
+			removeFromLRU(*ptrShard, ptrItemToFlush);
 		}
 
 		std::unique_lock<std::shared_mutex> lock_storage(m_mtxStorage);
 
-		lock_cache.unlock();
+		vtLocks.clear();
+
+		releaseRetiredUIDs();
 
 		if (m_mpUpdatedUIDs.size() > 0)
 		{
+			for (auto& prObject : vtObjects)
+			{
+				retireAppliedUIDs(prObject.second.second);
+			}
+
 			m_ptrCallback->applyExistingUpdates(vtObjects, m_mpUpdatedUIDs);
 		}
 
-		// Important: Ensure that no other thread should write to the stroage as the nPos is use to generate the addresses.
-		size_t nPos = m_ptrStorage->getWritePos();
+		// The storage hands out the blocks, freed ones included.
+		m_ptrCallback->prepareFlush(vtObjects, [this](size_t nBlocks) { return m_ptrStorage->allocate(nBlocks); }, m_ptrStorage->getBlockSize(), m_ptrStorage->getMediaType());
 
-		m_ptrCallback->prepareFlush(vtObjects, nPos, m_ptrStorage->getBlockSize(), m_ptrStorage->getMediaType());
+		// The objects flushed along with their parents are referred to by the new UIDs already.
+		std::unordered_set<ObjectUIDType> stAppliedUIDs;
+		for (auto& prObject : vtObjects)
+		{
+			m_ptrCallback->getChildUIDs(prObject.second.second, m_vtChildUIDs);
+			stAppliedUIDs.insert(m_vtChildUIDs.begin(), m_vtChildUIDs.end());
+		}
 
 		auto it = vtObjects.begin();
 		while (it != vtObjects.end())
@@ -692,12 +1173,17 @@ private:
 				m_mpUpdatedUIDs[(*it).first] = std::make_pair(std::nullopt, (*it).second.second);
 			}
 
+			if (stAppliedUIDs.find(*(*it).second.first) != stAppliedUIDs.end())
+			{
+				m_vtAppliedUIDs.push_back((*it).first);
+			}
+
 			it++;
 		}
 
 		lock_storage.unlock();
 		
-		m_ptrStorage->addObjects(vtObjects, nPos);
+		m_ptrStorage->addObjects(vtObjects);
 
 		it = vtObjects.begin();
 		while (it != vtObjects.end())
@@ -718,54 +1204,95 @@ private:
 
 		vtObjects.clear();
 #else
-		while (m_mpObjects.size() > m_nCacheCapacity)
+		releaseRetiredUIDs();
+
+		while (getCacheUsage() > m_nCacheCapacity)
 		{
-			if (m_ptrTail->m_ptrObject.use_count() > 1)
+			Shard* ptrShard = nullptr;
+			std::shared_ptr<Item> ptrItemToFlush = getItemToFlush(ptrShard);
+
+			if (ptrItemToFlush == nullptr)
 			{
-				/* Info:
-				 * Should proceed with the preceeding one?
-				 * But since each operation reorders the items at the end, therefore, the prceeding items would be in use as well!
-				 */
 				break;
 			}
 
-			if (m_ptrTail->m_ptrObject->dirty)
+			if (ptrItemToFlush->m_ptrObject->dirty)
 			{
 				if (m_mpUpdatedUIDs.size() > 0)
 				{
-					m_ptrCallback->applyExistingUpdates(m_ptrTail->m_ptrObject, m_mpUpdatedUIDs);
+					retireAppliedUIDs(ptrItemToFlush->m_ptrObject);
+
+					m_ptrCallback->applyExistingUpdates(ptrItemToFlush->m_ptrObject, m_mpUpdatedUIDs);
 				}
 
 				ObjectUIDType uidUpdated;
-				if (m_ptrStorage->addObject(m_ptrTail->m_uidSelf, m_ptrTail->m_ptrObject, uidUpdated) != CacheErrorCode::Success)
+				if (m_ptrStorage->addObject(ptrItemToFlush->m_uidSelf, ptrItemToFlush->m_ptrObject, uidUpdated) != CacheErrorCode::Success)
 				{
 					throw new std::exception("should not occur!");
 				}
 
-				if (m_mpUpdatedUIDs.find(m_ptrTail->m_uidSelf) != m_mpUpdatedUIDs.end())
+				if (m_mpUpdatedUIDs.find(ptrItemToFlush->m_uidSelf) != m_mpUpdatedUIDs.end())
 				{
 					throw new std::exception("should not occur!");
 				}
 
-				m_mpUpdatedUIDs[m_ptrTail->m_uidSelf] = std::make_pair(uidUpdated, m_ptrTail->m_ptrObject);
+				m_mpUpdatedUIDs[ptrItemToFlush->m_uidSelf] = std::make_pair(uidUpdated, ptrItemToFlush->m_ptrObject);
 			}
 
-			m_mpObjects.erase(m_ptrTail->m_uidSelf);
+			ptrShard->m_mpObjects.erase(ptrItemToFlush->m_uidSelf);
 
-			std::shared_ptr<Item> ptrTemp = m_ptrTail;
+			removeFromLRU(*ptrShard, ptrItemToFlush);
+		}
+#endif __CONCURRENT__
+	}
+
+	// The updates that applyExistingUpdates is about to apply to the given object.
+	inline void retireAppliedUIDs(std::shared_ptr<ObjectType> ptrObject)
+	{
+		m_ptrCallback->getChildUIDs(ptrObject, m_vtChildUIDs);
 
-			m_ptrTail = m_ptrTail->m_ptrPrev;
+		for (const ObjectUIDType& uidChild : m_vtChildUIDs)
+		{
+			if (m_mpUpdatedUIDs.find(uidChild) != m_mpUpdatedUIDs.end())
+			{
+				m_vtRetiredUIDs.push_back(uidChild);
+			}
+		}
+	}
 
-			if (m_ptrTail)
+	// The storage takes the retired UIDs back a flush later, so that the caller that got the new UID has updated the
+	// parent and a reader that picked up the old one right before does not find its blocks handed out again already.
+	inline void releaseRetiredUIDs()
+	{
+		// A reader may have looked one up in the meantime and retired it already.
+		auto it = m_vtAppliedUIDs.begin();
+		while (it != m_vtAppliedUIDs.end())
+		{
+			auto itUpdated = m_mpUpdatedUIDs.find(*it);
+			if (itUpdated == m_mpUpdatedUIDs.end())
 			{
-				m_ptrTail->m_ptrNext = nullptr;
+				it = m_vtAppliedUIDs.erase(it);
+			}
+			else if ((*itUpdated).second.first != std::nullopt)
+			{
+				m_mpUpdatedUIDs.erase(itUpdated);	// Applied.
+				m_vtRetiredUIDs.push_back(*it);
+
+				it = m_vtAppliedUIDs.erase(it);
 			}
 			else
 			{
-				m_ptrHead = nullptr;
+				it++;
 			}
 		}
-#endif __CONCURRENT__
+
+		for (const ObjectUIDType& uidObject : m_vtReleasableUIDs)
+		{
+			m_ptrStorage->remove(uidObject);
+		}
+
+		m_vtReleasableUIDs.swap(m_vtRetiredUIDs);
+		m_vtRetiredUIDs.clear();
 	}
 
 #ifdef __CONCURRENT__
@@ -796,7 +1323,12 @@ public:
 	}
 
 	void prepareFlush(std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>>& vtObjects
-		, size_t& nOffset, size_t nPointerSize, ObjectUIDType::Media nMediaType)
+		, const std::function<size_t(size_t)>& fnAllocate, size_t nBlockSize, ObjectUIDType::Media nMediaType)
+	{
+
+	}
+
+	void getChildUIDs(std::shared_ptr<ObjectType> ptrObject, std::vector<ObjectUIDType>& vtChildUIDs)
 	{
 
 	}
@@ -6,6 +6,8 @@
 #include <thread>
 #include <variant>
 #include <typeinfo>
+#include <atomic>
+#include <cstdint>
 
 #include <iostream>
 #include <fstream>
@@ -42,6 +44,7 @@ public:
 	bool dirty;
 	CoreTypesWrapperPtr data;
 	mutable std::shared_mutex mutex;
+	std::atomic<uint8_t> depth{ UINT8_MAX };	// distance from the root as last seen by the tree, UINT8_MAX if unknown.
 
 public:
 	template<class Type>
@@ -70,6 +73,11 @@ public:
 		CoreTypesMarshaller::template deserialize<CoreTypesWrapper, CoreTypes...>(szBuffer, data);
 	}
 
+	inline size_t getSize()
+	{
+		return std::visit([](const auto& ptrCoreObject) { return ptrCoreObject->getSize(); }, *data);
+	}
+
 	inline void serialize(std::fstream& os, uint8_t& uidObjectType, size_t& nBufferSize)
 	{
 		CoreTypesMarshaller::template serialize<CoreTypes...>(os, *data, uidObjectType, nBufferSize);
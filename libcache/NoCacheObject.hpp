@@ -6,6 +6,8 @@
 #include <thread>
 #include <variant>
 #include <typeinfo>
+#include <atomic>
+#include <cstdint>
 
 #include "ErrorCodes.h"
 
@@ -21,6 +23,7 @@ public:
 public:
 	CacheValueTypePtr data;
 	mutable std::shared_mutex mutex;
+	std::atomic<uint8_t> depth{ UINT8_MAX };	// distance from the root as last seen by the tree, UINT8_MAX if unknown.
 
 public:
 	NoCacheObject(CacheValueTypePtr ptrValue)
@@ -2,6 +2,7 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <exception>
 
 class ObjectFatUID
 {
@@ -15,22 +16,39 @@ public:
 		File
 	};
 
+	// The uid is a single tagged 64-bit word, the media type in the top bits and the address below. A file address is
+	// the offset and the size (in bytes) of the object, i.e. files of up to 2 TB and objects of up to 1 MB.
+	static constexpr uint8_t MEDIA_BITS = 3;
+	static constexpr uint8_t ADDRESS_BITS = 64 - MEDIA_BITS;
+	static constexpr uint8_t FILE_SIZE_BITS = 20;
+	static constexpr uint8_t FILE_OFFSET_BITS = ADDRESS_BITS - FILE_SIZE_BITS;
+
 	struct FilePointer
 	{
-		uint32_t m_nOffset;
-		uint32_t m_nSize;
+		uint64_t m_nOffset : FILE_OFFSET_BITS;
+		uint64_t m_nSize : FILE_SIZE_BITS;
 	};
 
-	struct NodeUID
+	// The members share the word, each of them only covers its own bits.
+	union NodeUID
 	{
-		uint8_t m_nMediaType;
+		struct
+		{
+			uint64_t : ADDRESS_BITS;
+			uint64_t m_nMediaType : MEDIA_BITS;
+		};
+
 		union
 		{
-			uintptr_t m_ptrVolatile;
+			uint64_t m_ptrVolatile : ADDRESS_BITS;
 			FilePointer m_ptrFile;
 		} FATPOINTER;
+
+		uint64_t m_nValue;
 	};
 
+	static_assert(sizeof(NodeUID) == sizeof(uint64_t), "NodeUID must fit in a single 64-bit word.");
+
 	NodeUID m_uid;
 
 	template <typename... Args>
@@ -54,18 +72,30 @@ public:
 		}
 	}
 
-	static ObjectFatUID createAddressFromFileOffset(uint32_t nPos, uint32_t nBlockSize, uint32_t nSize)
+	static ObjectFatUID createAddressFromFileOffset(uint64_t nPos, uint64_t nBlockSize, uint64_t nSize)
 	{
+		uint64_t nOffset = nPos * nBlockSize;
+
+		if ((nOffset >> FILE_OFFSET_BITS) != 0 || (nSize >> FILE_SIZE_BITS) != 0)
+		{
+			throw new std::exception("should not occur!");	// TODO: critical log.
+		}
+
 		ObjectFatUID key;
 		key.m_uid.m_nMediaType = File;
-		key.m_uid.FATPOINTER.m_ptrFile.m_nOffset = nPos * nBlockSize;
-		key.m_uid.FATPOINTER.m_ptrFile.m_nSize= nSize;
+		key.m_uid.FATPOINTER.m_ptrFile.m_nOffset = nOffset;
+		key.m_uid.FATPOINTER.m_ptrFile.m_nSize = nSize;
 
 		return key;
 	}
 
 	static ObjectFatUID createAddressFromVolatilePointer(uintptr_t ptr, ...)
 	{
+		if (((uint64_t)ptr >> ADDRESS_BITS) != 0)
+		{
+			throw new std::exception("should not occur!");	// TODO: critical log.
+		}
+
 		ObjectFatUID key;
 		key.m_uid.m_nMediaType = Volatile;
 		key.m_uid.FATPOINTER.m_ptrVolatile = ptr;
@@ -75,6 +105,11 @@ public:
 
 	static ObjectFatUID createAddressFromDRAMCacheCounter(uintptr_t ptr, ...)
 	{
+		if (((uint64_t)ptr >> ADDRESS_BITS) != 0)
+		{
+			throw new std::exception("should not occur!");	// TODO: critical log.
+		}
+
 		ObjectFatUID key;
 		key.m_uid.m_nMediaType = DRAM;
 		key.m_uid.FATPOINTER.m_ptrVolatile = ptr;
@@ -84,12 +119,12 @@ public:
 
 	bool operator==(const ObjectFatUID& rhs) const 
 	{
-		return memcmp(&m_uid, &rhs.m_uid, sizeof(NodeUID)) == 0;
+		return m_uid.m_nValue == rhs.m_uid.m_nValue;
 	}
 
 	bool operator <(const ObjectFatUID& rhs) const
 	{
-		return memcmp(&m_uid, &rhs.m_uid, sizeof(NodeUID)) < 1;
+		return m_uid.m_nValue < rhs.m_uid.m_nValue;
 	}
 
 	struct HashFunction
@@ -97,10 +132,7 @@ public:
 	public:
 		size_t operator()(const ObjectFatUID& rhs) const
 		{
-			return std::hash<uint8_t>()(rhs.m_uid.m_nMediaType)
-				^ std::hash<uintptr_t>()(rhs.m_uid.FATPOINTER.m_ptrVolatile)
-				^ std::hash<uint32_t>()(rhs.m_uid.FATPOINTER.m_ptrFile.m_nOffset)
-				^ std::hash<uint32_t>()(rhs.m_uid.FATPOINTER.m_ptrFile.m_nSize);
+			return std::hash<uint64_t>()(rhs.m_uid.m_nValue);
 		}
 	};
 
@@ -109,7 +141,7 @@ public:
 	public:
 		bool operator()(const ObjectFatUID& lhs, const ObjectFatUID& rhs) const 
 		{
-			return memcmp(&lhs.m_uid, &rhs.m_uid, sizeof(NodeUID)) == 0;
+			return lhs.m_uid.m_nValue == rhs.m_uid.m_nValue;
 		}
 	};
 
@@ -153,25 +185,8 @@ namespace std {
 	struct hash<ObjectFatUID> {
 		size_t operator()(const ObjectFatUID& rhs) const
 		{
-			size_t hashValue = 0;
-			hashValue ^= std::hash<uint8_t>()(rhs.m_uid.m_nMediaType);
-
-			switch (rhs.m_uid.m_nMediaType)
-			{
-			case ObjectFatUID::Media::Volatile:
-				hashValue ^= std::hash<uintptr_t>()(rhs.m_uid.FATPOINTER.m_ptrVolatile);
-				break;
-			case ObjectFatUID::Media::DRAM:
-				hashValue ^= std::hash<uintptr_t>()(rhs.m_uid.FATPOINTER.m_ptrVolatile);
-				break;
-			case ObjectFatUID::Media::File:
-				size_t offsetHash = std::hash<uint32_t>()(rhs.m_uid.FATPOINTER.m_ptrFile.m_nOffset);
-				size_t sizeHash = std::hash<uint32_t>()(rhs.m_uid.FATPOINTER.m_ptrFile.m_nSize);
-				hashValue ^= offsetHash ^ (sizeHash + 0x9e3779b9 + (offsetHash << 6) + (offsetHash >> 2));
-				break;
-			}
-
-			return hashValue;
+			// The media type and the address make up the word.
+			return std::hash<uint64_t>()(rhs.m_uid.m_nValue);
 		}
 	};
 }
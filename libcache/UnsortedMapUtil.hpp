@@ -11,22 +11,7 @@ struct SharedPtrHash
 
 	std::size_t operator()(const ObjectFatUID& rhs) const
 	{
-		size_t hashValue = 0;
-		hashValue ^= std::hash<uint8_t>()(rhs.m_uid.m_nMediaType);
-
-		switch (rhs.m_uid.m_nMediaType)
-		{
-		case ObjectFatUID::Media::Volatile:
-			hashValue ^= std::hash<uintptr_t>()(rhs.m_uid.FATPOINTER.m_ptrVolatile);
-			break;
-		case ObjectFatUID::Media::File:
-			size_t offsetHash = std::hash<uint32_t>()(rhs.m_uid.FATPOINTER.m_ptrFile.m_nOffset);
-			size_t sizeHash = std::hash<uint32_t>()(rhs.m_uid.FATPOINTER.m_ptrFile.m_nSize);
-			hashValue ^= offsetHash ^ (sizeHash + 0x9e3779b9 + (offsetHash << 6) + (offsetHash >> 2));
-			break;
-		}
-
-		return hashValue;
+		return std::hash<uint64_t>()(rhs.m_uid.m_nValue);
 	}
 
 };
@@ -39,7 +24,7 @@ struct SharedPtrEqual {
 
 	bool operator()(const ObjectFatUID& lhs, const ObjectFatUID& rhs) const
 	{
-		return memcmp(&lhs.m_uid, &rhs.m_uid, sizeof(NodeUID)) == 0;
+		return lhs.m_uid.m_nValue == rhs.m_uid.m_nValue;
 	}
 
 };
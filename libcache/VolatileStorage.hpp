@@ -94,9 +94,32 @@ public:
 		return CacheErrorCode::Success;
 	}
 
-	inline size_t getWritePos()
+	inline size_t allocate(size_t nBlocks)
 	{
-		return m_nCounter;
+#ifdef __CONCURRENT__
+		std::unique_lock<std::shared_mutex> lock_file_storage(m_mtxStorage);
+#endif __CONCURRENT__
+
+		size_t nPos = m_nCounter;
+		m_nCounter += nBlocks;
+
+		return nPos;
+	}
+
+	// The objects are not laid out in blocks, there is nothing to compact.
+	inline bool isRelocatable(const ObjectUIDType& uidObject)
+	{
+		return false;
+	}
+
+	inline double getFragmentation()
+	{
+		return 0;
+	}
+
+	inline size_t getUsedSize()
+	{
+		return 0;
 	}
 
 	inline size_t getBlockSize()
@@ -109,14 +132,12 @@ public:
 		return ObjectUIDType::DRAM;
 	}
 
-	CacheErrorCode addObjects(std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>>& vtObjects, size_t nNewOffset)
+	CacheErrorCode addObjects(std::vector<std::pair<ObjectUIDType, std::pair<std::optional<ObjectUIDType>, std::shared_ptr<ObjectType>>>>& vtObjects)
 	{
 #ifdef __CONCURRENT__
 		std::unique_lock<std::shared_mutex> lock_file_storage(m_mtxStorage);
 #endif __CONCURRENT__
 
-		m_nCounter = nNewOffset;
-
 		auto it = vtObjects.begin();
 		while (it != vtObjects.end())
 		{
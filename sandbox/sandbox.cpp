@@ -10,9 +10,11 @@
 
 #include "DataNode.hpp"
 #include "IndexNode.hpp"
+#include "KeySearch.hpp"
 
 #include <chrono>
 #include <cassert>
+#include <algorithm>
 
 #include "LRUCache.hpp"
 #include "VolatileStorage.hpp"
@@ -566,8 +568,91 @@ void test_for_threaded()
 #endif __CONCURRENT__
 }
 
+void test_for_key_search()
+{
+    // Times the linear scan against the binary search for the node sizes of interest, the crossover is where
+    // LINEAR_SEARCH_CUTOFF (or SIMD_LINEAR_SEARCH_CUTOFF with AVX2) should sit. The default is the hybrid of both,
+    // where the Eytzinger layout overtakes it is where EYTZINGER_MIN_PIVOTS should sit.
+    const size_t nSearches = 1000000;
+
+    for (size_t nKeys : { 4, 8, 16, 24, 32, 48, 64, 96, 128, 256, 512, 1024 }) {
+        std::vector<int> vtKeys;
+        for (size_t nCntr = 0; nCntr < nKeys; nCntr++)
+        {
+            vtKeys.push_back(nCntr * 2);
+        }
+
+        std::vector<int> vtProbes;
+        for (size_t nCntr = 0; nCntr < nSearches; nCntr++)
+        {
+            vtProbes.push_back(rand() % (nKeys * 2 + 1));
+        }
+
+        size_t nSum = 0;
+
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (size_t nCntr = 0; nCntr < nSearches; nCntr++)
+        {
+            nSum += KeySearch::upperBound(vtKeys, vtProbes[nCntr], SIZE_MAX);
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        size_t nLinear = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+        begin = std::chrono::steady_clock::now();
+        for (size_t nCntr = 0; nCntr < nSearches; nCntr++)
+        {
+            nSum -= KeySearch::upperBound(vtKeys, vtProbes[nCntr], 0);
+        }
+        end = std::chrono::steady_clock::now();
+        size_t nBinary = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+        begin = std::chrono::steady_clock::now();
+        for (size_t nCntr = 0; nCntr < nSearches; nCntr++)
+        {
+            nSum += KeySearch::upperBound(vtKeys, vtProbes[nCntr]);
+        }
+        end = std::chrono::steady_clock::now();
+        size_t nDefault = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+        begin = std::chrono::steady_clock::now();
+        for (size_t nCntr = 0; nCntr < nSearches; nCntr++)
+        {
+            nSum -= std::upper_bound(vtKeys.begin(), vtKeys.end(), vtProbes[nCntr]) - vtKeys.begin();
+        }
+        end = std::chrono::steady_clock::now();
+        size_t nStd = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+        std::vector<int> vtEytzinger;
+        std::vector<size_t> vtEytzingerRanks;
+        KeySearch::buildEytzinger(vtKeys, vtEytzinger, vtEytzingerRanks);
+
+        begin = std::chrono::steady_clock::now();
+        for (size_t nCntr = 0; nCntr < nSearches; nCntr++)
+        {
+            nSum += KeySearch::upperBoundEytzinger(vtEytzinger, vtEytzingerRanks, vtProbes[nCntr]);
+        }
+        end = std::chrono::steady_clock::now();
+        size_t nEytzinger = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+        for (size_t nCntr = 0; nCntr < nSearches; nCntr++)
+        {
+            nSum -= KeySearch::upperBound(vtKeys, vtProbes[nCntr]);
+        }
+
+        assert(nSum == 0);
+
+        std::cout << "test_for_key_search keys:" << nKeys
+            << "| linear: " << (double)nLinear / nSearches << "[ns]"
+            << "| binary: " << (double)nBinary / nSearches << "[ns]"
+            << "| default: " << (double)nDefault / nSearches << "[ns]"
+            << "| std: " << (double)nStd / nSearches << "[ns]"
+            << "| eytzinger: " << (double)nEytzinger / nSearches << "[ns]" << std::endl;
+    }
+}
+
 int main(int argc, char* argv[])
 {
+    test_for_key_search();
     test_for_ints();
     test_for_string();
     test_for_threaded();
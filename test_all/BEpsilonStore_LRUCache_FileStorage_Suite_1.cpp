@@ -0,0 +1,274 @@
+#include "pch.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <variant>
+#include <typeinfo>
+#include <type_traits>
+
+#include "glog/logging.h"
+
+#include "LRUCache.hpp"
+#include "IndexNodeWithBuffer.hpp"
+#include "DataNode.hpp"
+#include "BEpsilonStore.hpp"
+#include "LRUCacheObject.hpp"
+#include "FileStorage.hpp"
+#include "TypeMarshaller.hpp"
+#include "TypeUID.h"
+#include "ObjectFatUID.h"
+#include "IFlushCallback.h"
+
+#ifdef __TREE_AWARE_CACHE__
+namespace BEpsilonStore_LRUCache_FileStorage_Suite
+{
+    class BEpsilonStore_LRUCache_FileStorage_Suite_1 : public ::testing::TestWithParam<std::tuple<int, int, int, int, int, int, int, string>>
+    {
+    protected:
+        typedef int KeyType;
+        typedef int ValueType;
+        typedef ObjectFatUID ObjectUIDType;
+
+        typedef DataNode<KeyType, ValueType, ObjectUIDType, TYPE_UID::DATA_NODE_INT_INT > DataNodeType;
+        typedef IndexNodeWithBuffer<KeyType, ValueType, ObjectUIDType, TYPE_UID::INDEX_NODE_WITH_BUFFER_INT_INT > InternalNodeType;
+
+        typedef IFlushCallback<ObjectUIDType> ICallback;
+
+        typedef BEpsilonStore<ICallback, KeyType, ValueType, LRUCache<ICallback, FileStorage<ICallback, ObjectUIDType, LRUCacheObject, TypeMarshaller, DataNodeType, InternalNodeType>>> BEpsilonStoreType;
+
+        void SetUp() override
+        {
+            std::tie(nDegree, nBufferSize, nBegin_BulkInsert, nEnd_BulkInsert, nCacheSize, nBlockSize, nFileSize, stFileName) = GetParam();
+        }
+
+        void TearDown() override {
+        }
+
+        int nDegree;
+        int nBufferSize;
+        int nBegin_BulkInsert;
+        int nEnd_BulkInsert;
+        int nCacheSize;
+        int nBlockSize;
+        int nFileSize;
+        string stFileName;
+    };
+
+    TEST_P(BEpsilonStore_LRUCache_FileStorage_Suite_1, Bulk_Insert_v1) {
+
+        BEpsilonStoreType* ptrTree = new BEpsilonStoreType(nDegree, nBufferSize, nCacheSize, nBlockSize, nFileSize, stFileName);
+        ptrTree->template init<DataNodeType>();
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            ptrTree->insert(nCntr, nCntr);
+        }
+
+        delete ptrTree;
+    }
+
+    TEST_P(BEpsilonStore_LRUCache_FileStorage_Suite_1, Bulk_Search_v1) {
+
+        BEpsilonStoreType* ptrTree = new BEpsilonStoreType(nDegree, nBufferSize, nCacheSize, nBlockSize, nFileSize, stFileName);
+        ptrTree->template init<DataNodeType>();
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            ptrTree->insert(nCntr, nCntr);
+        }
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            int nValue = 0;
+            ErrorCode code = ptrTree->search(nCntr, nValue);
+
+            ASSERT_EQ(code, ErrorCode::Success);
+            ASSERT_EQ(nValue, nCntr);
+        }
+
+        delete ptrTree;
+    }
+
+    TEST_P(BEpsilonStore_LRUCache_FileStorage_Suite_1, Bulk_Search_v2) {
+
+        BEpsilonStoreType* ptrTree = new BEpsilonStoreType(nDegree, nBufferSize, nCacheSize, nBlockSize, nFileSize, stFileName);
+        ptrTree->template init<DataNodeType>();
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr = nCntr + 2)
+        {
+            ptrTree->insert(nCntr, nCntr);
+        }
+
+        for (int nCntr = nEnd_BulkInsert; nCntr >= nBegin_BulkInsert; nCntr--)
+        {
+            if ((nCntr - nBegin_BulkInsert) % 2 != 0)
+            {
+                ptrTree->insert(nCntr, nCntr);
+            }
+        }
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            int nValue = 0;
+            ErrorCode code = ptrTree->search(nCntr, nValue);
+
+            ASSERT_EQ(code, ErrorCode::Success);
+            ASSERT_EQ(nValue, nCntr);
+        }
+
+        delete ptrTree;
+    }
+
+    TEST_P(BEpsilonStore_LRUCache_FileStorage_Suite_1, Bulk_Overwrite_v1) {
+
+        BEpsilonStoreType* ptrTree = new BEpsilonStoreType(nDegree, nBufferSize, nCacheSize, nBlockSize, nFileSize, stFileName);
+        ptrTree->template init<DataNodeType>();
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            ptrTree->insert(nCntr, nCntr);
+        }
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr = nCntr + 3)
+        {
+            ptrTree->insert(nCntr, nCntr * 2);
+        }
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            int nValue = 0;
+            ErrorCode code = ptrTree->search(nCntr, nValue);
+
+            ASSERT_EQ(code, ErrorCode::Success);
+            ASSERT_EQ(nValue, (nCntr - nBegin_BulkInsert) % 3 == 0 ? nCntr * 2 : nCntr);
+        }
+
+        delete ptrTree;
+    }
+
+    TEST_P(BEpsilonStore_LRUCache_FileStorage_Suite_1, Bulk_Upsert_v1) {
+
+        BEpsilonStoreType* ptrTree = new BEpsilonStoreType(nDegree, nBufferSize, nCacheSize, nBlockSize, nFileSize, stFileName);
+        ptrTree->template init<DataNodeType>();
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr = nCntr + 2)
+        {
+            ptrTree->insert(nCntr, nCntr);
+        }
+
+        // Keys that are not there take the delta.
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            ptrTree->upsert(nCntr, 1);
+        }
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            ptrTree->upsert(nCntr, 2);
+        }
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            int nValue = 0;
+            ErrorCode code = ptrTree->search(nCntr, nValue);
+
+            ASSERT_EQ(code, ErrorCode::Success);
+            ASSERT_EQ(nValue, (nCntr - nBegin_BulkInsert) % 2 == 0 ? nCntr + 3 : 3);
+        }
+
+        delete ptrTree;
+    }
+
+    TEST_P(BEpsilonStore_LRUCache_FileStorage_Suite_1, Bulk_Delete_v1) {
+
+        BEpsilonStoreType* ptrTree = new BEpsilonStoreType(nDegree, nBufferSize, nCacheSize, nBlockSize, nFileSize, stFileName);
+        ptrTree->template init<DataNodeType>();
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            ptrTree->insert(nCntr, nCntr);
+        }
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            ErrorCode code = ptrTree->remove(nCntr);
+
+            ASSERT_EQ(code, ErrorCode::Success);
+        }
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            int nValue = 0;
+            ErrorCode code = ptrTree->search(nCntr, nValue);
+
+            ASSERT_EQ(code, ErrorCode::KeyDoesNotExist);
+        }
+
+        delete ptrTree;
+    }
+
+    TEST_P(BEpsilonStore_LRUCache_FileStorage_Suite_1, Bulk_Delete_v2) {
+
+        BEpsilonStoreType* ptrTree = new BEpsilonStoreType(nDegree, nBufferSize, nCacheSize, nBlockSize, nFileSize, stFileName);
+        ptrTree->template init<DataNodeType>();
+
+        for (int nCntr = nEnd_BulkInsert; nCntr >= nBegin_BulkInsert; nCntr--)
+        {
+            ptrTree->insert(nCntr, nCntr);
+        }
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr = nCntr + 2)
+        {
+            ErrorCode code = ptrTree->remove(nCntr);
+
+            ASSERT_EQ(code, ErrorCode::Success);
+        }
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            int nValue = 0;
+            ErrorCode code = ptrTree->search(nCntr, nValue);
+
+            if ((nCntr - nBegin_BulkInsert) % 2 == 0)
+            {
+                ASSERT_EQ(code, ErrorCode::KeyDoesNotExist);
+            }
+            else
+            {
+                ASSERT_EQ(code, ErrorCode::Success);
+                ASSERT_EQ(nValue, nCntr);
+            }
+        }
+
+        // Re-inserting after the removes.
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr = nCntr + 2)
+        {
+            ptrTree->insert(nCntr, nCntr);
+        }
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            int nValue = 0;
+            ErrorCode code = ptrTree->search(nCntr, nValue);
+
+            ASSERT_EQ(code, ErrorCode::Success);
+            ASSERT_EQ(nValue, nCntr);
+        }
+
+        delete ptrTree;
+    }
+
+    INSTANTIATE_TEST_CASE_P(
+        Bulk_Insert_Search_Delete,
+        BEpsilonStore_LRUCache_FileStorage_Suite_1,
+        ::testing::Values(
+            std::make_tuple(3, 16, 0, 99999, 100, 1024, 1024 * 1024 * 1024, "D:\\filestore.hdb"),
+            std::make_tuple(4, 16, 0, 99999, 100, 1024, 1024 * 1024 * 1024, "D:\\filestore.hdb"),
+            std::make_tuple(5, 32, 0, 99999, 100, 1024, 1024 * 1024 * 1024, "D:\\filestore.hdb"),
+            std::make_tuple(8, 32, 0, 99999, 100, 1024, 1024 * 1024 * 1024, "D:\\filestore.hdb"),
+            std::make_tuple(16, 64, 0, 199999, 100, 2048, 1024 * 1024 * 1024, "D:\\filestore.hdb"),
+            std::make_tuple(32, 64, 0, 199999, 100, 4096, 1024 * 1024 * 1024, "D:\\filestore.hdb")
+        ));
+}
+#endif __TREE_AWARE_CACHE__
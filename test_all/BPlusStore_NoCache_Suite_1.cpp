@@ -278,6 +278,173 @@ namespace BPlusStore_NoCache_Suite
         delete ptrTree;
     }
 
+    TEST_P(BPlusStore_NoCache_Suite_1, Range_Scan_v1) {
+
+        BPlusStoreType* ptrTree = new BPlusStoreType(nDegree);
+        ptrTree->template init<DataNodeType>();
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr = nCntr + 2)
+        {
+            ptrTree->insert(nCntr, nCntr);
+        }
+
+        for (size_t nCntr = nBegin_BulkInsert + 1; nCntr <= nEnd_BulkInsert; nCntr = nCntr + 2)
+        {
+            ptrTree->insert(nCntr, nCntr);
+        }
+
+        int nExpected = nBegin_BulkInsert;
+        ErrorCode code = ptrTree->scan(nBegin_BulkInsert, nEnd_BulkInsert + 1, [&nExpected](const int& nKey, const int& nValue) {
+            EXPECT_EQ(nKey, nExpected);
+            EXPECT_EQ(nValue, nExpected);
+            nExpected++;
+            return true;
+        });
+
+        ASSERT_EQ(code, ErrorCode::Success);
+        ASSERT_EQ(nExpected, nEnd_BulkInsert + 1);
+
+        int nRangeBegin = nBegin_BulkInsert + (nEnd_BulkInsert - nBegin_BulkInsert) / 3;
+        int nRangeEnd = nRangeBegin + 1000;
+
+        nExpected = nRangeBegin;
+        ptrTree->scan(nRangeBegin, nRangeEnd, [&nExpected](const int& nKey, const int& nValue) {
+            EXPECT_EQ(nKey, nExpected);
+            nExpected++;
+            return true;
+        });
+
+        ASSERT_EQ(nExpected, nRangeEnd);
+
+        delete ptrTree;
+    }
+
+    TEST_P(BPlusStore_NoCache_Suite_1, Reverse_Scan_v1) {
+
+        BPlusStoreType* ptrTree = new BPlusStoreType(nDegree);
+        ptrTree->template init<DataNodeType>();
+
+        for (int nCntr = nEnd_BulkInsert; nCntr >= nBegin_BulkInsert; nCntr--)
+        {
+            ptrTree->insert(nCntr, nCntr);
+        }
+
+        int nExpected = nEnd_BulkInsert;
+        ErrorCode code = ptrTree->reverseScan(nBegin_BulkInsert, nEnd_BulkInsert + 1, [&nExpected](const int& nKey, const int& nValue) {
+            EXPECT_EQ(nKey, nExpected);
+            EXPECT_EQ(nValue, nExpected);
+            nExpected--;
+            return true;
+        });
+
+        ASSERT_EQ(code, ErrorCode::Success);
+        ASSERT_EQ(nExpected, nBegin_BulkInsert - 1);
+
+        int nVisited = 0;
+        ptrTree->reverseScan(nBegin_BulkInsert, nEnd_BulkInsert + 1, [&nVisited](const int& nKey, const int& nValue) {
+            return ++nVisited < 10;
+        });
+
+        ASSERT_EQ(nVisited, 10);
+
+        delete ptrTree;
+    }
+
+    TEST_P(BPlusStore_NoCache_Suite_1, Bulk_Load_v1) {
+
+        BPlusStoreType* ptrTree = new BPlusStoreType(nDegree);
+        ptrTree->template init<DataNodeType>();
+
+        std::vector<std::pair<int, int>> vtEntries;
+        for (int nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr = nCntr + 2)
+        {
+            vtEntries.push_back(std::make_pair(nCntr, nCntr));
+        }
+
+        ASSERT_EQ(ptrTree->bulkLoad(vtEntries.begin(), vtEntries.end(), 0.7f), ErrorCode::Success);
+
+        for (size_t nCntr = nBegin_BulkInsert + 1; nCntr <= nEnd_BulkInsert; nCntr = nCntr + 2)
+        {
+            ptrTree->insert(nCntr, nCntr);
+        }
+
+        for (int nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            int nValue = 0;
+            ErrorCode code = ptrTree->search(nCntr, nValue);
+
+            ASSERT_EQ(nValue, nCntr);
+        }
+
+        delete ptrTree;
+    }
+
+    TEST_P(BPlusStore_NoCache_Suite_1, Batch_Insert_v1) {
+
+        BPlusStoreType* ptrTree = new BPlusStoreType(nDegree);
+        ptrTree->template init<DataNodeType>();
+
+        std::vector<std::pair<int, int>> vtEntries;
+        for (int nCntr = nEnd_BulkInsert; nCntr >= nBegin_BulkInsert; nCntr--)
+        {
+            vtEntries.push_back(std::make_pair(nCntr, nCntr));
+
+            if (vtEntries.size() == 1024)
+            {
+                ASSERT_EQ(ptrTree->insertBatch(vtEntries), ErrorCode::Success);
+                vtEntries.clear();
+            }
+        }
+
+        ASSERT_EQ(ptrTree->insertBatch(vtEntries), ErrorCode::Success);
+
+        for (int nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr++)
+        {
+            int nValue = 0;
+            ErrorCode code = ptrTree->search(nCntr, nValue);
+
+            ASSERT_EQ(nValue, nCntr);
+        }
+
+        delete ptrTree;
+    }
+
+    TEST_P(BPlusStore_NoCache_Suite_1, Batch_Search_v1) {
+
+        BPlusStoreType* ptrTree = new BPlusStoreType(nDegree);
+        ptrTree->template init<DataNodeType>();
+
+        for (size_t nCntr = nBegin_BulkInsert; nCntr <= nEnd_BulkInsert; nCntr = nCntr + 2)
+        {
+            ptrTree->insert(nCntr, nCntr);
+        }
+
+        std::vector<int> vtKeys;
+        for (int nCntr = nEnd_BulkInsert; nCntr >= nBegin_BulkInsert; nCntr--)
+        {
+            vtKeys.push_back(nCntr);
+        }
+
+        std::vector<int> vtValues;
+        std::vector<ErrorCode> vtErrorCodes;
+        ASSERT_EQ(ptrTree->searchBatch(vtKeys, vtValues, vtErrorCodes), ErrorCode::Success);
+
+        for (size_t nIdx = 0; nIdx < vtKeys.size(); nIdx++)
+        {
+            if ((vtKeys[nIdx] - nBegin_BulkInsert) % 2 == 0)
+            {
+                ASSERT_EQ(vtErrorCodes[nIdx], ErrorCode::Success);
+                ASSERT_EQ(vtValues[nIdx], vtKeys[nIdx]);
+            }
+            else
+            {
+                ASSERT_EQ(vtErrorCodes[nIdx], ErrorCode::KeyDoesNotExist);
+            }
+        }
+
+        delete ptrTree;
+    }
+
     INSTANTIATE_TEST_CASE_P(
         Bulk_Insert_Search_Delete,
         BPlusStore_NoCache_Suite_1,
@@ -291,6 +458,8 @@ namespace BPlusStore_NoCache_Suite
             std::make_tuple(15, 0, 199999),
             std::make_tuple(16, 0, 199999),
             std::make_tuple(32, 0, 199999),
-            std::make_tuple(64, 0, 199999)));   
+            std::make_tuple(64, 0, 199999),
+            std::make_tuple(256, 0, 199999),
+            std::make_tuple(512, 0, 199999)));   
 }
 #endif __TREE_AWARE_CACHE__
\ No newline at end of file
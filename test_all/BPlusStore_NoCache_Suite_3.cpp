@@ -329,6 +329,126 @@ namespace BPlusStore_NoCache_Suite
         delete ptrTree;
     }
 
+    TEST_P(BPlusStore_NoCache_Suite_3, Bulk_Search_While_Delete_v1) {
+
+        BPlusStoreType* ptrTree = new BPlusStoreType(nDegree);
+        ptrTree->template init<DataNodeType>();
+
+        std::vector<std::thread> vtThreads;
+
+        for (int nIdx = 0; nIdx < nThreadCount; nIdx++)
+        {
+            int nTotal = nTotalEntries / nThreadCount;
+            vtThreads.push_back(std::thread(insert_concurent, ptrTree, nIdx * nTotal, nIdx * nTotal + nTotal));
+        }
+
+        auto it = vtThreads.begin();
+        while (it != vtThreads.end())
+        {
+            (*it).join();
+            it++;
+        }
+
+        vtThreads.clear();
+
+        for (int nIdx = 0; nIdx < nThreadCount; nIdx++)
+        {
+            int nTotal = nTotalEntries / nThreadCount;
+            if (nIdx % 2 == 0)
+            {
+                vtThreads.push_back(std::thread(delete_concurent, ptrTree, nIdx * nTotal, nIdx * nTotal + nTotal));
+            }
+            else
+            {
+                vtThreads.push_back(std::thread(search_concurent, ptrTree, nIdx * nTotal, nIdx * nTotal + nTotal));
+            }
+        }
+
+        it = vtThreads.begin();
+        while (it != vtThreads.end())
+        {
+            (*it).join();
+            it++;
+        }
+
+        vtThreads.clear();
+
+        for (int nIdx = 0; nIdx < nThreadCount; nIdx += 2)
+        {
+            int nTotal = nTotalEntries / nThreadCount;
+            vtThreads.push_back(std::thread(search_not_found_concurent, ptrTree, nIdx * nTotal, nIdx * nTotal + nTotal));
+        }
+
+        it = vtThreads.begin();
+        while (it != vtThreads.end())
+        {
+            (*it).join();
+            it++;
+        }
+
+        delete ptrTree;
+    }
+
+    TEST_P(BPlusStore_NoCache_Suite_3, Bulk_Search_While_Insert_v1) {
+
+        BPlusStoreType* ptrTree = new BPlusStoreType(nDegree);
+        ptrTree->template init<DataNodeType>();
+
+        std::vector<std::thread> vtThreads;
+
+        for (int nIdx = 0; nIdx < nThreadCount; nIdx += 2)
+        {
+            int nTotal = nTotalEntries / nThreadCount;
+            vtThreads.push_back(std::thread(insert_concurent, ptrTree, nIdx * nTotal, nIdx * nTotal + nTotal));
+        }
+
+        auto it = vtThreads.begin();
+        while (it != vtThreads.end())
+        {
+            (*it).join();
+            it++;
+        }
+
+        vtThreads.clear();
+
+        for (int nIdx = 0; nIdx < nThreadCount; nIdx++)
+        {
+            int nTotal = nTotalEntries / nThreadCount;
+            if (nIdx % 2 == 0)
+            {
+                vtThreads.push_back(std::thread(search_concurent, ptrTree, nIdx * nTotal, nIdx * nTotal + nTotal));
+            }
+            else
+            {
+                vtThreads.push_back(std::thread(reverse_insert_concurent, ptrTree, nIdx * nTotal, nIdx * nTotal + nTotal));
+            }
+        }
+
+        it = vtThreads.begin();
+        while (it != vtThreads.end())
+        {
+            (*it).join();
+            it++;
+        }
+
+        vtThreads.clear();
+
+        for (int nIdx = 0; nIdx < nThreadCount; nIdx++)
+        {
+            int nTotal = nTotalEntries / nThreadCount;
+            vtThreads.push_back(std::thread(search_concurent, ptrTree, nIdx * nTotal, nIdx * nTotal + nTotal));
+        }
+
+        it = vtThreads.begin();
+        while (it != vtThreads.end())
+        {
+            (*it).join();
+            it++;
+        }
+
+        delete ptrTree;
+    }
+
 #ifdef __CONCURRENT__
     INSTANTIATE_TEST_CASE_P(
         Bulk_Insert_Search_Delete,